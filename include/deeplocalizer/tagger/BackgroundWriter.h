@@ -0,0 +1,66 @@
+#ifndef DEEP_LOCALIZER_BACKGROUNDWRITER_H
+#define DEEP_LOCALIZER_BACKGROUNDWRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <boost/optional.hpp>
+
+namespace deeplocalizer {
+
+// Runs writes on one dedicated thread, in the order they were submitted, so
+// the caller never waits for the disk. A job gets everything it writes
+// when it is submitted, e.g. a copy of the state.
+//
+// Jobs submitted with a key are coalesced: a job replaces the queued one
+// with the same key, so a slow disk writes only the newest snapshot
+// instead of falling behind.
+class BackgroundWriter {
+public:
+    using Job = std::function<void()>;
+    // Called on the writer thread after each job. `error` is set if the
+    // job threw.
+    using Callback = std::function<void(const std::string & key,
+                                        const boost::optional<std::string> & error)>;
+
+    explicit BackgroundWriter(Callback done = Callback());
+    // Runs the queued jobs before it returns.
+    ~BackgroundWriter();
+    BackgroundWriter(const BackgroundWriter &) = delete;
+    BackgroundWriter & operator=(const BackgroundWriter &) = delete;
+
+    // Queues `job`. It is never dropped.
+    void submit(Job job);
+    // Queues `job` after the other jobs and drops a queued job with the
+    // same `key`. A job that is already running is not affected.
+    void submit(const std::string & key, Job job);
+    // Blocks until every job submitted so far is done.
+    void flush();
+
+    size_t pending() const;
+    // number of jobs dropped for a newer one with the same key
+    size_t coalesced() const;
+private:
+    struct Item {
+        std::string key;
+        Job job;
+    };
+    const Callback _done;
+    std::deque<Item> _queue;
+    bool _running = false;
+    bool _stopped = false;
+    size_t _coalesced = 0;
+    mutable std::mutex _mutex;
+    std::condition_variable _queued;
+    std::condition_variable _idle;
+    std::thread _thread;
+
+    void run();
+};
+}
+
+#endif //DEEP_LOCALIZER_BACKGROUNDWRITER_H
@@ -0,0 +1,85 @@
+#ifndef DEEP_LOCALIZER_BOUNDEDQUEUE_H
+#define DEEP_LOCALIZER_BOUNDEDQUEUE_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace deeplocalizer {
+
+// A blocking FIFO queue with a fixed capacity. Producers block in `push` while
+// the queue is full and consumers block in `pop` while it is empty.
+// After `close` is called, `push` fails and `pop` drains the remaining items.
+template<typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : _capacity(std::max(capacity, size_t(1))) {}
+
+    bool push(T && item) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _not_full.wait(lock, [this]() { return _closed || _items.size() < _capacity; });
+        if (_closed) {
+            return false;
+        }
+        _items.push_back(std::move(item));
+        sample();
+        _not_empty.notify_one();
+        return true;
+    }
+
+    bool pop(T & item) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _not_empty.wait(lock, [this]() { return _closed || not _items.empty(); });
+        if (_items.empty()) {
+            return false;
+        }
+        item = std::move(_items.front());
+        _items.pop_front();
+        sample();
+        _not_full.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closed = true;
+        _not_full.notify_all();
+        _not_empty.notify_all();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _items.size();
+    }
+
+    size_t capacity() const {
+        return _capacity;
+    }
+
+    // Average fill ratio of the queue, sampled on every push and pop.
+    double meanOccupancy() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_nb_samples == 0) {
+            return 0;
+        }
+        return static_cast<double>(_sum_sizes) / (_nb_samples * _capacity);
+    }
+private:
+    const size_t _capacity;
+    std::deque<T> _items;
+    bool _closed = false;
+    size_t _sum_sizes = 0;
+    size_t _nb_samples = 0;
+    mutable std::mutex _mutex;
+    std::condition_variable _not_full;
+    std::condition_variable _not_empty;
+
+    void sample() {
+        _sum_sizes += _items.size();
+        _nb_samples++;
+    }
+};
+}
+
+#endif //DEEP_LOCALIZER_BOUNDEDQUEUE_H
@@ -0,0 +1,56 @@
+#ifndef DEEP_LOCALIZER_DIRECTORYWATCHER_H
+#define DEEP_LOCALIZER_DIRECTORYWATCHER_H
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "PathfileReader.h"
+
+namespace deeplocalizer {
+
+// Hands out the images written to a directory as they appear. Uses inotify,
+// so it is only available on Linux. An image is reported once it is fully
+// written: when it is closed after writing or moved into the directory.
+// The images already in the directory are reported first, sorted by name.
+class DirectoryWatcher : public PathSource {
+public:
+    static const std::vector<std::string> IMAGE_EXTENSIONS;
+
+    explicit DirectoryWatcher(const boost::filesystem::path & dir);
+    ~DirectoryWatcher();
+    DirectoryWatcher(const DirectoryWatcher &) = delete;
+    DirectoryWatcher & operator=(const DirectoryWatcher &) = delete;
+
+    // Blocks until new images are written or `stop` is called.
+    size_t next(size_t n, std::vector<std::string> & paths) override;
+
+    // Makes `next` return no paths from now on. Safe to call from a signal
+    // handler.
+    void stop() {
+        _stopped = true;
+    }
+    size_t nbRead() const override;
+    // A directory never ends, so the fraction is always unknown.
+    double fractionRead() const override {
+        return 0;
+    }
+private:
+    const boost::filesystem::path _dir;
+    int _fd = -1;
+    std::atomic<bool> _stopped{false};
+    std::deque<std::string> _pending;
+    // read without `_mutex`, which `next` holds while it waits for images
+    std::atomic<size_t> _nb_read{0};
+    std::mutex _mutex;
+
+    static bool isImage(const boost::filesystem::path & path);
+    void readEvents(int timeout_ms);
+};
+}
+
+#endif //DEEP_LOCALIZER_DIRECTORYWATCHER_H
@@ -0,0 +1,86 @@
+#ifndef DEEP_LOCALIZER_EDITJOURNAL_H
+#define DEEP_LOCALIZER_EDITJOURNAL_H
+
+#include <string>
+#include <vector>
+
+#include <boost/optional.hpp>
+#include <json.hpp>
+
+#include "Tag.h"
+
+namespace deeplocalizer {
+
+// One edit of the tagger. Tags are identified by their center, so applying
+// an event twice has the same effect as applying it once.
+struct JournalEvent {
+    enum Kind {
+        AddTag,
+        EraseTag,
+        SetTagType,
+        Done,
+    };
+    Kind kind;
+    // filename of the edited image
+    std::string image;
+    // the added, erased or changed tag. Not set for `Done`.
+    boost::optional<Tag> tag;
+
+    nlohmann::json to_json() const;
+    static JournalEvent from_json(const nlohmann::json &);
+};
+
+// An append-only log of the edits since the last snapshot of the tagger,
+// one JSON object per line. Events are buffered and written and fsynced
+// in batches, so an edit costs a few bytes instead of rewriting the state.
+//
+// To compact the journal into a snapshot, `rotate` moves it aside and
+// starts an empty one. Once the snapshot is written, `finishCompaction`
+// deletes the old journal. `read` returns the events of both, so a crash at
+// any point loses at most the last unflushed batch.
+class EditJournal {
+public:
+    static const size_t DEFAULT_BATCH_SIZE = 16;
+
+    explicit EditJournal(const std::string & path, size_t batch_size = DEFAULT_BATCH_SIZE);
+    // Flushes the buffered events.
+    ~EditJournal();
+    EditJournal(const EditJournal &) = delete;
+    EditJournal & operator=(const EditJournal &) = delete;
+
+    void append(const JournalEvent & event);
+    // Writes the buffered events and waits until they are on disk.
+    void flush();
+    // number of events since the journal was opened or rotated
+    size_t size() const {
+        return _nb_events;
+    }
+    const std::string & path() const {
+        return _path;
+    }
+
+    // Flushes and moves the events to `compactingPath()`. If that file is
+    // left over from an unfinished compaction, the events are appended to it.
+    void rotate();
+    // Deletes the rotated events of the journal at `path` once they are part
+    // of a snapshot.
+    static void finishCompaction(const std::string & path);
+    static std::string compactingPath(const std::string & path);
+
+    // The events of the rotated and the current journal at `path`, oldest
+    // first. Torn lines, as left by a crash, are skipped.
+    static std::vector<JournalEvent> read(const std::string & path);
+private:
+    const std::string _path;
+    const size_t _batch_size;
+    int _fd = -1;
+    std::string _buffer;
+    size_t _nb_buffered = 0;
+    size_t _nb_events = 0;
+
+    void open();
+    void close();
+};
+}
+
+#endif //DEEP_LOCALIZER_EDITJOURNAL_H
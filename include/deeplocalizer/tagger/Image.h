@@ -12,6 +12,14 @@ class QPixmap;
 
 namespace deeplocalizer {
 
+class TagStore;
+class TagStoreWriter;
+
+// An image whose description could not be loaded and why.
+struct LoadError {
+    std::string path;
+    std::string message;
+};
 
 class ImageDesc {
 public:
@@ -29,21 +37,40 @@ public:
     void save();
     void save(const std::string &path);
     static std::shared_ptr<ImageDesc> load(const std::string &path);
+    // Adds the tags to a tag store instead of writing a JSON file.
+    void save(TagStoreWriter & store) const;
+    // The image `filename` of a tag store. nullptr if the store does not have it.
+    static std::shared_ptr<ImageDesc> load(const TagStore & store, const std::string & filename);
     nlohmann::json to_json() const;
     static ImageDesc from_json(const nlohmann::json &);
+    // Same as `from_json(nlohmann::json::parse(json))`, but builds the
+    // description while reading the text, without a JSON DOM.
+    static ImageDesc parse(const std::string & json);
 
     void setSavePathExtension(std::string ext);
     std::string savePath() const;
 
+    // Loads the descriptions of the images on `nb_threads` threads, 0 is one
+    // per core. The result keeps the order of the paths. Images without a
+    // description file get an empty one. Images that are missing or whose
+    // description cannot be parsed are left out and added to `errors`.
+    // Without `errors`, one exception lists all of them.
     static std::vector<ImageDesc> fromPathFile(const std::string &path,
-                                               const std::string & image_desc_extension = "desc");
+                                               const std::string & image_desc_extension = "desc",
+                                               std::vector<LoadError> * errors = nullptr,
+                                               size_t nb_threads = 0);
     static std::vector<ImageDesc> fromPaths(const std::vector<std::string> paths,
-                                            const std::string & image_desc_extension = "desc");
+                                            const std::string & image_desc_extension = "desc",
+                                            std::vector<LoadError> * errors = nullptr,
+                                            size_t nb_threads = 0);
 
     static std::vector<std::shared_ptr<ImageDesc>> fromPathsPtr(const std::vector<std::string> paths,
-                                                             const std::string & image_desc_extension);
+                                                             const std::string & image_desc_extension,
+                                                             std::vector<LoadError> * errors = nullptr,
+                                                             size_t nb_threads = 0);
     static std::vector<std::shared_ptr<ImageDesc>> fromPathFilePtr(
-            const std::string &path, const std::string & image_desc_extension = "desc");
+            const std::string &path, const std::string & image_desc_extension = "desc",
+            std::vector<LoadError> * errors = nullptr, size_t nb_threads = 0);
 
 private:
     std::string _save_extension = ".desc";
@@ -56,6 +83,7 @@ class Image {
 public:
     explicit Image();
     explicit Image(const ImageDesc & descr);
+    explicit Image(const std::string & filename, cv::Mat mat);
 
     inline cv::Mat getCvMat() const {
         return _mat;
@@ -0,0 +1,101 @@
+#ifndef DEEP_LOCALIZER_IMAGECACHE_H
+#define DEEP_LOCALIZER_IMAGECACHE_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Image.h"
+
+namespace deeplocalizer {
+
+// Decoded images by filename, least recently used first out once they take
+// more than `maxBytes`. `prefetch` decodes images on background threads,
+// so `get` usually finds them in the cache instead of decoding on the
+// calling thread.
+class ImageCache {
+public:
+    using Loader = std::function<ImagePtr(const std::string & filename)>;
+    // Called on a background thread when a prefetched image is cached.
+    using Callback = std::function<void(const std::string & filename)>;
+    struct Stats {
+        // `get` found the image in the cache
+        size_t hits = 0;
+        // `get` had to decode the image
+        size_t misses = 0;
+        // `get` waited for the background thread to finish the image
+        size_t waits = 0;
+        // images decoded by the background thread
+        size_t prefetched = 0;
+        size_t evictions = 0;
+    };
+    static const size_t DEFAULT_MAX_BYTES = size_t(1) << 30;
+
+    explicit ImageCache(size_t max_bytes = DEFAULT_MAX_BYTES, Loader loader = decode,
+                        size_t nb_threads = 1, Callback prefetched = Callback());
+    // Waits for the images being decoded, the others queued are dropped.
+    ~ImageCache();
+    ImageCache(const ImageCache &) = delete;
+    ImageCache & operator=(const ImageCache &) = delete;
+
+    // The image `filename`, decoded on the calling thread if it is not
+    // cached. Errors of the loader are passed on.
+    ImagePtr get(const std::string & filename);
+    // The image `filename` if it is cached, else nullptr. Never decodes or
+    // waits, e.g. for a view that shows the image once it is prefetched.
+    ImagePtr find(const std::string & filename);
+    // Decodes `filenames` in the background, first ones first. Replaces the
+    // images still queued by an earlier call. Cached ones are marked as
+    // recently used, so they are not evicted for the others.
+    void prefetch(const std::vector<std::string> & filenames);
+    bool contains(const std::string & filename) const;
+    void clear();
+
+    Stats stats() const;
+    size_t usedBytes() const;
+    size_t maxBytes() const {
+        return _max_bytes;
+    }
+
+    // Reads the image the way `Image(ImageDesc)` does.
+    static ImagePtr decode(const std::string & filename);
+    static size_t bytesOf(const Image & image);
+private:
+    struct Entry {
+        ImagePtr image;
+        size_t bytes;
+        std::list<std::string>::iterator lru;
+    };
+    const size_t _max_bytes;
+    const Loader _loader;
+    const size_t _nb_threads;
+    const Callback _prefetched;
+    std::unordered_map<std::string, Entry> _entries;
+    // most recently used first
+    std::list<std::string> _lru;
+    size_t _used = 0;
+    Stats _stats;
+
+    std::deque<std::string> _queue;
+    std::set<std::string> _decoding;
+    bool _stopped = false;
+    mutable std::mutex _mutex;
+    std::condition_variable _queued;
+    std::condition_variable _decoded;
+    // started on the first prefetch
+    std::vector<std::thread> _workers;
+
+    void run();
+    void insert(const std::string & filename, ImagePtr image);
+    void touch(Entry & entry);
+};
+}
+
+#endif //DEEP_LOCALIZER_IMAGECACHE_H
@@ -0,0 +1,90 @@
+#ifndef DEEP_LOCALIZER_IMAGELISTMODEL_H
+#define DEEP_LOCALIZER_IMAGELISTMODEL_H
+
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <QAbstractListModel>
+#include <QCache>
+#include <QPixmap>
+#include <QStringList>
+
+#include "ImageCache.h"
+#include "ManuallyTagger.h"
+#include "ThumbnailStore.h"
+
+namespace deeplocalizer {
+
+// The images of a tagger as a list, optionally filtered. The rows are
+// rendered from the tagger's statuses when the view asks for them, so only
+// the visible rows cost anything. Connect `imageChanged` to the tagger's
+// signal of the same name to update single rows.
+//
+// With thumbnails enabled, every row has a thumbnail with the tags drawn
+// on it. Thumbnails are made on background threads for the rows the view
+// asked for last; until then, a row shows a placeholder. The tags of an
+// image the tagger did not load are read with its thumbnail.
+class ImageListModel : public QAbstractListModel {
+    Q_OBJECT
+public:
+    enum Filter {
+        All,
+        NotDone,
+        WithExcluded,
+    };
+    // thumbnails kept in memory
+    static const size_t THUMBNAIL_CACHE_BYTES = 64 << 20;
+    // thumbnails queued at most, the rows asked for last first
+    static const size_t MAX_WANTED_THUMBNAILS = 128;
+
+    explicit ImageListModel(ManuallyTagger * tagger, QObject * parent = nullptr);
+
+    int rowCount(const QModelIndex & parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex & index, int role = Qt::DisplayRole) const override;
+
+    Filter filter() const {
+        return _filter;
+    }
+    // `WithExcluded` counts the tags of the images that were never loaded.
+    void setFilter(Filter filter);
+    // the names of the filters, in the order of `Filter`
+    static QStringList filterNames();
+
+    // The image shown in `row`.
+    unsigned long imageIdx(int row) const;
+    // The row of image `idx`. Invalid if the filter hides it.
+    QModelIndex indexOf(unsigned long idx) const;
+
+    // Shows the thumbnails of `store`, made on `nb_threads` threads.
+    void enableThumbnails(std::shared_ptr<const ThumbnailStore> store, size_t nb_threads);
+    // The size of the placeholder and of the thumbnails of 4000x3000 images.
+    static QSize thumbnailSize() {
+        return QSize(128, 96);
+    }
+public slots:
+    void imageChanged(unsigned long idx);
+private slots:
+    void thumbnailReady(QString filename);
+private:
+    ManuallyTagger * _tagger;
+    Filter _filter = All;
+    // the sorted images shown with a filter, unused without one
+    std::vector<unsigned long> _rows;
+
+    // thumbnails with the tags drawn on them, by image index
+    mutable QCache<unsigned long, QPixmap> _decorations;
+    mutable std::deque<std::string> _wanted;
+    std::unordered_map<std::string, unsigned long> _idx_of;
+    QPixmap _placeholder;
+    // declared last, so its threads are stopped before the rest is destructed
+    std::unique_ptr<ImageCache> _thumbnails;
+
+    bool matches(unsigned long idx) const;
+    QVariant decoration(unsigned long idx) const;
+    void wantThumbnail(const std::string & filename) const;
+};
+}
+
+#endif //DEEP_LOCALIZER_IMAGELISTMODEL_H
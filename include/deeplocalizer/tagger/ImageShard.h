@@ -0,0 +1,118 @@
+#ifndef DEEP_LOCALIZER_IMAGESHARD_H
+#define DEEP_LOCALIZER_IMAGESHARD_H
+
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/optional.hpp>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+namespace deeplocalizer {
+
+// A frame stored in a shard, written as `<shard path>:<offset>` in pathfiles.
+struct ShardRef {
+    std::string shard;
+    uint64_t offset = 0;
+
+    std::string str() const;
+    // Parses `<path>.shard:<offset>`. Returns boost::none for ordinary paths.
+    static boost::optional<ShardRef> parse(const std::string & path);
+};
+
+// Returns true if the file or the shard of a shard reference exists.
+bool imageExists(const std::string & path);
+
+// Decodes the image at an ordinary path or a shard reference.
+// Returns an empty matrix if it cannot be read.
+cv::Mat readImage(const std::string & path, int flags = cv::IMREAD_GRAYSCALE);
+
+// Appends encoded frames to large shard files instead of writing one file per
+// frame. A shard is a sequence of records: the size of the encoded frame as
+// 64 bit little endian integer followed by the encoded frame. Next to every
+// shard, an index (`<shard>.index`) maps the original image names to the
+// record offsets; one JSON object per line.
+class ShardWriter {
+public:
+    static const std::string EXTENSION;
+    static const std::string INDEX_EXTENSION;
+
+    // Writes the shards `<prefix>_00000.shard`, `<prefix>_00001.shard`, ...
+    // A new shard is started once the current one is larger than `max_bytes`.
+    // Existing shards are never overwritten, so references from earlier runs
+    // stay valid.
+    ShardWriter(const boost::filesystem::path & prefix, uint64_t max_bytes);
+
+    // Appends the encoded frame of the image `name` and returns its
+    // `shard:offset` reference. Thread-safe.
+    std::string append(const std::string & name, const std::vector<uchar> & data);
+
+    size_t nbShards() const {
+        return _nb_shards;
+    }
+private:
+    const boost::filesystem::path _prefix;
+    const uint64_t _max_bytes;
+    std::mutex _mutex;
+    size_t _next_shard_idx = 0;
+    size_t _nb_shards = 0;
+    boost::filesystem::path _shard_path;
+    std::ofstream _data;
+    std::ofstream _index;
+    uint64_t _offset = 0;
+
+    void openNextShard();
+};
+
+// A read-only memory mapping of a shard. Reading a frame is a slice of the
+// mapping and needs no open or stat call.
+class ImageShard {
+public:
+    // Maps the shard at `path` and reads its index if there is one.
+    explicit ImageShard(const boost::filesystem::path & path);
+
+    // Returns the mapped shard at `path`, or nullptr if it cannot be read.
+    // Every shard is mapped once per process and later calls return the
+    // mapping without touching the file system, as shards are append only.
+    // With `revalidate`, the shard is mapped again if its size or mtime
+    // changed, e.g. because frames were appended since it was mapped.
+    static std::shared_ptr<ImageShard> open(const boost::filesystem::path & path,
+                                            bool revalidate = false);
+
+    // True if the whole record at `offset` lies in the mapping.
+    bool contains(uint64_t offset) const;
+
+    // The encoded frame of the record at `offset`, pointing into the mapping.
+    cv::Mat encoded(uint64_t offset) const;
+    cv::Mat decode(uint64_t offset, int flags = cv::IMREAD_GRAYSCALE) const;
+
+    // Offset of the frame of the image with the original name `name`.
+    boost::optional<uint64_t> find(const std::string & name) const;
+
+    uint64_t size() const {
+        return _size;
+    }
+    size_t nbFrames() const {
+        return _offsets.size();
+    }
+private:
+    boost::interprocess::file_mapping _file;
+    boost::interprocess::mapped_region _region;
+    uint64_t _size = 0;
+    std::time_t _mtime = 0;
+    std::unordered_map<std::string, uint64_t> _offsets;
+
+    uint64_t recordSize(uint64_t offset) const;
+};
+}
+
+#endif //DEEP_LOCALIZER_IMAGESHARD_H
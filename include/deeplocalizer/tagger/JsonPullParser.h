@@ -0,0 +1,65 @@
+#ifndef DEEP_LOCALIZER_JSONPULLPARSER_H
+#define DEEP_LOCALIZER_JSONPULLPARSER_H
+
+#include <string>
+#include <vector>
+
+namespace deeplocalizer {
+
+// Reads a JSON document token by token, without building a DOM. The caller
+// asks for the values in the order they appear:
+//
+//     parser.beginObject();
+//     while(parser.nextKey(key)) {
+//         if (key == "x") { x = parser.integer(); }
+//         else { parser.skipValue(); }
+//     }
+//
+// Malformed JSON and values of an unexpected type throw like ASSERT does.
+// The text must outlive the parser.
+class JsonPullParser {
+public:
+    JsonPullParser(const char * begin, const char * end);
+    explicit JsonPullParser(const std::string & text);
+
+    void beginObject();
+    // Reads the next key of the current object. Returns false and consumes
+    // the closing brace once the object has no more keys.
+    bool nextKey(std::string & key);
+
+    void beginArray();
+    // Returns true if the current array has another value, which must be
+    // read next. Returns false and consumes the closing bracket at its end.
+    bool nextElement();
+
+    std::string string();
+    double number();
+    // a number without fraction or exponent
+    long integer();
+    bool boolean();
+    // True and consumes it if the next value is `null`.
+    bool null();
+    // Skips the next value, including nested objects and arrays.
+    void skipValue();
+    // Checks that only whitespace is left.
+    void end();
+private:
+    const char * const _begin;
+    const char * _pos;
+    const char * const _end;
+    // per open object or array, whether it has no values yet
+    std::vector<bool> _first;
+
+    char peek();
+    void expect(char c);
+    void expectWord(const char * word);
+    [[noreturn]] void fail(const std::string & message) const;
+    void skipWhitespace();
+    void readString(std::string & out);
+    void appendCodepoint(std::string & out, unsigned long codepoint);
+    unsigned long hex4();
+    const char * numberEnd() const;
+};
+}
+
+#endif //DEEP_LOCALIZER_JSONPULLPARSER_H
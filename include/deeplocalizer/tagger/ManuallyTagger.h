@@ -3,9 +3,13 @@
 
 
 #include <string>
+#include <atomic>
 #include <deque>
+#include <functional>
+#include <map>
 #include <memory>
 #include <random>
+#include <set>
 
 #include <boost/version.hpp>
 #include <boost/optional/optional.hpp>
@@ -18,6 +22,10 @@
 
 #include "Tag.h"
 #include "Image.h"
+#include "BackgroundWriter.h"
+#include "EditJournal.h"
+#include "ImageCache.h"
+#include "StatusIndex.h"
 
 
 namespace deeplocalizer {
@@ -34,17 +42,42 @@ public slots:
     void loadLastImage();
     void loadImage(unsigned long idx);
     void loadCurrentImage();
+    // Starts decoding image `idx` in the background, e.g. when its row is
+    // pressed and before it is loaded.
+    void prefetch(unsigned long idx);
     void doneTagging();
     void doneTagging(unsigned long idx);
+    // Record an edit of the current image in the journal. The caller changes
+    // the description itself.
+    void tagAdded(Tag tag);
+    void tagErased(Tag tag);
+    void tagTypeChanged(Tag tag);
+    // Writes the journaled edits to disk in the background.
+    void flushJournal();
+    // Writes the changed descriptions and the progress in the background,
+    // then drops the journaled edits they contain. Replaces a snapshot that
+    // is still queued. With `wait`, returns once everything is written.
+    void compact(bool wait=false);
 signals:
     void loadedImage(unsigned long idx, ImageDescPtr desc, ImagePtr img);
     void outOfRange(unsigned long idx);
     void lastImage();
     void firstImage();
     void progress(double progress);
+    // The status or the tags of image `idx` changed.
+    void imageChanged(unsigned long idx);
+    // A snapshot was written. Emitted from the writer thread.
+    void saved();
+    // A snapshot or the journal could not be written. The edits are still in
+    // the journal, unless that failed. Emitted from the writer thread.
+    void saveFailed(QString message);
 public:
     static const std::string IMAGE_DESC_EXT;
     static const std::string DEFAULT_SAVE_PATH;
+    // the journal is compacted after this many edits
+    static const size_t COMPACT_AFTER = 2000;
+    // images decoded ahead on each side of the current one
+    static const size_t DEFAULT_PREFETCH_DEPTH = 2;
 
     explicit ManuallyTagger();
     explicit ManuallyTagger(const std::vector<ImageDesc> & descriptions,
@@ -53,6 +86,7 @@ public:
                             const std::string & save_path = DEFAULT_SAVE_PATH);
     explicit ManuallyTagger(std::vector<ImageDescPtr> && descriptions,
                             const std::string & save_path = DEFAULT_SAVE_PATH);
+    ~ManuallyTagger();
     void init();
 
     static std::unique_ptr<ManuallyTagger> load(const std::string & path);
@@ -61,22 +95,60 @@ public:
         return _save_path;
     }
     void setSavePath(const std::string &save_path) {
+        _writer.flush();
+        _journal.reset();
         ManuallyTagger::_save_path = save_path;
     }
+    // Edits since the last snapshot of the progress at `savePath()`.
+    std::string journalPath() const {
+        return _save_path + ".journal";
+    }
+    // The status of every image, written with the progress.
+    std::string indexPath() const {
+        return _save_path + ".index";
+    }
 
+    // Descriptions are loaded when they are first needed. Until then, they
+    // only have their filename and the tags they were constructed with.
     const std::vector<ImageDescPtr> &getImageDescs() const {
         return _image_descs;
     }
+    // The description of image `idx`. Loads it on first access.
+    ImageDescPtr imageDesc(unsigned long idx);
+    bool isLoaded(unsigned long idx) const {
+        return _loaded.at(idx);
+    }
+    // The description of image `filename` as imageDesc() reads it: its
+    // *.tagger.json file, else its proposals, else nullptr. Touches no
+    // tagger, so it can run on any thread.
+    static ImageDescPtr readImageDesc(const std::string & filename);
+    const ImageStatus & status(unsigned long idx) const {
+        return _status.at(idx);
+    }
+    // Counts the tags of every image whose counts are unknown. The
+    // descriptions are read in parallel, but not kept. Returns the images
+    // whose description could not be read, their counts stay unknown.
+    std::vector<LoadError> countTags();
     bool isDone(unsigned long idx) const {
         // either *.tagger.desc file exists or it is marked as done
-        return (idx < _image_descs.size() &&
-                boost::filesystem::exists(_image_descs.at(idx)->savePath())) ||
+        return (idx < _status.size() && _status.at(idx).has_desc) ||
                 (idx < _done_tagging.size() && _done_tagging.at(idx));
     }
     bool isDone(const ImageDesc & desc) const {
         return boost::filesystem::exists(desc.savePath());
     }
 
+    void setPrefetchDepth(size_t depth) {
+        _prefetch_depth = depth;
+    }
+    size_t prefetchDepth() const {
+        return _prefetch_depth;
+    }
+    // Hits and misses of the decoded images, to tune the prefetch depth.
+    ImageCache::Stats cacheStats() const {
+        return _cache.stats();
+    }
+
     unsigned long getIdx() const {
         return _image_idx;
     }
@@ -85,6 +157,9 @@ public:
 
 private:
     std::vector<ImageDescPtr> _image_descs;
+    std::vector<ImageStatus> _status;
+    // whether imageDesc() loaded the description
+    std::vector<bool> _loaded;
     std::vector<bool> _done_tagging;
     unsigned long _n_done = 0;
     bool _loaded_from_serialization = false;
@@ -94,6 +169,40 @@ private:
     ImagePtr _image;
     ImageDescPtr _desc;
     unsigned long _image_idx = 0;
+
+    ImageCache _cache;
+    size_t _prefetch_depth = DEFAULT_PREFETCH_DEPTH;
+
+    // What a compaction writes, copied when it is queued.
+    struct Snapshot {
+        // the changed descriptions by image index
+        std::map<size_t, ImageDesc> descs;
+        nlohmann::json state;
+        std::vector<ImageStatus> status;
+        std::vector<std::string> paths;
+        std::atomic<bool> written{false};
+    };
+
+    // only used on the writer thread
+    std::unique_ptr<EditJournal> _journal;
+    // descriptions changed since the last snapshot
+    std::set<size_t> _dirty;
+    // events queued since the last snapshot
+    size_t _nb_journaled = 0;
+    std::shared_ptr<Snapshot> _snapshot;
+
+    EditJournal & journal();
+    void record(JournalEvent::Kind kind, boost::optional<Tag> tag, size_t idx);
+    // Counts the tags of the loaded description `idx`.
+    void updateStatus(size_t idx);
+    void written(const std::string & job, const boost::optional<std::string> & error);
+
+    // Writes the journal and the snapshots off the GUI thread. Declared
+    // last, so it is done before the rest is destructed.
+    BackgroundWriter _writer{std::bind(&ManuallyTagger::written, this,
+                                       std::placeholders::_1, std::placeholders::_2)};
+    // Applies the journaled edits to the loaded descriptions.
+    void replayJournal();
 };
 }
 
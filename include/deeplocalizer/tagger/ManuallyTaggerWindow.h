@@ -3,9 +3,9 @@
 
 #include <QMainWindow>
 #include <QProgressBar>
-#include <QStringListModel>
 
 #include "ui_ManuallyTaggerWindow.h"
+#include "ImageListModel.h"
 #include "ManuallyTagger.h"
 #include "WholeImageWidget.h"
 
@@ -42,7 +42,7 @@ private:
     QGridLayout * _grid_layout;
     WholeImageWidget * _whole_image;
     QProgressBar * _progres_bar;
-    QStringListModel *_image_list_model;
+    ImageListModel *_image_list_model;
 
     std::unique_ptr<ManuallyTagger> _tagger;
     ImageDescPtr  _desc;
@@ -57,7 +57,6 @@ private:
     void setupActions();
     void setupUi();
     void eraseNegativeTags();
-    QStringList fileStringList();
 };
 }
 #endif // MANUELLTAGWINDOW_H
@@ -0,0 +1,76 @@
+#ifndef DEEP_LOCALIZER_MEMORYBUDGET_H
+#define DEEP_LOCALIZER_MEMORYBUDGET_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+
+namespace deeplocalizer {
+
+// Counts the bytes held by work in flight and makes `acquire` wait while they
+// would exceed `max_bytes`. Something is always admitted when nothing else is
+// in flight, so items larger than the budget still pass, one at a time.
+// A budget of 0 bytes is unlimited.
+class MemoryBudget {
+public:
+    explicit MemoryBudget(size_t max_bytes) : _max_bytes(max_bytes) {}
+
+    // Blocks until `bytes` fit into the budget and takes them.
+    void acquire(size_t bytes) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _released.wait(lock, [&]() {
+            return _max_bytes == 0 || _used == _pinned || _used + bytes <= _max_bytes;
+        });
+        take(bytes);
+    }
+
+    // Takes `bytes` without waiting. For memory that is already allocated,
+    // e.g. an image that turned out larger than expected.
+    void force(size_t bytes) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        take(bytes);
+    }
+
+    // Takes `bytes` for good, e.g. for buffers that are kept until the end.
+    // They do not count as in flight, so something is still admitted once
+    // everything else is released.
+    void pin(size_t bytes) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        take(bytes);
+        _pinned += bytes;
+    }
+
+    void release(size_t bytes) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _used -= std::min(bytes, _used - _pinned);
+        _released.notify_all();
+    }
+
+    size_t maxBytes() const {
+        return _max_bytes;
+    }
+    size_t used() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _used;
+    }
+    // the most bytes used at any time
+    size_t peak() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _peak;
+    }
+private:
+    const size_t _max_bytes;
+    size_t _used = 0;
+    size_t _pinned = 0;
+    size_t _peak = 0;
+    mutable std::mutex _mutex;
+    std::condition_variable _released;
+
+    void take(size_t bytes) {
+        _used += bytes;
+        _peak = std::max(_peak, _used);
+    }
+};
+}
+
+#endif //DEEP_LOCALIZER_MEMORYBUDGET_H
@@ -0,0 +1,65 @@
+#ifndef DEEP_LOCALIZER_PATHFILEREADER_H
+#define DEEP_LOCALIZER_PATHFILEREADER_H
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace deeplocalizer {
+
+// A source of image paths shared by many threads.
+class PathSource {
+public:
+    virtual ~PathSource() = default;
+
+    // Gets up to `n` further paths into `paths` and returns the index of the
+    // first one. May block until paths are available. `paths` is empty once
+    // the source is exhausted. Thread-safe.
+    virtual size_t next(size_t n, std::vector<std::string> & paths) = 0;
+
+    // number of paths handed out so far
+    virtual size_t nbRead() const = 0;
+    // Fraction of all paths handed out so far. 0 if unknown.
+    virtual double fractionRead() const = 0;
+};
+
+// Reads the image paths of a pathfile a few lines at a time, so the work on
+// the first images can start before the whole pathfile is read. The paths are
+// not checked; whoever opens an image has to handle a missing file.
+// Empty lines are skipped.
+class PathfileReader : public PathSource {
+public:
+    // pathfile name that reads the paths from the standard input
+    static const std::string STDIN;
+
+    explicit PathfileReader(const std::string & pathfile);
+    // Reads the paths from an already opened stream.
+    explicit PathfileReader(std::istream & is);
+
+    // Reads up to `n` further paths into `paths` and returns the index of the
+    // first one. `paths` is empty once the pathfile is exhausted. Thread-safe.
+    size_t next(size_t n, std::vector<std::string> & paths) override;
+
+    // Reads all remaining paths.
+    std::vector<std::string> readAll();
+
+    size_t nbRead() const override;
+    bool eof() const;
+    // Fraction of the pathfile read so far. Unknown for streams, then 0
+    // until the end is reached.
+    double fractionRead() const override;
+private:
+    std::ifstream _file;
+    std::istream & _is;
+    uintmax_t _file_size = 0;
+    uintmax_t _bytes_read = 0;
+    size_t _nb_read = 0;
+    bool _eof = false;
+    mutable std::mutex _mutex;
+};
+}
+
+#endif //DEEP_LOCALIZER_PATHFILEREADER_H
@@ -0,0 +1,87 @@
+#ifndef DEEP_LOCALIZER_PREPROCESSCONTEXT_H
+#define DEEP_LOCALIZER_PREPROCESSCONTEXT_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "preprocessing.h"
+
+namespace deeplocalizer {
+
+// A thread-safe pool of frame buffers. Buffers given back with `release`
+// are handed out again by `acquire` instead of allocating new ones.
+class FramePool {
+public:
+    // Returns a free buffer of the given size and type or allocates a new one.
+    cv::Mat acquire(cv::Size size, int type);
+    // Returns any free buffer. Empty if the pool has none.
+    cv::Mat acquire();
+    void release(cv::Mat mat);
+
+    // number of buffers `acquire(size, type)` had to allocate. Only counts
+    // these buffers, not the other allocations of the process.
+    size_t bufferGrowths() const {
+        return _nb_buffer_growths;
+    }
+    size_t size() const;
+private:
+    mutable std::mutex _mutex;
+    std::vector<cv::Mat> _free;
+    std::atomic<size_t> _nb_buffer_growths{0};
+};
+
+// Everything a preprocessing worker reuses from one image to the next:
+// the CLAHE instance, scratch images sized for the largest frame seen so far,
+// a buffer for the encoded file and a pool of output images.
+// A context must only be used by one thread at a time, except for
+// `releaseOutput` which may be called from any thread.
+class PreprocessContext {
+public:
+    explicit PreprocessContext(const PreprocessOptions & opt);
+
+    // Reads and decodes the grayscale image at `path` into a buffer of `pool`.
+    // Returns an empty matrix if the file cannot be read or decoded.
+    cv::Mat decode(const std::string & path, FramePool & pool);
+
+    // The two halves of `decode`: `readFile` loads the encoded file into the
+    // context's file buffer and `decodeFile` decodes it.
+    bool readFile(const std::string & path);
+    cv::Mat decodeFile(FramePool & pool);
+    // hash of the content of the last file read
+    uint64_t fileHash() const;
+
+    // Runs `processImage` on `input`. The result is a buffer of the output
+    // pool and should be given back with `releaseOutput` after it was written.
+    cv::Mat process(const cv::Mat & input);
+    void releaseOutput(cv::Mat output);
+
+    // number of times a frame buffer, a scratch image or the file buffer had
+    // to be allocated or grown. Stays constant once all frame sizes have been
+    // seen. Other allocations, e.g. inside OpenCV, are not counted.
+    size_t bufferGrowths() const {
+        return _nb_buffer_growths + _outputs.bufferGrowths();
+    }
+    // bytes of the scratch images and the file buffer kept between frames
+    size_t scratchBytes() const;
+private:
+    const PreprocessOptions _opt;
+    ProcessingBuffers _buffers;
+    cv::Mat _bordered_storage;
+    cv::Mat _equalized_storage;
+    cv::Mat _local_mean_storage;
+    cv::Mat _local_mean_float_storage;
+    cv::Mat _horizontal_storage;
+    FramePool _outputs;
+    std::vector<uchar> _file_buffer;
+    std::atomic<size_t> _nb_buffer_growths{0};
+
+    cv::Mat scratch(cv::Mat & storage, cv::Size size, int type);
+    void prepareBuffers(cv::Size input_size);
+};
+}
+
+#endif //DEEP_LOCALIZER_PREPROCESSCONTEXT_H
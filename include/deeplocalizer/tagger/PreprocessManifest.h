@@ -0,0 +1,112 @@
+#ifndef DEEP_LOCALIZER_PREPROCESSMANIFEST_H
+#define DEEP_LOCALIZER_PREPROCESSMANIFEST_H
+
+#include <ctime>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <boost/filesystem.hpp>
+#include <json.hpp>
+
+#include "ImageShard.h"
+#include "preprocessing.h"
+
+namespace deeplocalizer {
+
+// What bb_preprocess knows about one input image and the output it produced.
+struct ManifestEntry {
+    std::string input;
+    std::string output;
+    // `shard:offset` reference if the output was appended to a shard
+    // instead of being written to `output`
+    std::string location;
+    uintmax_t size = 0;
+    std::time_t mtime = 0;
+    uint64_t hash = 0;
+
+    // Fills `size` and `mtime` from the file system.
+    // Returns false if the input file cannot be stat'ed.
+    bool stat();
+
+    // where the output can be read from: `location` or `output`
+    const std::string & storedAt() const {
+        return location.empty() ? output : location;
+    }
+
+    nlohmann::json to_json() const;
+    static ManifestEntry from_json(const nlohmann::json &);
+};
+
+// Records which inputs bb_preprocess has already processed with which options.
+// The manifest is a JSON lines file: the first line holds the options, every
+// following line a `ManifestEntry`. Entries are appended as soon as an image
+// is written, so the manifest survives a crash. A later line for the same
+// input overrides an earlier one.
+class PreprocessManifest {
+public:
+    static const std::string EXTENSION;
+    // The manifest lies next to the output pathfile.
+    static boost::filesystem::path pathFor(const boost::filesystem::path & output_pathfile);
+    // The options that change the content of the output images.
+    static nlohmann::json optionsToJson(const PreprocessOptions & opt);
+
+    // Reads the entries of the manifest at `path` without changing it.
+    // Empty if the manifest was written with other options or its header
+    // cannot be read.
+    static std::unordered_map<std::string, ManifestEntry> read(
+            const boost::filesystem::path & path, const PreprocessOptions & opt);
+
+    // Opens the manifest at `path`. The entries of a previous run are kept
+    // if `reuse` is set and they were produced with the same options.
+    PreprocessManifest(const boost::filesystem::path & path,
+                       const PreprocessOptions & opt, bool reuse = true);
+
+    // Returns the entry of a previous run for `input` or nullptr.
+    const ManifestEntry * previous(const std::string & input) const;
+
+    // Returns true if `entry.output` was produced by a previous run from the
+    // same input file. Compares size and mtime first and only falls back to
+    // the content hash if they differ. `hashFn` is called to compute the hash
+    // of the input; its result is stored in `entry.hash`.
+    template<typename HashFn>
+    bool isUpToDate(ManifestEntry & entry, HashFn hashFn) const {
+        const ManifestEntry * prev = previous(entry.input);
+        if (not prev || prev->output != entry.output ||
+                not imageExists(prev->storedAt())) {
+            return false;
+        }
+        entry.location = prev->location;
+        if (prev->size == entry.size && prev->mtime == entry.mtime) {
+            entry.hash = prev->hash;
+            return true;
+        }
+        entry.hash = hashFn();
+        return prev->size == entry.size && prev->hash == entry.hash;
+    }
+
+    // Appends `entry` to the manifest. Thread-safe.
+    void add(const ManifestEntry & entry);
+
+    // Rewrites the manifest with only the latest entry of every input.
+    void compact();
+
+    size_t nbPrevious() const {
+        return _previous.size();
+    }
+private:
+    boost::filesystem::path _path;
+    nlohmann::json _options;
+    std::unordered_map<std::string, ManifestEntry> _previous;
+    std::unordered_map<std::string, ManifestEntry> _current;
+    std::ofstream _journal;
+    std::mutex _mutex;
+
+    static std::unordered_map<std::string, ManifestEntry> read(
+            const boost::filesystem::path & path, const nlohmann::json & options);
+    void writeHeader(std::ostream & os) const;
+};
+}
+
+#endif //DEEP_LOCALIZER_PREPROCESSMANIFEST_H
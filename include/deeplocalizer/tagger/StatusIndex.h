@@ -0,0 +1,42 @@
+#ifndef DEEP_LOCALIZER_STATUSINDEX_H
+#define DEEP_LOCALIZER_STATUSINDEX_H
+
+#include <ctime>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace deeplocalizer {
+
+// What the tagger knows about an image without loading its description.
+struct ImageStatus {
+    // whether the tagger wrote a description, i.e. the image was tagged
+    bool has_desc = false;
+    // number of tags of the description, -1 if it was never loaded
+    long nb_tags = -1;
+    // number of tags marked as excluded regions, -1 if never loaded
+    long nb_excluded = -1;
+    // modification time of the description, 0 if there is none
+    std::time_t desc_mtime = 0;
+
+    // Stats the description at `desc_path`. The number of tags is unknown.
+    static ImageStatus probe(const std::string & desc_path);
+};
+
+// The status of every image of a tagger session in one file, so the tagger
+// can start without opening the description of every image. It is written
+// together with the progress. On start, an entry is only used if the
+// description still has the recorded mtime; the status of an image is also
+// refreshed whenever its description is loaded.
+class StatusIndex {
+public:
+    // The statuses by image filename. Empty if there is no index at `path`
+    // or it cannot be parsed.
+    static std::unordered_map<std::string, ImageStatus> load(const std::string & path);
+    static void save(const std::string & path,
+                     const std::vector<std::string> & filenames,
+                     const std::vector<ImageStatus> & statuses);
+};
+}
+
+#endif //DEEP_LOCALIZER_STATUSINDEX_H
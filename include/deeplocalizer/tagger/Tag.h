@@ -8,6 +8,7 @@
 #include <QMetaType>
 #include <QString>
 
+#include <boost/optional.hpp>
 #include <opencv2/core/core.hpp>
 #include <json.hpp>
 
@@ -18,6 +19,8 @@ class QPainter;
 
 namespace deeplocalizer {
 
+class JsonPullParser;
+
 
 enum TagType {
     IsTag,
@@ -26,10 +29,26 @@ enum TagType {
     BeeWithoutTag,
 };
 
+// The ellipse the proposal pipeline fitted to a tag. `center` is relative
+// to the tag's bounding box, `vote` is the score of the fit.
+struct TagEllipse {
+    int vote;
+    cv::Point2i center;
+    cv::Size axis;
+    double angle;
+
+    bool operator==(const TagEllipse & other) const;
+    nlohmann::json to_json() const;
+    static TagEllipse from_json(const nlohmann::json &);
+    static TagEllipse parse(JsonPullParser & parser);
+};
+
 class Tag {
 public:
     Tag();
     Tag(cv::Rect boundingBox);
+    // a tag sized bounding box around `center`
+    static Tag fromCenter(cv::Point2i center);
     static const int IS_TAG_THRESHOLD = 1200;
 
     unsigned long id() const;
@@ -41,6 +60,9 @@ public:
     void setType(TagType tagtype);
     void toggleIsTag();
 
+    const boost::optional<TagEllipse> & ellipse() const;
+    void setEllipse(boost::optional<TagEllipse> ellipse);
+
     inline bool isExclude() const {
         return _tag_type == Exclude;
     }
@@ -68,11 +90,14 @@ public:
 
     nlohmann::json to_json() const;
     static Tag from_json(const nlohmann::json &);
+    // Same as `from_json`, but reads the tag directly from the parser.
+    static Tag parse(JsonPullParser & parser);
 
 private:
     unsigned long _id;
     cv::Rect _boundingBox;
     TagType _tag_type = TagType::IsTag;
+    boost::optional<TagEllipse> _ellipse;
 
     static unsigned long generateId();
     static std::atomic_long id_counter;
@@ -0,0 +1,66 @@
+#ifndef DEEP_LOCALIZER_TAGGRID_H
+#define DEEP_LOCALIZER_TAGGRID_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/optional.hpp>
+#include <opencv2/core/core.hpp>
+
+#include "Tag.h"
+
+namespace deeplocalizer {
+
+// A spatial index over the bounding boxes of tags. The tags are bucketed by
+// the grid cell of their center, so queries only look at the cells near the
+// queried area instead of at every tag. A tag is identified by a key, e.g.
+// its index in a vector of tags.
+class TagGrid {
+public:
+    explicit TagGrid(int cell_size = 2 * TAG_WIDTH);
+
+    // Adds or moves the tag `key`.
+    void insert(size_t key, const cv::Rect & box);
+    // False if there is no tag `key`.
+    bool erase(size_t key);
+    void clear();
+    size_t size() const {
+        return _centers.size();
+    }
+
+    // The tag whose box contains `point`. If several do, the one whose
+    // center is closest.
+    boost::optional<size_t> at(cv::Point2i point) const;
+    // All tags whose boxes intersect `rect`, in no particular order.
+    std::vector<size_t> intersecting(const cv::Rect & rect) const;
+    // All tags whose centers are at most `radius` away from `center`, in no
+    // particular order.
+    std::vector<size_t> within(cv::Point2i center, double radius) const;
+private:
+    struct Entry {
+        size_t key;
+        cv::Rect box;
+    };
+    const int _cell_size;
+    // the largest distance of a box's border to its center, over all boxes
+    // ever inserted. Queries look this far into the neighbouring cells.
+    int _max_extent = 0;
+    std::unordered_map<uint64_t, std::vector<Entry>> _cells;
+    std::unordered_map<size_t, cv::Point2i> _centers;
+
+    cv::Point2i cellOf(cv::Point2i point) const;
+    static uint64_t cellKey(cv::Point2i cell);
+    // Calls `fn` with every entry in the cells whose centers may lie in
+    // `area`.
+    template<typename Fn>
+    void forEachEntry(const cv::Rect & area, Fn fn) const;
+};
+
+// Merges proposals whose centers are at most `distance` apart. Of every
+// group the tag with the highest ellipse vote is kept; tags without an
+// ellipse come last. The result keeps the order of `tags`.
+std::vector<Tag> mergeNearDuplicates(const std::vector<Tag> & tags, double distance);
+}
+
+#endif //DEEP_LOCALIZER_TAGGRID_H
@@ -0,0 +1,85 @@
+#ifndef DEEP_LOCALIZER_TAGSTORE_H
+#define DEEP_LOCALIZER_TAGSTORE_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/optional.hpp>
+
+#include "Image.h"
+
+namespace deeplocalizer {
+
+// The tags of many images in one binary file, instead of one JSON file per
+// image. All integers are little endian. The file has three parts:
+//
+//   header:  the magic "BBTAGS", a 16 bit version, the 64 bit number of
+//            images and the 64 bit offset of the index.
+//   records: one per image. The filename and the number of tags, then for
+//            every tag the distance of its center to the previous tag's
+//            center, its type and optionally its ellipse. Integers are
+//            varints, signed ones zigzag encoded. The ellipse angle is a
+//            64 bit double.
+//   index:   the 64 bit offset and 32 bit size of every record, sorted by
+//            filename.
+//
+// The file is memory mapped. Finding an image is a binary search over the
+// index and reading it decodes a single record.
+class TagStore {
+public:
+    static const std::string EXTENSION;
+
+    explicit TagStore(const boost::filesystem::path & path);
+
+    // number of images
+    size_t size() const {
+        return _nb_images;
+    }
+    // The images are sorted by filename.
+    std::string filename(size_t i) const;
+    ImageDesc at(size_t i) const;
+    boost::optional<ImageDesc> find(const std::string & filename) const;
+    bool contains(const std::string & filename) const;
+private:
+    friend class TagStoreWriter;
+
+    boost::interprocess::file_mapping _file;
+    boost::interprocess::mapped_region _region;
+    const unsigned char * _data = nullptr;
+    uint64_t _size = 0;
+    uint64_t _nb_images = 0;
+    const unsigned char * _index = nullptr;
+
+    // the encoded record of the i-th image, pointing into the mapping
+    std::pair<const unsigned char *, size_t> record(size_t i) const;
+    boost::optional<size_t> indexOf(const std::string & filename) const;
+};
+
+// Collects images and writes them to a tag store. Images can be added in any
+// order; an image added twice keeps the tags it was added with last. The
+// images of an existing store at `path` are kept unless they are replaced.
+class TagStoreWriter {
+public:
+    explicit TagStoreWriter(const boost::filesystem::path & path);
+
+    // Encodes the tags of `desc`. Thread-safe.
+    void add(const ImageDesc & desc);
+    size_t size() const;
+    // Writes the store to a temporary file and renames it to `path`, so
+    // readers never see a half written store.
+    void save();
+private:
+    const boost::filesystem::path _path;
+    // encoded records by filename
+    std::map<std::string, std::string> _records;
+    mutable std::mutex _mutex;
+};
+}
+
+#endif //DEEP_LOCALIZER_TAGSTORE_H
@@ -0,0 +1,152 @@
+#ifndef DEEP_LOCALIZER_TAGTABLE_H
+#define DEEP_LOCALIZER_TAGTABLE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+#include "Image.h"
+
+namespace deeplocalizer {
+
+class TagStore;
+class TagTable;
+
+// A read-only tag of a TagTable with the accessors of Tag. The table must
+// outlive the view.
+class TagView {
+public:
+    TagView(const TagTable & table, size_t index) :
+        _table(&table), _index(index) {}
+
+    // index of the tag in the table
+    size_t index() const {
+        return _index;
+    }
+    // index of the image of the tag
+    size_t image() const;
+    cv::Point2i center() const;
+    cv::Rect getBoundingBox() const;
+    TagType type() const;
+    boost::optional<TagEllipse> ellipse() const;
+
+    inline bool isExclude() const {
+        return type() == Exclude;
+    }
+    inline bool isTag() const {
+        return type() == IsTag;
+    }
+    inline bool isNoTag() const {
+        return type() == NoTag;
+    }
+    inline bool isBeeWithoutTag() const {
+        return type() == BeeWithoutTag;
+    }
+    // A Tag with the same center, type and ellipse, e.g. to draw or edit it.
+    Tag toTag() const;
+private:
+    const TagTable * _table;
+    size_t _index;
+};
+
+// The tags of many images, e.g. of a whole season, in a compact
+// struct-of-arrays layout. A Tag takes 72 bytes and every ImageDesc
+// owns its tag vector and filename. Here, a tag takes 13 bytes: its center
+// as two 16 bit columns, a type column, the ellipse vote and the index of
+// its ellipse. Tags with an ellipse, i.e. proposals, take another 32 bytes
+// for the TagEllipse, so 45 bytes in total. Filenames are split into
+// directory and basename; every directory is stored once.
+//
+// Tags are kept in the order of their images, so the tags of an image are a
+// contiguous range. Tags do not keep their ids; TagView::toTag creates a new
+// one.
+//
+// The filters compute a mask of a block of a column and count it without
+// branches; these passes are vectorized. Only blocks with some but not all
+// tags selected are compacted by a scalar loop.
+class TagTable {
+public:
+    TagTable() = default;
+    // All images of a tag store.
+    static TagTable fromStore(const TagStore & store);
+
+    // Appends the image and its tags. Centers must fit into 16 bits.
+    void add(const ImageDesc & desc);
+    void reserve(size_t nb_images, size_t nb_tags);
+    // Frees the unused capacity of the columns.
+    void shrinkToFit();
+
+    // number of tags
+    size_t size() const {
+        return _x.size();
+    }
+    size_t nbImages() const {
+        return _tags_begin.size() - 1;
+    }
+    std::string filename(size_t image) const;
+    // the tags of `image` are [first, second)
+    std::pair<size_t, size_t> tagsOf(size_t image) const;
+    // the image of tag `i`
+    size_t imageOf(size_t i) const;
+    TagView tag(size_t i) const {
+        return TagView(*this, i);
+    }
+    // A copy of the image with its tags.
+    ImageDesc imageDesc(size_t image) const;
+
+    // The columns, one entry per tag.
+    const std::vector<int16_t> & xs() const {
+        return _x;
+    }
+    const std::vector<int16_t> & ys() const {
+        return _y;
+    }
+    const std::vector<uint8_t> & types() const {
+        return _type;
+    }
+    // NO_VOTE for tags without an ellipse
+    const std::vector<int32_t> & votes() const {
+        return _vote;
+    }
+    static const int32_t NO_VOTE;
+
+    // Indices of all tags of `type`.
+    std::vector<uint32_t> withType(TagType type) const;
+    // Indices of all tags with an ellipse whose vote is at least `min_vote`.
+    std::vector<uint32_t> withVote(int32_t min_vote) const;
+    // Indices of the tags in `indices` that are of `type`.
+    std::vector<uint32_t> withType(const std::vector<uint32_t> & indices, TagType type) const;
+
+    // Bytes used by the columns and filenames.
+    size_t memoryUsage() const;
+private:
+    friend class TagView;
+    static const uint32_t NO_ELLIPSE;
+
+    std::vector<int16_t> _x;
+    std::vector<int16_t> _y;
+    std::vector<uint8_t> _type;
+    std::vector<int32_t> _vote;
+    // index into _ellipses or NO_ELLIPSE
+    std::vector<uint32_t> _ellipse;
+    std::vector<TagEllipse> _ellipses;
+
+    // the tags of image i are [_tags_begin[i], _tags_begin[i+1])
+    std::vector<uint32_t> _tags_begin = {0};
+    // The basenames of all images in one arena. The basename of image i is
+    // [_name_begin[i], _name_begin[i+1]), its directory is _dirs[_dir[i]].
+    std::string _names;
+    std::vector<uint64_t> _name_begin = {0};
+    std::vector<uint32_t> _dir;
+    std::vector<std::string> _dirs;
+    std::unordered_map<std::string, uint32_t> _dir_ids;
+
+    uint32_t internDirectory(const std::string & dir);
+};
+}
+
+#endif //DEEP_LOCALIZER_TAGTABLE_H
@@ -0,0 +1,73 @@
+#ifndef DEEP_LOCALIZER_THREADINGPOLICY_H
+#define DEEP_LOCALIZER_THREADINGPOLICY_H
+
+#include <string>
+#include <vector>
+
+namespace deeplocalizer {
+
+// How the cores are shared between our own worker threads and the threads
+// OpenCV starts inside its functions (CLAHE, blurs, ...).
+enum class Parallelism {
+    // many frames at once, every OpenCV call runs on a single thread
+    Frames,
+    // one frame at a time, OpenCV uses all cores inside every call
+    IntraFrame,
+    // measure both at startup and pick the faster one
+    Auto
+};
+
+std::string parallelism_to_str(Parallelism parallelism);
+Parallelism parallelism_from_str(const std::string & str);
+
+// The CPUs this process may run on, grouped by NUMA node. A single group
+// with all allowed CPUs if the NUMA topology is unknown.
+std::vector<std::vector<int>> cpusByNumaNode();
+
+// Decides how many threads process frames, how many threads OpenCV may use
+// and where the worker threads run. `Auto` has to be resolved before, e.g.
+// with `probeParallelism`.
+class ThreadingPolicy {
+public:
+    explicit ThreadingPolicy(Parallelism parallelism = Parallelism::Frames,
+                             bool pin_threads = false);
+
+    Parallelism parallelism() const {
+        return _parallelism;
+    }
+    // number of CPUs this process may run on
+    size_t nbCores() const {
+        return _cpus.size();
+    }
+    // Number of threads working on different frames. `requested` if it is
+    // not 0, otherwise one per core or a single one for `IntraFrame`.
+    size_t frameThreads(size_t requested) const;
+    // Number of threads for work that does not call into OpenCV, e.g. reading
+    // files or parsing descriptions. `requested` if it is not 0, otherwise
+    // one per core.
+    size_t workerThreads(size_t requested) const;
+    // number of threads OpenCV may use inside a single call
+    int opencvThreads() const;
+
+    // Sets OpenCV's number of threads. Call it before starting the workers.
+    void apply() const;
+    // With `pin_threads`, binds the calling thread to one CPU. Consecutive
+    // workers go to different NUMA nodes, so every node gets its share.
+    // Returns false if the thread could not be pinned.
+    bool pinWorker(size_t worker_idx) const;
+private:
+    Parallelism _parallelism;
+    bool _pin_threads;
+    // allowed CPUs, interleaved over the NUMA nodes
+    std::vector<int> _cpus;
+};
+
+// The policy of the whole process, which the library's thread pools follow.
+// `Frames` parallelism without pinning until `setProcessPolicy` is called.
+ThreadingPolicy processPolicy();
+// Makes `policy` the policy of the process and applies it. Call it once at
+// startup, before any threads are started.
+void setProcessPolicy(const ThreadingPolicy & policy);
+}
+
+#endif //DEEP_LOCALIZER_THREADINGPOLICY_H
@@ -0,0 +1,47 @@
+#ifndef DEEP_LOCALIZER_THUMBNAILSTORE_H
+#define DEEP_LOCALIZER_THUMBNAILSTORE_H
+
+#include <string>
+
+#include <boost/filesystem.hpp>
+#include <opencv2/core/core.hpp>
+
+#include "Image.h"
+
+namespace deeplocalizer {
+
+// Small grayscale previews of images, kept in a directory under a key of
+// the image's content, so an image is decoded for its thumbnail only once
+// and a moved or renamed image keeps its thumbnail.
+class ThumbnailStore {
+public:
+    // a thumbnail is this many times smaller than its image on each side
+    static const int SCALE_DOWN = 32;
+
+    explicit ThumbnailStore(const boost::filesystem::path & dir = defaultDirectory());
+
+    // The thumbnail of `filename` from the store. If it is not there, the
+    // image is decoded at reduced resolution and its thumbnail stored.
+    // The returned image has the filename of the full image.
+    ImagePtr load(const std::string & filename) const;
+    // The file in the store for the thumbnail of `filename`.
+    boost::filesystem::path pathOf(const std::string & filename) const;
+    const boost::filesystem::path & directory() const {
+        return _dir;
+    }
+
+    // Hashes the size, the first and the last 64 KiB of the file, which
+    // hold the JPEG header and the end of the scan data. A shard reference
+    // is its own key, as shards are append only.
+    static std::string contentKey(const std::string & filename);
+    // Decodes the thumbnail of `filename`, using the JPEG decoder's reduced
+    // resolution modes where OpenCV has them.
+    static cv::Mat make(const std::string & filename);
+    // $XDG_CACHE_HOME/deeplocalizer/thumbnails, or ~/.cache/... without it.
+    static boost::filesystem::path defaultDirectory();
+private:
+    const boost::filesystem::path _dir;
+};
+}
+
+#endif //DEEP_LOCALIZER_THUMBNAILSTORE_H
@@ -0,0 +1,49 @@
+#ifndef DEEP_LOCALIZER_TILEPYRAMID_H
+#define DEEP_LOCALIZER_TILEPYRAMID_H
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+namespace deeplocalizer {
+
+// An image at halving resolutions, each cut into square tiles, so a view
+// of the image only touches the tiles it shows at about the resolution it
+// shows them. Level 0 is the image itself, level k is 2^k times smaller.
+// Levels are added until the image fits into one tile.
+class TilePyramid {
+public:
+    static const int DEFAULT_TILE_SIZE = 256;
+
+    // Shares the data of `mat` for level 0. With `max_levels` = 1, nothing
+    // is computed, so the first view does not wait for the smaller levels.
+    explicit TilePyramid(cv::Mat mat, int tile_size = DEFAULT_TILE_SIZE,
+                         size_t max_levels = 0);
+
+    size_t levels() const {
+        return _levels.size();
+    }
+    const cv::Mat & level(size_t level) const {
+        return _levels.at(level);
+    }
+    int tileSize() const {
+        return _tile_size;
+    }
+
+    // The smallest level that still has at least the resolution of the
+    // image drawn at `scale`.
+    size_t levelFor(double scale) const;
+    // The tiles of `level` that intersect `area`, in the pixel coordinates of
+    // that level. Tiles at the right and bottom border may be smaller.
+    std::vector<cv::Rect> tiles(size_t level, const cv::Rect & area) const;
+    // The pixels of `tile`, shared with the level.
+    cv::Mat tile(size_t level, const cv::Rect & tile) const {
+        return _levels.at(level)(tile);
+    }
+private:
+    const int _tile_size;
+    std::vector<cv::Mat> _levels;
+};
+}
+
+#endif //DEEP_LOCALIZER_TILEPYRAMID_H
@@ -1,7 +1,9 @@
 #ifndef DEEP_LOCALIZER_WHOLEIMAGEWIDGET_H
 #define DEEP_LOCALIZER_WHOLEIMAGEWIDGET_H
 
-#include <thread>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
 #include <QObject>
 #include <QWidget>
 #include <QScrollArea>
@@ -11,7 +13,10 @@
 #include <opencv2/core/core.hpp>
 #include <boost/optional/optional.hpp>
 #include <QtGui/qpainter.h>
+#include "BackgroundWriter.h"
 #include "Image.h"
+#include "TagGrid.h"
+#include "TilePyramid.h"
 #include "qt_helper.h"
 
 namespace deeplocalizer {
@@ -29,6 +34,7 @@ public:
     WholeImageWidget(QScrollArea * parent, cv::Mat mat, std::vector<Tag> * tags);
     WholeImageWidget(QScrollArea * parent,
                      boost::optional<std::pair<cv::Mat, std::vector<Tag> *>> tags);
+    ~WholeImageWidget();
     void setTags(cv::Mat mat, std::vector<Tag> * tags);
     void setZoomFactor(double factor);
     inline double getZoomFactor() {
@@ -45,21 +51,50 @@ public slots:
 signals:
     void imageFinished();
     void changed();
+    void tagAdded(Tag tag);
+    void tagErased(Tag tag);
+    // `tag` has the new type.
+    void tagTypeChanged(Tag tag);
 protected:
     void mousePressEvent(QMouseEvent *event);
     void wheelEvent(QWheelEvent * event);
     virtual void paintEvent(QPaintEvent *);
+private slots:
+    // Swaps in the pyramid of the current image once all its levels are built.
+    void pyramidBuilt(int generation);
 private:
     QScrollArea *_parent;
     cv::Mat _mat;
-    QPixmap _pixmap;
+    // only level 0 until the background build of the smaller levels is done
+    std::shared_ptr<const TilePyramid> _pyramid;
+    // bumped for every image, builds of an older one are dropped
+    std::atomic<int> _pyramid_generation{0};
+    // the newest finished build, handed to pyramidBuilt
+    std::mutex _built_mutex;
+    std::shared_ptr<const TilePyramid> _built_pyramid;
+    int _built_generation = 0;
+    // the converted tiles by level, row and column
+    std::unordered_map<uint64_t, QPixmap> _tile_pixmaps;
     QPainter _painter;
     double _scale = 0.8;
     std::vector<Tag> * _tags;
+    // the bounding boxes of *_tags by their index
+    TagGrid _grid;
     std::list<Tag> _newly_added_tags;
     std::set<unsigned long> _deleted_Ids;
+    // Builds the pyramids. Only the newest queued build is kept, so
+    // switching images never waits for a build. Declared last, it stops
+    // before the members its jobs use.
+    BackgroundWriter _pyramid_builder;
 
+    const QPixmap & tilePixmap(size_t level, const cv::Rect & tile);
     boost::optional<Tag> getTag(int x, int y);
+    void addTag(const Tag & tag);
+    // Removes the tag at `idx` by moving the last tag into its place.
+    void eraseTag(size_t idx);
+    void setTagType(size_t idx, TagType type);
+    // Rebuilds the grid if *_tags was changed by someone else.
+    void updateGrid();
 
     template<typename T>
     void eraseTag(const unsigned long id, T& tags) {
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace deeplocalizer {
+
+// Number of threads to use if the user did not ask for a specific number.
+inline size_t defaultNumberOfThreads() {
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+// Calls `fn(i, thread_idx)` for every `i` in [0, n) on `nb_threads` threads.
+// The threads claim chunks of `chunk_size` indices from a shared cursor, so
+// slow items do not hold back the other threads.
+template<typename Fn>
+void parallelFor(size_t n, size_t nb_threads, Fn fn, size_t chunk_size = 1) {
+    nb_threads = std::max(std::min(nb_threads, n), size_t(1));
+    chunk_size = std::max(chunk_size, size_t(1));
+    std::atomic<size_t> next_idx{0};
+    auto worker = [&](size_t thread_idx) {
+        while(true) {
+            size_t start = next_idx.fetch_add(chunk_size, std::memory_order_relaxed);
+            if (start >= n) {
+                return;
+            }
+            size_t end = std::min(start + chunk_size, n);
+            for(size_t i = start; i < end; i++) {
+                fn(i, thread_idx);
+            }
+        }
+    };
+    if (nb_threads == 1) {
+        worker(0);
+        return;
+    }
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < nb_threads; t++) {
+        threads.emplace_back(worker, t);
+    }
+    for(auto & thread : threads) {
+        thread.join();
+    }
+}
+}
@@ -0,0 +1,110 @@
+#ifndef DEEP_LOCALIZER_PREPROCESSING_H
+#define DEEP_LOCALIZER_PREPROCESSING_H
+
+#include <string>
+#include <utility>
+
+#include <boost/filesystem.hpp>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "Image.h"
+#include "simd.h"
+#include "ThreadingPolicy.h"
+
+namespace deeplocalizer {
+
+enum ImageFormat {
+    PNG,
+    JPEG
+
+};
+
+std::string format_to_str(ImageFormat format);
+
+// opencv default values
+static const int DEFAULT_JPEG_COMPRESSION = 95;
+static const int DEFAULT_PNG_COMPRESSION = 3;
+
+struct PreprocessOptions {
+    boost::filesystem::path output_dir;
+    bool use_hist_eq;
+    bool use_thresholding;
+    bool use_binary_image;
+    bool add_border;
+    ImageFormat format;
+    int compression;
+    bool benchmark;
+    size_t nb_read_threads;
+    size_t nb_threads;
+    size_t nb_write_threads;
+    size_t queue_size;
+    bool force;
+    size_t benchmark_samples;
+    // maximum size of a shard in bytes. 0 writes one file per image.
+    uint64_t shard_size;
+    // use the vectorized kernels for CLAHE and thresholding. Faster, but not
+    // bit identical to OpenCV.
+    bool use_simd;
+    // split the work over `nb_nodes` machines, this one processes the part
+    // `node_index`. 0 or 1 nodes process everything.
+    size_t node_index;
+    size_t nb_nodes;
+    // bytes the images in flight may use. 0 is unlimited.
+    uint64_t max_memory;
+    // frame level or intra frame parallelism, see ThreadingPolicy.h
+    Parallelism parallelism;
+    // bind every worker thread to one CPU
+    bool pin_threads;
+
+    std::pair<int, int> opencv_compression() const;
+    std::string extension() const;
+    // True if the image belongs to the part of this node. Depends only on
+    // the filename, so the split is the same in every pathfile order.
+    bool isOnThisNode(const std::string & image_path) const;
+    void print() const;
+};
+
+// Scratch images and the CLAHE instance reused by `processImage` across frames.
+struct ProcessingBuffers {
+    cv::Ptr<cv::CLAHE> clahe;
+    cv::Mat bordered;
+    cv::Mat equalized;
+    cv::Mat local_mean;
+    cv::Mat local_mean_float;
+    SimdBuffers simd;
+};
+
+void makeBorder(cv::Mat & mat);
+void localHistogramEq(cv::Mat & mat);
+void adaptiveTresholding(cv::Mat & mat, bool use_binary_image);
+
+// Applies border, CLAHE and thresholding one after the other.
+// Every step allocates a new image. Kept as reference for `processImage` below.
+void processImage(Image & img, const PreprocessOptions & opt);
+
+// Same result as `processImage(Image &, ...)` bit by bit, but writes into
+// `output` and keeps all intermediate images in `buffers`. The thresholding
+// and the blending with the original are done in a single sweep.
+// With `opt.use_simd`, CLAHE and thresholding use the kernels of simd.h and
+// the result may differ slightly.
+// `output` must not share its data with `input` or `buffers`.
+void processImage(const cv::Mat & input, cv::Mat & output,
+                  const PreprocessOptions & opt,
+                  ProcessingBuffers & buffers);
+
+// Processes copies of `sample` once with many frames in parallel and once
+// frame by frame with OpenCV using all cores. Returns the faster one.
+// With `opt.max_memory`, fewer frames are processed in parallel if their
+// buffers would not fit. Changes OpenCV's number of threads.
+Parallelism probeParallelism(const cv::Mat & sample, const PreprocessOptions & opt);
+
+// Peak signal-to-noise ratio in dB of two 8 bit images.
+// Infinite if the images are identical.
+double psnr(const cv::Mat & a, const cv::Mat & b);
+// Mean structural similarity of two 8 bit grayscale images.
+// Uses the usual 11x11 gaussian window with sigma 1.5.
+double ssim(const cv::Mat & a, const cv::Mat & b);
+}
+
+#endif //DEEP_LOCALIZER_PREPROCESSING_H
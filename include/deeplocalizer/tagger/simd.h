@@ -0,0 +1,63 @@
+#ifndef DEEP_LOCALIZER_SIMD_H
+#define DEEP_LOCALIZER_SIMD_H
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+namespace deeplocalizer {
+
+// Instruction sets the kernels below are compiled for. The best one the CPU
+// supports is picked at runtime.
+enum class SimdLevel {
+    Scalar,
+    SSE42,
+    AVX2,
+    AVX512
+};
+
+std::string simd_level_to_str(SimdLevel level);
+
+// The best level supported by this CPU.
+SimdLevel detectSimdLevel();
+// All levels supported by this CPU, from `Scalar` up to `detectSimdLevel()`.
+std::vector<SimdLevel> supportedSimdLevels();
+
+// Scratch memory of the kernels. Reused from frame to frame.
+struct SimdBuffers {
+    cv::Mat horizontal;
+    cv::Mat clahe_extended;
+    cv::Mat clahe_luts;
+    std::vector<float> padded_row;
+    std::vector<const float *> rows;
+    std::vector<int> lut_offsets_x1;
+    std::vector<int> lut_offsets_x2;
+    std::vector<float> weights_x;
+};
+
+// Gaussian weighted mean of the `block_size` x `block_size` neighbourhood of
+// every pixel of the 8 bit image `src` with replicated borders. `mean` is a
+// 32 bit float image. Uses the same kernel as cv::adaptiveThreshold, but
+// sums the separable passes in a different order, so results differ from
+// OpenCV's in the last bits.
+void gaussianLocalMeanSimd(const cv::Mat & src, cv::Mat & mean, int block_size,
+                           SimdBuffers & buffers, SimdLevel level = detectSimdLevel());
+
+// Sets every pixel brighter than its rounded local mean to `max_value` and
+// all others to 0. Unless `binary` is set, the result is then blended with
+// `src`: `weight_original * src + weight_threshold * threshold`.
+// `dst` must not share its data with `src`.
+void thresholdBlendSimd(const cv::Mat & src, const cv::Mat & mean, cv::Mat & dst,
+                        double max_value, bool binary,
+                        double weight_original, double weight_threshold,
+                        SimdLevel level = detectSimdLevel());
+
+// Contrast limited adaptive histogram equalization of an 8 bit image, like
+// cv::CLAHE with the same clip limit and tile grid.
+// `dst` must not share its data with `src`.
+void claheSimd(const cv::Mat & src, cv::Mat & dst, double clip_limit, cv::Size tile_grid,
+               SimdBuffers & buffers, SimdLevel level = detectSimdLevel());
+}
+
+#endif //DEEP_LOCALIZER_SIMD_H
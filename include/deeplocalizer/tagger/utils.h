@@ -1,5 +1,6 @@
 #pragma  once
 
+#include <cstdint>
 #include <iostream>
 #include <fstream>
 #include <chrono>
@@ -76,6 +77,21 @@ inline void printProgress(const std::chrono::time_point<Clock> & start_time,
     cout << "          " << std::flush;
 }
 
+// 64 bit FNV-1a hash. Unlike std::hash it is the same on every run and machine.
+inline uint64_t fnv1aHash(const void * data, size_t size,
+                          uint64_t hash = 14695981039346656037ULL) {
+    const unsigned char * bytes = static_cast<const unsigned char *>(data);
+    for(size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline uint64_t fnv1aHash(const std::string & str) {
+    return fnv1aHash(str.data(), str.size());
+}
+
 inline std::vector<unsigned long> shuffledIndecies(unsigned long n) {
     std::vector<unsigned long> indecies;
     indecies.reserve(n);
@@ -0,0 +1,90 @@
+
+#include "BackgroundWriter.h"
+
+#include <algorithm>
+#include <exception>
+
+namespace deeplocalizer {
+
+BackgroundWriter::BackgroundWriter(Callback done) :
+    _done(std::move(done)),
+    _thread(&BackgroundWriter::run, this)
+{ }
+
+BackgroundWriter::~BackgroundWriter() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopped = true;
+    }
+    _queued.notify_all();
+    _thread.join();
+}
+
+void BackgroundWriter::submit(Job job) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push_back(Item{std::string(), std::move(job)});
+    }
+    _queued.notify_one();
+}
+
+void BackgroundWriter::submit(const std::string & key, Job job) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto it = std::remove_if(_queue.begin(), _queue.end(), [&key](const Item & item) {
+            return item.key == key;
+        });
+        _coalesced += static_cast<size_t>(std::distance(it, _queue.end()));
+        _queue.erase(it, _queue.end());
+        _queue.push_back(Item{key, std::move(job)});
+    }
+    _queued.notify_one();
+}
+
+void BackgroundWriter::flush() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _idle.wait(lock, [this]() { return _queue.empty() && not _running; });
+}
+
+size_t BackgroundWriter::pending() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _queue.size() + (_running ? 1 : 0);
+}
+
+size_t BackgroundWriter::coalesced() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _coalesced;
+}
+
+void BackgroundWriter::run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while(true) {
+        _queued.wait(lock, [this]() { return _stopped || not _queue.empty(); });
+        if (_queue.empty()) {
+            return;
+        }
+        Item item = std::move(_queue.front());
+        _queue.pop_front();
+        _running = true;
+        lock.unlock();
+        boost::optional<std::string> error;
+        try {
+            item.job();
+        } catch(const std::string & msg) {
+            error = msg;
+        } catch(const std::exception & e) {
+            error = std::string(e.what());
+        } catch(...) {
+            error = std::string("unknown error");
+        }
+        if (_done) {
+            _done(item.key, error);
+        }
+        lock.lock();
+        _running = false;
+        if (_queue.empty()) {
+            _idle.notify_all();
+        }
+    }
+}
+}
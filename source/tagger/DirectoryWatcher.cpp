@@ -0,0 +1,112 @@
+
+#include "DirectoryWatcher.h"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "utils.h"
+
+namespace deeplocalizer {
+
+namespace io = boost::filesystem;
+
+const std::vector<std::string> DirectoryWatcher::IMAGE_EXTENSIONS = {".jpeg", ".jpg", ".png"};
+
+// `next` wakes up this often to check if the watcher was stopped.
+static const int POLL_TIMEOUT_MS = 200;
+
+DirectoryWatcher::DirectoryWatcher(const io::path & dir) : _dir(dir) {
+    ASSERT(io::is_directory(_dir), "Directory " << _dir << " does not exists.");
+#ifdef __linux__
+    _fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    ASSERT(_fd >= 0, "Cannot initialize inotify.");
+    // watch before listing the directory, so no image written in between is missed
+    int wd = inotify_add_watch(_fd, _dir.string().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    ASSERT(wd >= 0, "Cannot watch directory " << _dir);
+#else
+    ASSERT(false, "Watching a directory needs inotify, which is only available on Linux.");
+#endif
+    std::vector<std::string> existing;
+    for(io::directory_iterator it(_dir); it != io::directory_iterator(); ++it) {
+        if (io::is_regular_file(it->status()) && isImage(it->path())) {
+            existing.push_back(it->path().string());
+        }
+    }
+    std::sort(existing.begin(), existing.end());
+    _pending.insert(_pending.end(), existing.begin(), existing.end());
+}
+
+DirectoryWatcher::~DirectoryWatcher() {
+#ifdef __linux__
+    if (_fd >= 0) {
+        close(_fd);
+    }
+#endif
+}
+
+bool DirectoryWatcher::isImage(const io::path & path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return std::find(IMAGE_EXTENSIONS.begin(), IMAGE_EXTENSIONS.end(), ext) != IMAGE_EXTENSIONS.end();
+}
+
+void DirectoryWatcher::readEvents(int timeout_ms) {
+#ifdef __linux__
+    pollfd pfd{_fd, POLLIN, 0};
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+        return;
+    }
+    alignas(inotify_event) char buffer[64 * 1024];
+    while(true) {
+        ssize_t len = read(_fd, buffer, sizeof(buffer));
+        if (len <= 0) {
+            return;
+        }
+        for(char * ptr = buffer; ptr < buffer + len; ) {
+            const auto * event = reinterpret_cast<const inotify_event *>(ptr);
+            ptr += sizeof(inotify_event) + event->len;
+            if (event->len == 0 || (event->mask & IN_ISDIR)) {
+                continue;
+            }
+            io::path path = _dir / event->name;
+            if (not isImage(path)) {
+                continue;
+            }
+            // a file written right after the directory was listed is reported twice
+            if (std::find(_pending.begin(), _pending.end(), path.string()) == _pending.end()) {
+                _pending.push_back(path.string());
+            }
+        }
+    }
+#else
+    (void) timeout_ms;
+#endif
+}
+
+size_t DirectoryWatcher::next(size_t n, std::vector<std::string> & paths) {
+    paths.clear();
+    std::lock_guard<std::mutex> lock(_mutex);
+    while(_pending.empty() && not _stopped) {
+        readEvents(POLL_TIMEOUT_MS);
+    }
+    const size_t first_idx = _nb_read;
+    if (_stopped) {
+        return first_idx;
+    }
+    while(paths.size() < n && not _pending.empty()) {
+        paths.push_back(_pending.front());
+        _pending.pop_front();
+    }
+    _nb_read += paths.size();
+    return first_idx;
+}
+
+size_t DirectoryWatcher::nbRead() const {
+    return _nb_read;
+}
+}
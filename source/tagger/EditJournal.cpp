@@ -0,0 +1,192 @@
+
+#include "EditJournal.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+
+#include "utils.h"
+
+namespace deeplocalizer {
+
+namespace io = boost::filesystem;
+using json = nlohmann::json;
+
+static std::string kind_to_string(JournalEvent::Kind kind) {
+    switch(kind) {
+        case JournalEvent::AddTag:
+            return "add";
+        case JournalEvent::EraseTag:
+            return "erase";
+        case JournalEvent::SetTagType:
+            return "type";
+        case JournalEvent::Done:
+            return "done";
+    }
+    ASSERT(false, "unknown journal event " << static_cast<int>(kind));
+    return "";
+}
+
+static JournalEvent::Kind kind_from_string(const std::string & str) {
+    if (str == "add") {
+        return JournalEvent::AddTag;
+    } else if (str == "erase") {
+        return JournalEvent::EraseTag;
+    } else if (str == "type") {
+        return JournalEvent::SetTagType;
+    } else if (str == "done") {
+        return JournalEvent::Done;
+    }
+    ASSERT(false, "unknown journal event " << str);
+    return JournalEvent::Done;
+}
+
+json JournalEvent::to_json() const {
+    json j;
+    j["op"] = kind_to_string(kind);
+    j["image"] = image;
+    if (tag) {
+        j["tag"] = tag->to_json();
+    }
+    return j;
+}
+
+JournalEvent JournalEvent::from_json(const json & j) {
+    JournalEvent event;
+    event.kind = kind_from_string(j["op"].get<std::string>());
+    event.image = j["image"].get<std::string>();
+    if (j.find("tag") != j.end()) {
+        event.tag = Tag::from_json(j["tag"]);
+    }
+    return event;
+}
+
+EditJournal::EditJournal(const std::string & path, size_t batch_size) :
+    _path(path), _batch_size(std::max<size_t>(batch_size, 1))
+{ }
+
+EditJournal::~EditJournal() {
+    try {
+        flush();
+    } catch(const std::string & msg) {
+        std::cerr << "Could not flush the journal " << _path << ": " << msg << std::endl;
+    }
+    close();
+}
+
+void EditJournal::open() {
+    if (_fd >= 0) {
+        return;
+    }
+    _fd = ::open(_path.c_str(), O_RDWR | O_APPEND | O_CREAT, 0644);
+    ASSERT(_fd >= 0, "Cannot open journal " << _path << ": " << std::strerror(errno));
+    // end a line torn by a crash, so it does not swallow the next event
+    const off_t size = ::lseek(_fd, 0, SEEK_END);
+    char last = '\n';
+    if (size > 0 && ::pread(_fd, &last, 1, size - 1) == 1 && last != '\n') {
+        _buffer.insert(0, "\n");
+    }
+}
+
+void EditJournal::close() {
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+void EditJournal::append(const JournalEvent & event) {
+    _buffer += event.to_json().dump();
+    _buffer += '\n';
+    _nb_buffered++;
+    _nb_events++;
+    if (_nb_buffered >= _batch_size) {
+        flush();
+    }
+}
+
+void EditJournal::flush() {
+    if (_buffer.empty()) {
+        return;
+    }
+    open();
+    size_t written = 0;
+    while(written < _buffer.size()) {
+        const ssize_t n = ::write(_fd, _buffer.data() + written, _buffer.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        ASSERT(n >= 0, "Cannot write journal " << _path << ": " << std::strerror(errno));
+        written += static_cast<size_t>(n);
+    }
+    ASSERT(::fdatasync(_fd) == 0, "Cannot sync journal " << _path << ": " << std::strerror(errno));
+    _buffer.clear();
+    _nb_buffered = 0;
+}
+
+std::string EditJournal::compactingPath(const std::string & path) {
+    return path + ".compacting";
+}
+
+void EditJournal::rotate() {
+    flush();
+    close();
+    _nb_events = 0;
+    if (not io::exists(_path)) {
+        return;
+    }
+    const std::string compacting = compactingPath(_path);
+    if (io::exists(compacting)) {
+        {
+            std::ifstream is(_path, std::ios::binary);
+            std::ofstream os(compacting, std::ios::binary | std::ios::app);
+            // ends a torn last line, so it does not swallow the first event
+            os << '\n' << is.rdbuf();
+            os.flush();
+            ASSERT(os.good(), "Cannot append journal " << _path << " to " << compacting);
+        }
+        io::remove(_path);
+    } else {
+        io::rename(_path, compacting);
+    }
+}
+
+void EditJournal::finishCompaction(const std::string & path) {
+    io::remove(compactingPath(path));
+}
+
+static void readEvents(const std::string & path, std::vector<JournalEvent> & events) {
+    std::ifstream is(path);
+    if (not is.is_open()) {
+        return;
+    }
+    std::vector<std::string> lines;
+    std::string line;
+    while(std::getline(is, line)) {
+        if (not line.empty()) {
+            lines.push_back(line);
+        }
+    }
+    for(size_t i = 0; i < lines.size(); i++) {
+        try {
+            events.push_back(JournalEvent::from_json(json::parse(lines.at(i))));
+        } catch(...) {
+            // A crash can tear the last write. After a rotation, that line
+            // may be followed by the events of the next session.
+            std::cerr << "Skipping torn line " << i + 1 << " of journal " << path << std::endl;
+        }
+    }
+}
+
+std::vector<JournalEvent> EditJournal::read(const std::string & path) {
+    std::vector<JournalEvent> events;
+    readEvents(compactingPath(path), events);
+    readEvents(path, events);
+    return events;
+}
+}
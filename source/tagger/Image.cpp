@@ -6,7 +6,13 @@
 #include <boost/optional.hpp>
 
 #include "Image.h"
+#include "ImageShard.h"
+#include "JsonPullParser.h"
+#include "PathfileReader.h"
 #include "Tag.h"
+#include "TagStore.h"
+#include "ThreadingPolicy.h"
+#include "parallel.h"
 #include "utils.h"
 #include "qt_helper.h"
 
@@ -60,32 +66,25 @@ bool ImageDesc::operator==(const ImageDesc & other) const {
 }
 
 std::vector<ImageDescPtr> ImageDesc::fromPathFilePtr(const std::string &path,
-                                               const std::string & image_desc_extension) {
-    auto image_descs = fromPathFile(path, image_desc_extension);
-    std::vector<ImageDescPtr> image_desc_ptrs;
-    for(auto & desc : image_descs) {
-        image_desc_ptrs.emplace_back(std::make_shared<ImageDesc>(std::move(desc)));
-    }
-    return image_desc_ptrs;
+                                               const std::string & image_desc_extension,
+                                               std::vector<LoadError> * errors,
+                                               size_t nb_threads) {
+    return fromPathsPtr(PathfileReader(path).readAll(), image_desc_extension, errors, nb_threads);
 }
 
 std::vector<ImageDesc> ImageDesc::fromPathFile(const std::string &path,
-                                               const std::string & image_desc_extension) {
-    const io::path pathfile(path);
-    ASSERT(io::exists(pathfile), "File " << pathfile << " does not exists.");
-    ifstream ifs{pathfile.string()};
-    std::string path_to_image;
-    std::vector<std::string> paths;
-    for(int i = 0; std::getline(ifs, path_to_image); i++) {
-        ASSERT(io::exists(path_to_image), "File " << path_to_image << " does not exists.");
-        paths.push_back(path_to_image);
-    }
-    return fromPaths(paths, image_desc_extension);
+                                               const std::string & image_desc_extension,
+                                               std::vector<LoadError> * errors,
+                                               size_t nb_threads) {
+    // fromPaths checks that the images exist
+    return fromPaths(PathfileReader(path).readAll(), image_desc_extension, errors, nb_threads);
 }
 
 std::vector<ImageDescPtr> ImageDesc::fromPathsPtr(const std::vector<std::string> paths,
-                                                  const std::string & image_desc_extension) {
-    auto image_descs = fromPaths(paths, image_desc_extension);
+                                                  const std::string & image_desc_extension,
+                                                  std::vector<LoadError> * errors,
+                                                  size_t nb_threads) {
+    auto image_descs = fromPaths(paths, image_desc_extension, errors, nb_threads);
     std::vector<ImageDescPtr> image_desc_ptrs;
     for(auto & desc : image_descs) {
         image_desc_ptrs.emplace_back(std::make_shared<ImageDesc>(std::move(desc)));
@@ -93,19 +92,65 @@ std::vector<ImageDescPtr> ImageDesc::fromPathsPtr(const std::vector<std::string>
     return image_desc_ptrs;
 }
 
+// Most of the time goes to stat calls and JSON parsing, which run in
+// parallel. The threads claim chunks of this many paths.
+static const size_t LOAD_CHUNK_SIZE = 16;
+// at most this many errors are listed in the exception of `fromPaths`
+static const size_t MAX_LISTED_ERRORS = 10;
+
 std::vector<ImageDesc> ImageDesc::fromPaths(const std::vector<std::string> paths,
-                                            const std::string & image_desc_extension) {
+                                            const std::string & image_desc_extension,
+                                            std::vector<LoadError> * errors,
+                                            size_t nb_threads) {
+    if (nb_threads == 0) {
+        nb_threads = processPolicy().workerThreads(0);
+    }
+    std::vector<boost::optional<ImageDesc>> loaded(paths.size());
+    std::vector<std::string> messages(paths.size());
+    parallelFor(paths.size(), nb_threads, [&](size_t i, size_t) {
+        const std::string & path = paths.at(i);
+        try {
+            if (not imageExists(path)) {
+                messages.at(i) = "File does not exists.";
+                return;
+            }
+            auto desc = ImageDesc(path);
+            desc.setSavePathExtension(image_desc_extension);
+            if(io::exists(desc.savePath())) {
+                desc = *ImageDesc::load(desc.savePath());
+                desc.filename = path;
+            }
+            loaded.at(i) = std::move(desc);
+        } catch(const std::string & msg) {
+            messages.at(i) = msg;
+        } catch(const std::exception & e) {
+            messages.at(i) = e.what();
+        } catch(...) {
+            // nothing may escape the worker thread
+            messages.at(i) = "Unknown error.";
+        }
+    }, LOAD_CHUNK_SIZE);
+
     std::vector<ImageDesc> descs;
-    for(auto & path: paths) {
-        ASSERT(io::exists(path), "File " << path << " does not exists.");
-        auto desc = ImageDesc(path);
-        desc.setSavePathExtension(image_desc_extension);
-        if(io::exists(desc.savePath())) {
-            desc = *ImageDesc::load(desc.savePath());
-            desc.filename = path;
+    descs.reserve(paths.size());
+    std::vector<LoadError> failed;
+    for(size_t i = 0; i < paths.size(); i++) {
+        if (loaded.at(i)) {
+            descs.push_back(std::move(*loaded.at(i)));
+        } else {
+            failed.push_back(LoadError{paths.at(i), messages.at(i)});
         }
-        descs.push_back(desc);
     }
+    if (errors) {
+        errors->insert(errors->end(), failed.begin(), failed.end());
+        return descs;
+    }
+    std::stringstream ss;
+    for(size_t i = 0; i < std::min(failed.size(), MAX_LISTED_ERRORS); i++) {
+        ss << std::endl << "    " << failed.at(i).path << ": " << failed.at(i).message;
+    }
+    ASSERT(failed.empty(), "Could not load " << failed.size() << " of " << paths.size()
+                           << " images:" << ss.str());
     return descs;
 }
 
@@ -126,18 +171,35 @@ void ImageDesc::save(const std::string & path) {
 }
 
 ImageDescPtr ImageDesc::load(const std::string & path) {
-    std::ifstream is(path);
-    nlohmann::json json_desc;
-    is >>  json_desc;
-    return std::make_shared<ImageDesc>(ImageDesc::from_json(json_desc));
+    std::ifstream is(path, std::ios::binary);
+    ASSERT(is, "Cannot open " << path);
+    std::stringstream ss;
+    ss << is.rdbuf();
+    return std::make_shared<ImageDesc>(ImageDesc::parse(ss.str()));
+}
+
+void ImageDesc::save(TagStoreWriter & store) const {
+    store.add(*this);
+}
+
+ImageDescPtr ImageDesc::load(const TagStore & store, const std::string & filename) {
+    auto desc = store.find(filename);
+    if (not desc) {
+        return nullptr;
+    }
+    return std::make_shared<ImageDesc>(std::move(*desc));
 }
 
 Image::Image() {
 }
 
 Image::Image(const ImageDesc & descr) : _filename(descr.filename)  {
-    ASSERT(io::exists(_filename), "Cannot open file: " << _filename);
-    _mat = cv::imread(_filename, cv::IMREAD_GRAYSCALE);
+    ASSERT(imageExists(_filename), "Cannot open file: " << _filename);
+    _mat = readImage(_filename, cv::IMREAD_GRAYSCALE);
+}
+
+Image::Image(const std::string & filename, cv::Mat mat) :
+    _mat(mat), _filename(filename) {
 }
 
 
@@ -184,6 +246,28 @@ json ImageDesc::to_json() const {
     return j;
 }
 
+ImageDesc ImageDesc::parse(const std::string & text) {
+    JsonPullParser parser(text);
+    std::string filename;
+    std::vector<Tag> tags;
+    std::string key;
+    parser.beginObject();
+    while(parser.nextKey(key)) {
+        if (key == "filename") {
+            filename = parser.string();
+        } else if (key == "tags") {
+            parser.beginArray();
+            while(parser.nextElement()) {
+                tags.push_back(Tag::parse(parser));
+            }
+        } else {
+            parser.skipValue();
+        }
+    }
+    parser.end();
+    return ImageDesc(filename, std::move(tags));
+}
+
 ImageDesc ImageDesc::from_json(const json &j) {
     std::vector<Tag> tags;
     for(const auto & jtag : j["tags"]) {
@@ -0,0 +1,181 @@
+
+#include "ImageCache.h"
+
+#include <algorithm>
+
+namespace deeplocalizer {
+
+ImageCache::ImageCache(size_t max_bytes, Loader loader, size_t nb_threads, Callback prefetched) :
+    _max_bytes(max_bytes), _loader(std::move(loader)),
+    _nb_threads(std::max<size_t>(nb_threads, 1)), _prefetched(std::move(prefetched))
+{ }
+
+ImageCache::~ImageCache() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopped = true;
+        _queue.clear();
+    }
+    _queued.notify_all();
+    for(auto & worker : _workers) {
+        worker.join();
+    }
+}
+
+ImagePtr ImageCache::decode(const std::string & filename) {
+    return std::make_shared<Image>(ImageDesc(filename));
+}
+
+size_t ImageCache::bytesOf(const Image & image) {
+    const cv::Mat mat = image.getCvMat();
+    return mat.total() * mat.elemSize();
+}
+
+ImagePtr ImageCache::get(const std::string & filename) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    auto it = _entries.find(filename);
+    if (it == _entries.end() && _decoding.count(filename)) {
+        _stats.waits++;
+        _decoded.wait(lock, [&]() { return not _decoding.count(filename); });
+        it = _entries.find(filename);
+        if (it == _entries.end()) {
+            // the background thread failed, decode again to report the error
+            _stats.misses++;
+        }
+    } else if (it == _entries.end()) {
+        _stats.misses++;
+    } else {
+        _stats.hits++;
+    }
+    if (it != _entries.end()) {
+        touch(it->second);
+        return it->second.image;
+    }
+    _queue.erase(std::remove(_queue.begin(), _queue.end(), filename), _queue.end());
+    lock.unlock();
+    ImagePtr image = _loader(filename);
+    lock.lock();
+    insert(filename, image);
+    return image;
+}
+
+ImagePtr ImageCache::find(const std::string & filename) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _entries.find(filename);
+    if (it == _entries.end()) {
+        return nullptr;
+    }
+    touch(it->second);
+    return it->second.image;
+}
+
+void ImageCache::prefetch(const std::vector<std::string> & filenames) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.clear();
+        // the first filename ends up as the most recently used one
+        for(auto it = filenames.rbegin(); it != filenames.rend(); ++it) {
+            auto entry = _entries.find(*it);
+            if (entry != _entries.end()) {
+                touch(entry->second);
+            }
+        }
+        for(const auto & filename : filenames) {
+            if (not _entries.count(filename) && not _decoding.count(filename) &&
+                    std::find(_queue.begin(), _queue.end(), filename) == _queue.end()) {
+                _queue.push_back(filename);
+            }
+        }
+        if (_queue.empty()) {
+            return;
+        }
+        while(_workers.size() < _nb_threads) {
+            _workers.emplace_back(&ImageCache::run, this);
+        }
+    }
+    _queued.notify_all();
+}
+
+bool ImageCache::contains(const std::string & filename) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _entries.count(filename) > 0;
+}
+
+void ImageCache::clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _queue.clear();
+    _entries.clear();
+    _lru.clear();
+    _used = 0;
+}
+
+ImageCache::Stats ImageCache::stats() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
+
+size_t ImageCache::usedBytes() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _used;
+}
+
+void ImageCache::run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while(true) {
+        _queued.wait(lock, [this]() { return _stopped || not _queue.empty(); });
+        if (_stopped) {
+            return;
+        }
+        std::string filename = std::move(_queue.front());
+        _queue.pop_front();
+        if (_entries.count(filename) || _decoding.count(filename)) {
+            continue;
+        }
+        _decoding.insert(filename);
+        lock.unlock();
+        ImagePtr image;
+        try {
+            image = _loader(filename);
+        } catch(...) {
+            // left to `get`, which reports the error to the caller
+        }
+        lock.lock();
+        _decoding.erase(filename);
+        if (image) {
+            insert(filename, image);
+            _stats.prefetched++;
+        }
+        _decoded.notify_all();
+        if (image && _prefetched) {
+            lock.unlock();
+            _prefetched(filename);
+            lock.lock();
+        }
+    }
+}
+
+void ImageCache::insert(const std::string & filename, ImagePtr image) {
+    auto it = _entries.find(filename);
+    if (it != _entries.end()) {
+        _used -= it->second.bytes;
+        _lru.erase(it->second.lru);
+        _entries.erase(it);
+    }
+    const size_t bytes = bytesOf(*image);
+    _lru.push_front(filename);
+    _entries[filename] = Entry{std::move(image), bytes, _lru.begin()};
+    _used += bytes;
+    // the new image is kept even if it alone exceeds the limit
+    while(_used > _max_bytes && _lru.size() > 1) {
+        auto last = _entries.find(_lru.back());
+        _used -= last->second.bytes;
+        _entries.erase(last);
+        _lru.pop_back();
+        _stats.evictions++;
+    }
+}
+
+void ImageCache::touch(Entry & entry) {
+    _lru.splice(_lru.begin(), _lru, entry.lru);
+}
+}
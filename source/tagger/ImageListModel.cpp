@@ -0,0 +1,270 @@
+
+#include "ImageListModel.h"
+
+#include <algorithm>
+
+#include <QDebug>
+#include <QPainter>
+
+#include "qt_helper.h"
+
+namespace deeplocalizer {
+
+const size_t ImageListModel::THUMBNAIL_CACHE_BYTES;
+
+namespace {
+// What a thumbnail shows of a tag.
+struct TagMark {
+    cv::Point2i center;
+    TagType type;
+};
+
+std::vector<TagMark> marksOf(const std::vector<Tag> & tags) {
+    std::vector<TagMark> marks;
+    marks.reserve(tags.size());
+    for(const auto & tag : tags) {
+        marks.push_back(TagMark{tag.center(), tag.type()});
+    }
+    return marks;
+}
+
+// A thumbnail and the tags of its stored description, both read on a
+// worker thread of the thumbnail cache. Only the marks are kept, proposals
+// can have thousands of tags.
+class TaggedThumbnail : public Image {
+public:
+    TaggedThumbnail(const Image & thumbnail, boost::optional<std::vector<TagMark>> stored) :
+        Image(thumbnail), stored(std::move(stored)) {}
+    // none if the image has no description file or it is unreadable
+    const boost::optional<std::vector<TagMark>> stored;
+};
+}
+
+ImageListModel::ImageListModel(ManuallyTagger * tagger, QObject * parent) :
+    QAbstractListModel(parent), _tagger(tagger), _decorations(512)
+{ }
+
+void ImageListModel::enableThumbnails(std::shared_ptr<const ThumbnailStore> store,
+                                      size_t nb_threads) {
+    _idx_of.clear();
+    const auto & descs = _tagger->getImageDescs();
+    for(unsigned long idx = 0; idx < descs.size(); idx++) {
+        _idx_of[descs.at(idx)->filename] = idx;
+    }
+    _placeholder = QPixmap(thumbnailSize());
+    _placeholder.fill(Qt::darkGray);
+    _thumbnails = std::make_unique<ImageCache>(THUMBNAIL_CACHE_BYTES,
+        [store](const std::string & filename) -> ImagePtr {
+            ImagePtr thumbnail = store->load(filename);
+            boost::optional<std::vector<TagMark>> stored;
+            try {
+                if (auto desc = ManuallyTagger::readImageDesc(filename)) {
+                    stored = marksOf(desc->getTags());
+                }
+            } catch(const std::string & msg) {
+                qWarning() << "No tags on the thumbnail: " << QString::fromStdString(msg);
+            }
+            return std::make_shared<TaggedThumbnail>(*thumbnail, std::move(stored));
+        },
+        nb_threads,
+        [this](const std::string & filename) {
+            // called on a worker thread
+            QMetaObject::invokeMethod(this, "thumbnailReady", Qt::QueuedConnection,
+                                      Q_ARG(QString, QString::fromStdString(filename)));
+        });
+    beginResetModel();
+    endResetModel();
+}
+
+int ImageListModel::rowCount(const QModelIndex & parent) const {
+    if (parent.isValid()) {
+        return 0;
+    }
+    if (_filter == All) {
+        return static_cast<int>(_tagger->getImageDescs().size());
+    }
+    return static_cast<int>(_rows.size());
+}
+
+QVariant ImageListModel::data(const QModelIndex & index, int role) const {
+    if (not index.isValid() || index.row() >= rowCount()) {
+        return QVariant();
+    }
+    const unsigned long idx = imageIdx(index.row());
+    const auto & filename = _tagger->getImageDescs().at(idx)->filename;
+    if (role == Qt::ToolTipRole) {
+        return QString::fromStdString(filename);
+    }
+    if (role == Qt::DecorationRole) {
+        return decoration(idx);
+    }
+    if (role != Qt::DisplayRole) {
+        return QVariant();
+    }
+    QString check;
+    if (_tagger->isDone(idx)) {
+        check = "\u2713  ";
+    }
+    QString text = "#" + QString::number(idx + 1) + ":   " + check +
+                   QString::fromStdString(filename);
+    const auto & status = _tagger->status(idx);
+    if (status.nb_tags >= 0) {
+        text += "   (" + QString::number(status.nb_tags) + ")";
+    }
+    return text;
+}
+
+void ImageListModel::setFilter(Filter filter) {
+    beginResetModel();
+    _filter = filter;
+    _rows.clear();
+    if (_filter == WithExcluded) {
+        for(const auto & error : _tagger->countTags()) {
+            qWarning() << "Could not count the tags of" << QString::fromStdString(error.path)
+                       << ":" << QString::fromStdString(error.message);
+        }
+    }
+    if (_filter != All) {
+        const unsigned long n = _tagger->getImageDescs().size();
+        for(unsigned long idx = 0; idx < n; idx++) {
+            if (matches(idx)) {
+                _rows.push_back(idx);
+            }
+        }
+    }
+    endResetModel();
+}
+
+QStringList ImageListModel::filterNames() {
+    return {tr("All images"), tr("Not done"), tr("With excluded regions")};
+}
+
+unsigned long ImageListModel::imageIdx(int row) const {
+    if (_filter == All) {
+        return static_cast<unsigned long>(row);
+    }
+    return _rows.at(static_cast<size_t>(row));
+}
+
+QModelIndex ImageListModel::indexOf(unsigned long idx) const {
+    if (_filter == All) {
+        return index(static_cast<int>(idx));
+    }
+    auto it = std::lower_bound(_rows.cbegin(), _rows.cend(), idx);
+    if (it == _rows.cend() || *it != idx) {
+        return QModelIndex();
+    }
+    return index(static_cast<int>(it - _rows.cbegin()));
+}
+
+QVariant ImageListModel::decoration(unsigned long idx) const {
+    if (not _thumbnails) {
+        return QVariant();
+    }
+    if (const QPixmap * cached = _decorations.object(idx)) {
+        return *cached;
+    }
+    const auto & filename = _tagger->getImageDescs().at(idx)->filename;
+    ImagePtr thumbnail = _thumbnails->find(filename);
+    if (not thumbnail) {
+        wantThumbnail(filename);
+        return _placeholder;
+    }
+    // Until the tagger loads a description, it is only a placeholder. The
+    // stored one was read with the thumbnail, off the GUI thread.
+    const auto & stored = static_cast<const TaggedThumbnail &>(*thumbnail).stored;
+    const auto & desc = _tagger->getImageDescs().at(idx);
+    const std::vector<TagMark> marks = (_tagger->isLoaded(idx) || not stored) ?
+                                       marksOf(desc->getTags()) : *stored;
+    auto pixmap = new QPixmap(cvMatToQPixmap(thumbnail->getCvMat()));
+    QPainter painter(pixmap);
+    painter.setRenderHint(QPainter::Antialiasing);
+    const double scale = 1. / ThumbnailStore::SCALE_DOWN;
+    const double radius = std::max(1., scale * TAG_WIDTH / 2);
+    for(const auto & mark : marks) {
+        if (mark.type == TagType::IsTag) {
+            painter.setPen(Qt::green);
+        } else if (mark.type == TagType::NoTag) {
+            painter.setPen(Qt::red);
+        } else if (mark.type == TagType::Exclude) {
+            painter.setPen(Qt::magenta);
+        } else {
+            painter.setPen(Qt::cyan);
+        }
+        painter.drawEllipse(QPointF(mark.center.x * scale, mark.center.y * scale), radius, radius);
+    }
+    painter.end();
+    const QPixmap result = *pixmap;
+    _decorations.insert(idx, pixmap);
+    return result;
+}
+
+void ImageListModel::wantThumbnail(const std::string & filename) const {
+    auto it = std::find(_wanted.begin(), _wanted.end(), filename);
+    if (it == _wanted.begin()) {
+        return;
+    }
+    if (it != _wanted.end()) {
+        _wanted.erase(it);
+    }
+    // scrolling asks for new rows, they are made first
+    _wanted.push_front(filename);
+    if (_wanted.size() > MAX_WANTED_THUMBNAILS) {
+        _wanted.pop_back();
+    }
+    _thumbnails->prefetch(std::vector<std::string>(_wanted.cbegin(), _wanted.cend()));
+}
+
+void ImageListModel::thumbnailReady(QString filename) {
+    const std::string name = filename.toStdString();
+    _wanted.erase(std::remove(_wanted.begin(), _wanted.end(), name), _wanted.end());
+    auto it = _idx_of.find(name);
+    if (it == _idx_of.end()) {
+        return;
+    }
+    _decorations.remove(it->second);
+    const QModelIndex changed = indexOf(it->second);
+    if (changed.isValid()) {
+        emit dataChanged(changed, changed, {Qt::DecorationRole});
+    }
+}
+
+void ImageListModel::imageChanged(unsigned long idx) {
+    // the tags drawn on the thumbnail may have changed
+    _decorations.remove(idx);
+    if (_filter == All) {
+        const QModelIndex changed = index(static_cast<int>(idx));
+        emit dataChanged(changed, changed);
+        return;
+    }
+    auto it = std::lower_bound(_rows.begin(), _rows.end(), idx);
+    const int row = static_cast<int>(it - _rows.begin());
+    const bool shown = it != _rows.end() && *it == idx;
+    const bool match = matches(idx);
+    if (shown && match) {
+        const QModelIndex changed = index(row);
+        emit dataChanged(changed, changed);
+    } else if (shown) {
+        beginRemoveRows(QModelIndex(), row, row);
+        _rows.erase(it);
+        endRemoveRows();
+    } else if (match) {
+        beginInsertRows(QModelIndex(), row, row);
+        _rows.insert(it, idx);
+        endInsertRows();
+    }
+}
+
+bool ImageListModel::matches(unsigned long idx) const {
+    switch(_filter) {
+        case All:
+            return true;
+        case NotDone:
+            return not _tagger->isDone(idx);
+        case WithExcluded:
+            // counted by setFilter, unless the description is unreadable
+            return _tagger->status(idx).nb_excluded > 0;
+    }
+    return true;
+}
+}
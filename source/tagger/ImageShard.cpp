@@ -0,0 +1,232 @@
+
+#include "ImageShard.h"
+
+#include <cctype>
+#include <iomanip>
+
+#include <opencv2/highgui/highgui.hpp>
+#include <json.hpp>
+
+#include "utils.h"
+
+namespace deeplocalizer {
+
+namespace io = boost::filesystem;
+namespace ipc = boost::interprocess;
+using json = nlohmann::json;
+
+const std::string ShardWriter::EXTENSION = ".shard";
+const std::string ShardWriter::INDEX_EXTENSION = ".index";
+
+static const size_t RECORD_HEADER_SIZE = sizeof(uint64_t);
+
+std::string ShardRef::str() const {
+    return shard + ":" + std::to_string(offset);
+}
+
+boost::optional<ShardRef> ShardRef::parse(const std::string & path) {
+    size_t colon = path.rfind(':');
+    if (colon == std::string::npos || colon + 1 == path.size()) {
+        return boost::none;
+    }
+    const std::string shard = path.substr(0, colon);
+    if (io::path(shard).extension() != ShardWriter::EXTENSION) {
+        return boost::none;
+    }
+    for(size_t i = colon + 1; i < path.size(); i++) {
+        if (not std::isdigit(static_cast<unsigned char>(path[i]))) {
+            return boost::none;
+        }
+    }
+    ShardRef ref;
+    ref.shard = shard;
+    ref.offset = std::stoull(path.substr(colon + 1));
+    return ref;
+}
+
+// The mapped shard of `ref` if the record of `ref` lies in it. A mapping
+// that is too short is checked against the file once, as the shard may have
+// grown since it was mapped.
+static std::shared_ptr<ImageShard> shardOf(const ShardRef & ref) {
+    auto shard = ImageShard::open(ref.shard);
+    if (shard && not shard->contains(ref.offset)) {
+        shard = ImageShard::open(ref.shard, true);
+    }
+    if (not shard || not shard->contains(ref.offset)) {
+        return nullptr;
+    }
+    return shard;
+}
+
+bool imageExists(const std::string & path) {
+    auto ref = ShardRef::parse(path);
+    if (not ref) {
+        return io::exists(path);
+    }
+    return shardOf(ref.get()) != nullptr;
+}
+
+cv::Mat readImage(const std::string & path, int flags) {
+    auto ref = ShardRef::parse(path);
+    if (not ref) {
+        return cv::imread(path, flags);
+    }
+    auto shard = shardOf(ref.get());
+    if (not shard) {
+        return cv::Mat();
+    }
+    cv::Mat image = shard->decode(ref->offset, flags);
+    if (image.empty()) {
+        // the shard may have been replaced by a new one with the same name
+        shard = ImageShard::open(ref->shard, true);
+        if (shard && shard->contains(ref->offset)) {
+            image = shard->decode(ref->offset, flags);
+        }
+    }
+    return image;
+}
+
+ShardWriter::ShardWriter(const io::path & prefix, uint64_t max_bytes) :
+    _prefix(prefix), _max_bytes(max_bytes)
+{
+    if (not _prefix.parent_path().empty()) {
+        io::create_directories(_prefix.parent_path());
+    }
+}
+
+void ShardWriter::openNextShard() {
+    do {
+        std::stringstream ss;
+        ss << _prefix.string() << "_" << std::setw(5) << std::setfill('0')
+           << _next_shard_idx++ << EXTENSION;
+        _shard_path = ss.str();
+    } while(io::exists(_shard_path));
+    _data.close();
+    _index.close();
+    _data.open(_shard_path.string(), std::ios::binary);
+    io::path index_path = _shard_path;
+    index_path += INDEX_EXTENSION;
+    _index.open(index_path.string());
+    ASSERT(_data.is_open() && _index.is_open(), "Cannot create shard " << _shard_path);
+    _offset = 0;
+    _nb_shards++;
+}
+
+std::string ShardWriter::append(const std::string & name, const std::vector<uchar> & data) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (not _data.is_open() || (_offset > 0 && _offset + data.size() > _max_bytes)) {
+        openNextShard();
+    }
+    ShardRef ref;
+    ref.shard = _shard_path.string();
+    ref.offset = _offset;
+    uchar header[RECORD_HEADER_SIZE];
+    uint64_t size = data.size();
+    for(size_t i = 0; i < RECORD_HEADER_SIZE; i++) {
+        header[i] = static_cast<uchar>(size >> (8*i));
+    }
+    _data.write(reinterpret_cast<const char *>(header), RECORD_HEADER_SIZE);
+    _data.write(reinterpret_cast<const char *>(data.data()), data.size());
+    // the manifest records the reference right away, so the frame must be
+    // in the shard before the index and the manifest point to it
+    _data.flush();
+    ASSERT(_data.good(), "Cannot write to shard " << _shard_path);
+    json j;
+    j["name"] = name;
+    j["offset"] = ref.offset;
+    j["size"] = size;
+    _index << j.dump() << std::endl;
+    _offset += RECORD_HEADER_SIZE + data.size();
+    return ref.str();
+}
+
+ImageShard::ImageShard(const io::path & path) {
+    _size = io::file_size(path);
+    _mtime = io::last_write_time(path);
+    // an empty file cannot be mapped
+    if (_size > 0) {
+        _file = ipc::file_mapping(path.string().c_str(), ipc::read_only);
+        _region = ipc::mapped_region(_file, ipc::read_only);
+    }
+    io::path index_path = path;
+    index_path += ShardWriter::INDEX_EXTENSION;
+    std::ifstream is(index_path.string());
+    std::string line;
+    while(std::getline(is, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        try {
+            json j = json::parse(line);
+            _offsets[j["name"].get<std::string>()] = j["offset"].get<uint64_t>();
+        } catch(const std::exception &) {
+            // the last line may be cut off by a crash
+            break;
+        }
+    }
+}
+
+std::shared_ptr<ImageShard> ImageShard::open(const io::path & path, bool revalidate) {
+    static std::mutex mutex;
+    static std::unordered_map<std::string, std::shared_ptr<ImageShard>> shards;
+    const std::string key = path.string();
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = shards.find(key);
+    if (it != shards.end() && not revalidate) {
+        return it->second;
+    }
+    boost::system::error_code ec;
+    const uintmax_t size = io::file_size(path, ec);
+    const std::time_t mtime = ec ? 0 : io::last_write_time(path, ec);
+    if (ec) {
+        if (it != shards.end()) {
+            shards.erase(it);
+        }
+        return nullptr;
+    }
+    if (it == shards.end() || it->second->size() != size || it->second->_mtime != mtime) {
+        auto shard = std::make_shared<ImageShard>(path);
+        shards[key] = shard;
+        return shard;
+    }
+    return it->second;
+}
+
+bool ImageShard::contains(uint64_t offset) const {
+    if (offset + RECORD_HEADER_SIZE > _size) {
+        return false;
+    }
+    return recordSize(offset) <= _size - offset - RECORD_HEADER_SIZE;
+}
+
+uint64_t ImageShard::recordSize(uint64_t offset) const {
+    const uchar * record = static_cast<const uchar *>(_region.get_address()) + offset;
+    uint64_t size = 0;
+    for(size_t i = 0; i < RECORD_HEADER_SIZE; i++) {
+        size |= static_cast<uint64_t>(record[i]) << (8*i);
+    }
+    return size;
+}
+
+cv::Mat ImageShard::encoded(uint64_t offset) const {
+    ASSERT(offset + RECORD_HEADER_SIZE <= _size, "Offset " << offset << " is outside of the shard.");
+    const uchar * record = static_cast<const uchar *>(_region.get_address()) + offset;
+    const uint64_t size = recordSize(offset);
+    ASSERT(offset + RECORD_HEADER_SIZE + size <= _size,
+           "Frame at offset " << offset << " is cut off.");
+    return cv::Mat(1, static_cast<int>(size), CV_8U,
+                   const_cast<uchar *>(record + RECORD_HEADER_SIZE));
+}
+
+cv::Mat ImageShard::decode(uint64_t offset, int flags) const {
+    return cv::imdecode(encoded(offset), flags);
+}
+
+boost::optional<uint64_t> ImageShard::find(const std::string & name) const {
+    auto it = _offsets.find(name);
+    if (it == _offsets.end()) {
+        return boost::none;
+    }
+    return it->second;
+}
+}
@@ -0,0 +1,297 @@
+
+#include "JsonPullParser.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+namespace deeplocalizer {
+
+JsonPullParser::JsonPullParser(const char * begin, const char * end) :
+    _begin(begin), _pos(begin), _end(end)
+{ }
+
+JsonPullParser::JsonPullParser(const std::string & text) :
+    JsonPullParser(text.data(), text.data() + text.size())
+{ }
+
+void JsonPullParser::fail(const std::string & message) const {
+    std::stringstream ss;
+    ss << "Invalid JSON at offset " << (_pos - _begin) << ": " << message;
+    throw ss.str();
+}
+
+void JsonPullParser::skipWhitespace() {
+    while(_pos < _end && (*_pos == ' ' || *_pos == '\n' || *_pos == '\r' || *_pos == '\t')) {
+        _pos++;
+    }
+}
+
+char JsonPullParser::peek() {
+    skipWhitespace();
+    if (_pos == _end) {
+        fail("unexpected end");
+    }
+    return *_pos;
+}
+
+void JsonPullParser::expect(char c) {
+    if (peek() != c) {
+        fail(std::string("expected '") + c + "' but got '" + *_pos + "'");
+    }
+    _pos++;
+}
+
+void JsonPullParser::expectWord(const char * word) {
+    const size_t length = std::strlen(word);
+    if (static_cast<size_t>(_end - _pos) < length || std::strncmp(_pos, word, length) != 0) {
+        fail(std::string("expected ") + word);
+    }
+    _pos += length;
+}
+
+void JsonPullParser::beginObject() {
+    expect('{');
+    _first.push_back(true);
+}
+
+bool JsonPullParser::nextKey(std::string & key) {
+    if (_first.empty()) {
+        fail("not in an object");
+    }
+    if (peek() == '}') {
+        _pos++;
+        _first.pop_back();
+        return false;
+    }
+    if (not _first.back()) {
+        expect(',');
+    }
+    _first.back() = false;
+    readString(key);
+    expect(':');
+    return true;
+}
+
+void JsonPullParser::beginArray() {
+    expect('[');
+    _first.push_back(true);
+}
+
+bool JsonPullParser::nextElement() {
+    if (_first.empty()) {
+        fail("not in an array");
+    }
+    if (peek() == ']') {
+        _pos++;
+        _first.pop_back();
+        return false;
+    }
+    if (not _first.back()) {
+        expect(',');
+    }
+    _first.back() = false;
+    return true;
+}
+
+std::string JsonPullParser::string() {
+    std::string str;
+    readString(str);
+    return str;
+}
+
+unsigned long JsonPullParser::hex4() {
+    if (_end - _pos < 4) {
+        fail("truncated \\u escape");
+    }
+    unsigned long value = 0;
+    for(int i = 0; i < 4; i++) {
+        const char c = *_pos++;
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value |= c - 'A' + 10;
+        } else {
+            fail("invalid \\u escape");
+        }
+    }
+    return value;
+}
+
+void JsonPullParser::appendCodepoint(std::string & out, unsigned long codepoint) {
+    if (codepoint < 0x80) {
+        out.push_back(static_cast<char>(codepoint));
+    } else if (codepoint < 0x800) {
+        out.push_back(static_cast<char>(0xc0 | (codepoint >> 6)));
+        out.push_back(static_cast<char>(0x80 | (codepoint & 0x3f)));
+    } else if (codepoint < 0x10000) {
+        out.push_back(static_cast<char>(0xe0 | (codepoint >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3f)));
+        out.push_back(static_cast<char>(0x80 | (codepoint & 0x3f)));
+    } else {
+        out.push_back(static_cast<char>(0xf0 | (codepoint >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((codepoint >> 12) & 0x3f)));
+        out.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3f)));
+        out.push_back(static_cast<char>(0x80 | (codepoint & 0x3f)));
+    }
+}
+
+void JsonPullParser::readString(std::string & out) {
+    out.clear();
+    expect('"');
+    while(true) {
+        // copy the plain characters up to the next quote or escape at once
+        const char * begin = _pos;
+        while(_pos < _end && *_pos != '"' && *_pos != '\\') {
+            if (static_cast<unsigned char>(*_pos) < 0x20) {
+                fail("control character in string");
+            }
+            _pos++;
+        }
+        out.append(begin, _pos);
+        if (_pos == _end) {
+            fail("unterminated string");
+        }
+        if (*_pos++ == '"') {
+            return;
+        }
+        if (_pos == _end) {
+            fail("unterminated string");
+        }
+        switch(*_pos++) {
+            case '"': out.push_back('"'); break;
+            case '\\': out.push_back('\\'); break;
+            case '/': out.push_back('/'); break;
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'n': out.push_back('\n'); break;
+            case 'r': out.push_back('\r'); break;
+            case 't': out.push_back('\t'); break;
+            case 'u': {
+                unsigned long codepoint = hex4();
+                if (codepoint >= 0xd800 && codepoint <= 0xdbff) {
+                    expectWord("\\u");
+                    const unsigned long low = hex4();
+                    if (low < 0xdc00 || low > 0xdfff) {
+                        fail("invalid surrogate pair");
+                    }
+                    codepoint = 0x10000 + ((codepoint - 0xd800) << 10) + (low - 0xdc00);
+                }
+                appendCodepoint(out, codepoint);
+                break;
+            }
+            default:
+                fail("invalid escape");
+        }
+    }
+}
+
+const char * JsonPullParser::numberEnd() const {
+    const char * pos = _pos;
+    while(pos < _end && *pos != '\0' && std::strchr("0123456789+-.eE", *pos) != nullptr) {
+        pos++;
+    }
+    return pos;
+}
+
+double JsonPullParser::number() {
+    skipWhitespace();
+    const char * end = numberEnd();
+    // strtod needs a terminated string
+    char buffer[64];
+    const size_t length = end - _pos;
+    if (length == 0 || length >= sizeof(buffer)) {
+        fail("expected a number");
+    }
+    std::memcpy(buffer, _pos, length);
+    buffer[length] = '\0';
+    char * parsed_end;
+    const double value = std::strtod(buffer, &parsed_end);
+    if (parsed_end != buffer + length) {
+        fail("invalid number");
+    }
+    _pos = end;
+    return value;
+}
+
+long JsonPullParser::integer() {
+    skipWhitespace();
+    const char * pos = _pos;
+    const bool negative = pos < _end && *pos == '-';
+    if (negative) {
+        pos++;
+    }
+    long value = 0;
+    const char * digits = pos;
+    while(pos < _end && *pos >= '0' && *pos <= '9') {
+        value = 10 * value + (*pos - '0');
+        pos++;
+    }
+    if (pos == digits) {
+        fail("expected an integer");
+    }
+    if (pos < _end && (*pos == '.' || *pos == 'e' || *pos == 'E')) {
+        // like nlohmann::json, a floating point number is truncated
+        return static_cast<long>(number());
+    }
+    _pos = pos;
+    return negative ? -value : value;
+}
+
+bool JsonPullParser::boolean() {
+    if (peek() == 't') {
+        expectWord("true");
+        return true;
+    }
+    expectWord("false");
+    return false;
+}
+
+bool JsonPullParser::null() {
+    if (peek() != 'n') {
+        return false;
+    }
+    expectWord("null");
+    return true;
+}
+
+void JsonPullParser::skipValue() {
+    std::string ignored;
+    switch(peek()) {
+        case '{':
+            beginObject();
+            while(nextKey(ignored)) {
+                skipValue();
+            }
+            break;
+        case '[':
+            beginArray();
+            while(nextElement()) {
+                skipValue();
+            }
+            break;
+        case '"':
+            readString(ignored);
+            break;
+        case 't':
+        case 'f':
+            boolean();
+            break;
+        case 'n':
+            null();
+            break;
+        default:
+            number();
+    }
+}
+
+void JsonPullParser::end() {
+    skipWhitespace();
+    if (_pos != _end) {
+        fail("trailing characters");
+    }
+}
+}
@@ -2,9 +2,13 @@
 #include "ManuallyTagger.h"
 
 #include <QDebug>
+#include <numeric>
+#include <unordered_map>
 #include <boost/archive/xml_oarchive.hpp>
 #include <boost/archive/xml_iarchive.hpp>
 
+#include "ThreadingPolicy.h"
+#include "parallel.h"
 #include "utils.h"
 #include "qt_helper.h"
 
@@ -18,6 +22,15 @@ namespace io = boost::filesystem;
 const std::string ManuallyTagger::IMAGE_DESC_EXT = "tagger.json";
 const std::string ManuallyTagger::DEFAULT_SAVE_PATH = "tagger_progress.json";
 
+namespace {
+void setTagCounts(const std::vector<Tag> & tags, ImageStatus & status) {
+    status.nb_tags = static_cast<long>(tags.size());
+    status.nb_excluded = std::count_if(tags.cbegin(), tags.cend(), [](const Tag & tag) {
+        return tag.type() == TagType::Exclude;
+    });
+}
+}
+
 
 ManuallyTagger::ManuallyTagger() {
     init();
@@ -51,48 +64,289 @@ ManuallyTagger::ManuallyTagger(std::vector<ImageDescPtr> && descriptions,
     init();
 }
 
+ManuallyTagger::~ManuallyTagger() {
+    // Finishes the jobs while the whole tagger is alive: they use the journal
+    // and report to `written`. `_writer` is declared last, so it is also the
+    // first member to be destructed.
+    _writer.flush();
+}
+
 void ManuallyTagger::init() {
     if(_loaded_from_serialization) {
-        _image_descs = ImageDesc::fromPathsPtr(_image_paths, IMAGE_DESC_EXT);
+        _image_descs.clear();
+        for(const auto & path : _image_paths) {
+            _image_descs.push_back(std::make_shared<ImageDesc>(path));
+        }
     }
     _image_paths.clear();
-    for(auto & descr : _image_descs) {
-        ASSERT(io::exists(descr->filename),
-               "Could not open file " << descr->filename);
+    const size_t n = _image_descs.size();
+    // Every image and description is stat'ed, in parallel, but none is
+    // opened. The status index keeps the tag counts of a description as long
+    // as its mtime did not change, e.g. by `bb_tagstore export`.
+    const auto index = StatusIndex::load(indexPath());
+    _status.assign(n, ImageStatus());
+    std::vector<std::string> errors(n);
+    parallelFor(n, processPolicy().workerThreads(0), [&](size_t i, size_t) {
+        auto & descr = _image_descs.at(i);
         descr->setSavePathExtension(IMAGE_DESC_EXT);
+        if (not io::exists(descr->filename)) {
+            errors.at(i) = descr->filename;
+            return;
+        }
+        _status.at(i) = ImageStatus::probe(descr->savePath());
+        auto it = index.find(descr->filename);
+        if (it != index.end() && it->second.has_desc == _status.at(i).has_desc &&
+                it->second.desc_mtime == _status.at(i).desc_mtime) {
+            _status.at(i) = it->second;
+        }
+    }, 256);
+    for(const auto & error : errors) {
+        ASSERT(error.empty(), "Could not open file " << error);
     }
     // sort images that are allready done to the begining
-    std::sort(_image_descs.begin(), _image_descs.end(),
-              [this](const ImageDescPtr &d1, const ImageDescPtr &d2){
-                    return isDone(*d1) > isDone(*d2);
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return _status.at(a).has_desc > _status.at(b).has_desc;
     });
+    const bool keep_done = _done_tagging.size() == n;
+    std::vector<ImageDescPtr> descs(n);
+    std::vector<ImageStatus> status(n);
+    std::vector<bool> done_tagging(n, false);
+    for(size_t i = 0; i < n; i++) {
+        descs.at(i) = std::move(_image_descs.at(order.at(i)));
+        status.at(i) = _status.at(order.at(i));
+        done_tagging.at(i) = keep_done && _done_tagging.at(order.at(i));
+    }
+    _image_descs = std::move(descs);
+    _status = std::move(status);
+    _done_tagging = std::move(done_tagging);
+    _n_done = std::count(_done_tagging.cbegin(), _done_tagging.cend(), true);
+    _loaded.assign(n, false);
     for(auto & descr : _image_descs) {
-        if (io::exists(descr->savePath())) {
-            descr = ImageDesc::load(descr->savePath());
-        } else {
-            descr->setSavePathExtension(".proposal.json");
-            if (io::exists(descr->savePath())) {
-                descr = ImageDesc::load(descr->savePath());
+        _image_paths.push_back(descr->filename);
+    }
+    // the index is written with the next snapshot, next to the progress
+    replayJournal();
+}
+
+ImageDescPtr ManuallyTagger::imageDesc(unsigned long idx) {
+    auto & descr = _image_descs.at(idx);
+    if (_loaded.at(idx)) {
+        return descr;
+    }
+    if (auto stored = readImageDesc(descr->filename)) {
+        descr = stored;
+    }
+    descr->setSavePathExtension(IMAGE_DESC_EXT);
+    _loaded.at(idx) = true;
+    _status.at(idx) = ImageStatus::probe(descr->savePath());
+    updateStatus(idx);
+    // the placeholder was replaced, and with it the tags
+    emit imageChanged(idx);
+    return descr;
+}
+
+ImageDescPtr ManuallyTagger::readImageDesc(const std::string & filename) {
+    for(const auto & ext : {IMAGE_DESC_EXT, std::string("proposal.json")}) {
+        const std::string path = filename + "." + ext;
+        if (not io::exists(path)) {
+            continue;
+        }
+        try {
+            return ImageDesc::load(path);
+        } catch(const std::string & msg) {
+            ASSERT(false, "Could not load " << path << ": " << msg);
+        } catch(const std::exception & e) {
+            ASSERT(false, "Could not load " << path << ": " << e.what());
+        } catch(...) {
+            ASSERT(false, "Could not load " << path << ".");
+        }
+    }
+    return nullptr;
+}
+
+void ManuallyTagger::updateStatus(size_t idx) {
+    setTagCounts(_image_descs.at(idx)->getTags(), _status.at(idx));
+}
+
+std::vector<LoadError> ManuallyTagger::countTags() {
+    std::vector<size_t> unknown;
+    for(size_t idx = 0; idx < _status.size(); idx++) {
+        if (_status.at(idx).nb_tags < 0 || _status.at(idx).nb_excluded < 0) {
+            unknown.push_back(idx);
+        }
+    }
+    std::vector<std::string> messages(unknown.size());
+    parallelFor(unknown.size(), processPolicy().workerThreads(0), [&](size_t i, size_t) {
+        const size_t idx = unknown.at(i);
+        try {
+            ImageDescPtr descr = _image_descs.at(idx);
+            if (not _loaded.at(idx)) {
+                if (auto stored = readImageDesc(descr->filename)) {
+                    descr = stored;
+                }
             }
+            setTagCounts(descr->getTags(), _status.at(idx));
+        } catch(const std::string & msg) {
+            messages.at(i) = msg;
+        } catch(...) {
+            // nothing may escape the worker thread
+            messages.at(i) = "Unknown error.";
         }
-        descr->setSavePathExtension(IMAGE_DESC_EXT);
-        _image_paths.push_back(descr->filename);
+    }, 16);
+    std::vector<LoadError> errors;
+    for(size_t i = 0; i < unknown.size(); i++) {
+        if (not messages.at(i).empty()) {
+            errors.push_back(LoadError{_image_descs.at(unknown.at(i))->filename, messages.at(i)});
+        }
+    }
+    return errors;
+}
+
+EditJournal & ManuallyTagger::journal() {
+    if (not _journal) {
+        _journal = std::make_unique<EditJournal>(journalPath());
+    }
+    return *_journal;
+}
+
+void ManuallyTagger::replayJournal() {
+    if (_image_descs.empty()) {
+        return;
     }
-    if (_image_descs.size() != _done_tagging.size()) {
-        _done_tagging = std::vector<bool>(_image_descs.size(), false);
-        _n_done = 0;
-    } else {
-        _n_done = std::count(_done_tagging.cbegin(), _done_tagging.cend(), true);
+    const auto events = EditJournal::read(journalPath());
+    if (events.empty()) {
+        return;
+    }
+    std::unordered_map<std::string, size_t> indices;
+    for(size_t i = 0; i < _image_descs.size(); i++) {
+        indices[_image_descs.at(i)->filename] = i;
+    }
+    for(const auto & event : events) {
+        auto it = indices.find(event.image);
+        if (it == indices.end()) {
+            continue;
+        }
+        const size_t idx = it->second;
+        _dirty.insert(idx);
+        if (event.kind == JournalEvent::Done) {
+            _done_tagging.at(idx) = true;
+            _image_idx = idx;
+            continue;
+        }
+        if (not event.tag) {
+            continue;
+        }
+        auto & tags = imageDesc(idx)->getTags();
+        const cv::Point2i center = event.tag->center();
+        auto tag = std::find_if(tags.begin(), tags.end(), [&center](const Tag & t) {
+            return t.center() == center;
+        });
+        if (event.kind == JournalEvent::AddTag && tag == tags.end()) {
+            tags.push_back(*event.tag);
+        } else if (event.kind == JournalEvent::EraseTag && tag != tags.end()) {
+            tags.erase(tag);
+        } else if (event.kind == JournalEvent::SetTagType && tag != tags.end()) {
+            tag->setType(event.tag->type());
+        }
+    }
+    _n_done = std::count(_done_tagging.cbegin(), _done_tagging.cend(), true);
+}
+
+void ManuallyTagger::record(JournalEvent::Kind kind, boost::optional<Tag> tag, size_t idx) {
+    JournalEvent event{kind, _image_descs.at(idx)->filename, tag};
+    _writer.submit([this, event]() {
+        journal().append(event);
+    });
+    _dirty.insert(idx);
+    if (event.tag) {
+        updateStatus(idx);
+        emit imageChanged(idx);
+    }
+    if (++_nb_journaled >= COMPACT_AFTER) {
+        compact();
+    }
+}
+
+void ManuallyTagger::written(const std::string & job, const boost::optional<std::string> & error) {
+    if (error) {
+        qWarning() << "Could not save the tagger: " << QString::fromStdString(*error);
+        emit saveFailed(QString::fromStdString(*error));
+    } else if (job == "snapshot") {
+        emit saved();
+    }
+}
+
+void ManuallyTagger::tagAdded(Tag tag) {
+    record(JournalEvent::AddTag, tag, _image_idx);
+}
+
+void ManuallyTagger::tagErased(Tag tag) {
+    record(JournalEvent::EraseTag, tag, _image_idx);
+}
+
+void ManuallyTagger::tagTypeChanged(Tag tag) {
+    record(JournalEvent::SetTagType, tag, _image_idx);
+}
+
+void ManuallyTagger::flushJournal() {
+    _writer.submit("journal", [this]() {
+        journal().flush();
+    });
+}
+
+void ManuallyTagger::compact(bool wait) {
+    auto snapshot = std::make_shared<Snapshot>();
+    // A snapshot that is not written yet, because it is queued, running or
+    // failed, may be replaced by this one. Its descriptions are not dirty
+    // anymore, so they are written again.
+    if (_snapshot && not _snapshot->written) {
+        snapshot->descs = _snapshot->descs;
+    }
+    for(size_t idx : _dirty) {
+        snapshot->descs[idx] = *imageDesc(idx);
+        _status.at(idx).has_desc = true;
+        updateStatus(idx);
+    }
+    _dirty.clear();
+    _nb_journaled = 0;
+    snapshot->state = to_json();
+    snapshot->status = _status;
+    snapshot->paths = _image_paths;
+    _snapshot = snapshot;
+    const std::string save_path = _save_path;
+    const std::string journal_path = journalPath();
+    const std::string index_path = indexPath();
+    _writer.submit("snapshot", [this, snapshot, save_path, journal_path, index_path]() {
+        // the edits queued after this snapshot go to a new journal
+        journal().rotate();
+        auto status = snapshot->status;
+        for(const auto & entry : snapshot->descs) {
+            ImageDesc desc = entry.second;
+            desc.save();
+            status.at(entry.first).desc_mtime = ImageStatus::probe(desc.savePath()).desc_mtime;
+        }
+        StatusIndex::save(index_path, snapshot->paths, status);
+        safe_serialization(save_path, nlohmann::json(snapshot->state));
+        EditJournal::finishCompaction(journal_path);
+        snapshot->written = true;
+    });
+    if (wait) {
+        _writer.flush();
     }
 }
 
 void ManuallyTagger::save(bool all_descs) const {
     save(savePath());
+    // descriptions that were never loaded are unchanged
     if (all_descs) {
-        for(auto & desc: _image_descs) {
-            desc->save();
+        for(size_t i = 0; i < _image_descs.size(); i++) {
+            if (_loaded.at(i)) {
+                _image_descs.at(i)->save();
+            }
         }
-    } else {
+    } else if (_loaded.at(_image_idx)) {
         _image_descs.at(_image_idx)->save();
     }
 
@@ -106,6 +360,7 @@ std::unique_ptr<ManuallyTagger> ManuallyTagger::load(const std::string & path) {
     nlohmann::json j;
     is >> j;
     auto tagger = ManuallyTagger::from_json(j);
+    tagger->_save_path = path;
     tagger->_loaded_from_serialization = true;
     tagger->init();
     return tagger;
@@ -126,8 +381,19 @@ void ManuallyTagger::loadImage(unsigned long idx) {
         return;
     }
     _image_idx = idx;
-    _image = std::make_shared<Image>(*_image_descs.at(_image_idx));
-    _desc = _image_descs.at(_image_idx);
+    _desc = imageDesc(_image_idx);
+    _image = _cache.get(_desc->filename);
+    // the neighbours, nearest first, while the window draws this image
+    std::vector<std::string> neighbours{_desc->filename};
+    for(size_t d = 1; d <= _prefetch_depth; d++) {
+        if (idx + d < _image_descs.size()) {
+            neighbours.push_back(_image_descs.at(idx + d)->filename);
+        }
+        if (idx >= d) {
+            neighbours.push_back(_image_descs.at(idx - d)->filename);
+        }
+    }
+    _cache.prefetch(neighbours);
     emit loadedImage(_image_idx, _desc, _image);
     if (_image_idx == 0) { emit firstImage(); }
     if (_image_idx + 1 == _image_descs.size()) { emit lastImage(); }
@@ -137,6 +403,12 @@ void ManuallyTagger::loadCurrentImage() {
     loadImage(_image_idx);
 }
 
+void ManuallyTagger::prefetch(unsigned long idx) {
+    if (idx < _image_descs.size()) {
+        _cache.prefetch({_image_descs.at(idx)->filename});
+    }
+}
+
 void ManuallyTagger::doneTagging() {
     doneTagging(_image_idx);
 }
@@ -146,10 +418,12 @@ void ManuallyTagger::doneTagging(unsigned long idx) {
         qWarning() << "[doneTagging] index " << idx << " exceeded size of images "
             << _done_tagging.size();
     }
-    _image_descs.at(idx)->save();
-    save();
+    // only the journal is written here; compact() writes the description
+    record(JournalEvent::Done, boost::none, idx);
+    flushJournal();
     _done_tagging.at(idx) = true;
     _n_done++;
+    emit imageChanged(idx);
     emit progress(static_cast<double>(_n_done)/_image_descs.size());
 }
 
@@ -1,10 +1,13 @@
 #include <QApplication>
+#include <QDebug>
 #include <QMessageBox>
 #include <QKeyEvent>
 #include <QScrollBar>
 #include <QTimer>
 #include <QListView>
+#include <QComboBox>
 #include "ManuallyTaggerWindow.h"
+#include "ThreadingPolicy.h"
 #include "utils.h"
 
 using boost::optional;
@@ -31,7 +34,14 @@ void ManuallyTaggerWindow::init() {
     _grid_layout = new QGridLayout(ui->scrollArea);
     _whole_image = new WholeImageWidget(ui->scrollArea);
     _progres_bar = new QProgressBar(ui->statusbar);
-    _image_list_model = new QStringListModel(this);
+    _image_list_model = new ImageListModel(_tagger.get(), this);
+    try {
+        // half the cores, the others stay free for the window and the images
+        _image_list_model->enableThumbnails(std::make_shared<ThumbnailStore>(),
+                                            std::max<size_t>(processPolicy().nbCores() / 2, 1));
+    } catch(const std::exception & e) {
+        qWarning() << "No thumbnails: " << e.what();
+    }
     _save_timer = new QTimer(this);
     _save_timer->start(10000);
     ui->scrollArea->setAlignment(Qt::AlignCenter);
@@ -44,7 +54,12 @@ void ManuallyTaggerWindow::init() {
 
 ManuallyTaggerWindow::~ManuallyTaggerWindow()
 {
-    save();
+    try {
+        // waits until the snapshot and the journal are written
+        _tagger->compact(true);
+    } catch(const std::string & msg) {
+        qWarning() << "Could not save the tagger: " << QString::fromStdString(msg);
+    }
     delete ui;
 }
 
@@ -98,6 +113,9 @@ void ManuallyTaggerWindow::setupConnections() {
     connect(ui->push_next, &QPushButton::clicked, ui->actionNext, &QAction::trigger);
     connect(ui->push_back, &QPushButton::clicked, ui->actionBack, &QAction::trigger);
     connect(_whole_image, &WholeImageWidget::changed, this, &ManuallyTaggerWindow::changed);
+    connect(_whole_image, &WholeImageWidget::tagAdded, _tagger.get(), &ManuallyTagger::tagAdded);
+    connect(_whole_image, &WholeImageWidget::tagErased, _tagger.get(), &ManuallyTagger::tagErased);
+    connect(_whole_image, &WholeImageWidget::tagTypeChanged, _tagger.get(), &ManuallyTagger::tagTypeChanged);
     connect(_tagger.get(), &ManuallyTagger::loadedImage, this, &ManuallyTaggerWindow::setImage);
     connect(_tagger.get(), &ManuallyTagger::outOfRange, []() {
         QMessageBox box;
@@ -106,9 +124,26 @@ void ManuallyTaggerWindow::setupConnections() {
         box.exec();
     });
     connect(_tagger.get(), &ManuallyTagger::progress, this, &ManuallyTaggerWindow::setProgress);
-    connect(_save_timer, &QTimer::timeout, this, [this]() { this->save(false); });
+    connect(_save_timer, &QTimer::timeout, _tagger.get(), &ManuallyTagger::flushJournal);
+    // emitted from the writer thread, so the slot runs queued on this one
+    connect(_tagger.get(), &ManuallyTagger::saveFailed, this, [this](QString message) {
+        // the next save writes the snapshot again
+        _changed = true;
+        ui->statusbar->showMessage(tr("Could not save: ") + message);
+    });
+    // decoding starts on press, the image is shown on release
+    connect(ui->imagesListView, &QListView::pressed, [this](const QModelIndex & idx) {
+        _tagger->prefetch(_image_list_model->imageIdx(idx.row()));
+    });
     connect(ui->imagesListView, &QListView::clicked, [this](const QModelIndex & idx) {
-        _tagger->loadImage(idx.row());
+        _tagger->loadImage(_image_list_model->imageIdx(idx.row()));
+    });
+    connect(_tagger.get(), &ManuallyTagger::imageChanged,
+            _image_list_model, &ImageListModel::imageChanged);
+    connect(ui->imagesFilter, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+            [this](int filter) {
+        _image_list_model->setFilter(static_cast<ImageListModel::Filter>(filter));
+        ui->imagesListView->setCurrentIndex(_image_list_model->indexOf(_tagger->getIdx()));
     });
 }
 
@@ -130,25 +165,14 @@ void ManuallyTaggerWindow::updateStatusBar() {
 void ManuallyTaggerWindow::setupUi() {
     ui->statusbar->addPermanentWidget(_progres_bar);
     setProgress(0);
-    _image_list_model->setStringList(fileStringList());
+    ui->imagesFilter->addItems(ImageListModel::filterNames());
+    // all rows have the same height, so the view only asks for the visible ones
+    ui->imagesListView->setUniformItemSizes(true);
+    ui->imagesListView->setIconSize(ImageListModel::thumbnailSize());
     ui->imagesListView->setModel(_image_list_model);
 
 }
 
-QStringList ManuallyTaggerWindow::fileStringList() {
-    QStringList list;
-    auto & descs = _tagger->getImageDescs();
-    for(size_t i = 0; i < descs.size(); i++) {
-        const auto &desc = descs.at(i);
-        QString check;
-        if (_tagger->isDone(i)) {
-            check = "\u2713  ";
-        }
-        list.append("#" + QString::number(i+1) + ":   " + check +
-                            QString::fromStdString(desc->filename));
-    }
-    return list;
-}
 void ManuallyTaggerWindow::next() {
     if (_whole_image->getZoomFactor() > 0.5) {
         _whole_image->setZoomFactor(0.30);
@@ -157,8 +181,6 @@ void ManuallyTaggerWindow::next() {
 
     _whole_image->setZoomFactor(1.50);
     _tagger->doneTagging();
-
-    _image_list_model->setStringList(fileStringList());
     _tagger->loadNextImage();
 }
 
@@ -234,7 +256,7 @@ void ManuallyTaggerWindow::setImage(unsigned long idx, ImageDescPtr desc,
     _desc = desc;
     _image = img;
     updateStatusBar();
-    ui->imagesListView->setCurrentIndex(_image_list_model->index(idx));
+    ui->imagesListView->setCurrentIndex(_image_list_model->indexOf(idx));
     showImage();
 
 }
@@ -250,15 +272,10 @@ void ManuallyTaggerWindow::changed() {
     _changed = true;
     updateStatusBar();
 }
-void ManuallyTaggerWindow::save(bool all_descs) {
+void ManuallyTaggerWindow::save(bool) {
     if(_changed) {
-        _tagger->save();
-        if (all_descs) {
-        } else {
-            if (_desc) {
-                _desc->save();
-            }
-        }
+        // every edit is already in the journal, this writes a snapshot
+        _tagger->compact();
         _changed = false;
         updateStatusBar();
     }
@@ -0,0 +1,80 @@
+
+#include "PathfileReader.h"
+
+#include <boost/filesystem.hpp>
+
+#include "utils.h"
+
+namespace deeplocalizer {
+
+namespace io = boost::filesystem;
+
+const std::string PathfileReader::STDIN = "-";
+
+PathfileReader::PathfileReader(const std::string & pathfile) :
+    _is(pathfile == STDIN ? std::cin : _file)
+{
+    if (pathfile != STDIN) {
+        ASSERT(io::exists(pathfile), "File " << pathfile << " does not exists.");
+        _file.open(pathfile);
+        _file_size = io::file_size(pathfile);
+    }
+}
+
+PathfileReader::PathfileReader(std::istream & is) : _is(is) {
+}
+
+size_t PathfileReader::next(size_t n, std::vector<std::string> & paths) {
+    paths.clear();
+    std::lock_guard<std::mutex> lock(_mutex);
+    const size_t first_idx = _nb_read;
+    std::string line;
+    while(paths.size() < n && not _eof) {
+        if (not std::getline(_is, line)) {
+            _eof = true;
+            break;
+        }
+        _bytes_read += line.size() + 1;
+        if (line.empty()) {
+            continue;
+        }
+        paths.push_back(line);
+    }
+    _nb_read += paths.size();
+    return first_idx;
+}
+
+std::vector<std::string> PathfileReader::readAll() {
+    std::vector<std::string> all_paths;
+    std::vector<std::string> paths;
+    while(true) {
+        next(4096, paths);
+        if (paths.empty()) {
+            break;
+        }
+        all_paths.insert(all_paths.end(), paths.begin(), paths.end());
+    }
+    return all_paths;
+}
+
+size_t PathfileReader::nbRead() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _nb_read;
+}
+
+bool PathfileReader::eof() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _eof;
+}
+
+double PathfileReader::fractionRead() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_eof) {
+        return 1;
+    }
+    if (_file_size == 0) {
+        return 0;
+    }
+    return std::min(1., static_cast<double>(_bytes_read) / _file_size);
+}
+}
@@ -0,0 +1,147 @@
+
+#include "PreprocessContext.h"
+
+#include <fstream>
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include "deeplocalizer_tagger.h"
+#include "utils.h"
+
+namespace deeplocalizer {
+
+cv::Mat FramePool::acquire(cv::Size size, int type) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for(auto it = _free.begin(); it != _free.end(); ++it) {
+            if (it->size() == size && it->type() == type) {
+                cv::Mat mat = *it;
+                _free.erase(it);
+                return mat;
+            }
+        }
+    }
+    _nb_buffer_growths++;
+    return cv::Mat(size, type);
+}
+
+cv::Mat FramePool::acquire() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_free.empty()) {
+        return cv::Mat();
+    }
+    cv::Mat mat = _free.back();
+    _free.pop_back();
+    return mat;
+}
+
+void FramePool::release(cv::Mat mat) {
+    if (mat.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    _free.push_back(mat);
+}
+
+size_t FramePool::size() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _free.size();
+}
+
+PreprocessContext::PreprocessContext(const PreprocessOptions & opt) :
+    _opt(opt)
+{ }
+
+cv::Mat PreprocessContext::decode(const std::string & path, FramePool & pool) {
+    if (not readFile(path)) {
+        return cv::Mat();
+    }
+    return decodeFile(pool);
+}
+
+bool PreprocessContext::readFile(const std::string & path) {
+    std::ifstream is(path, std::ios::binary | std::ios::ate);
+    if (not is) {
+        return false;
+    }
+    std::streamsize file_size = is.tellg();
+    if (file_size <= 0) {
+        return false;
+    }
+    is.seekg(0);
+    if (static_cast<size_t>(file_size) > _file_buffer.capacity()) {
+        _nb_buffer_growths++;
+    }
+    _file_buffer.resize(static_cast<size_t>(file_size));
+    return static_cast<bool>(is.read(reinterpret_cast<char *>(_file_buffer.data()), file_size));
+}
+
+cv::Mat PreprocessContext::decodeFile(FramePool & pool) {
+    cv::Mat mat = pool.acquire();
+    const uchar * old_data = mat.data;
+    cv::imdecode(_file_buffer, cv::IMREAD_GRAYSCALE, &mat);
+    if (not mat.empty() && mat.data != old_data) {
+        _nb_buffer_growths++;
+    }
+    return mat;
+}
+
+uint64_t PreprocessContext::fileHash() const {
+    return fnv1aHash(_file_buffer.data(), _file_buffer.size());
+}
+
+// Returns a continuous `size` image on the front of `storage`. The storage
+// only grows, so frames smaller than the largest one do not allocate.
+cv::Mat PreprocessContext::scratch(cv::Mat & storage, cv::Size size, int type) {
+    const size_t nb_bytes = size.area() * CV_ELEM_SIZE(type);
+    if (storage.empty() || storage.total() * storage.elemSize() < nb_bytes) {
+        storage.create(1, static_cast<int>(nb_bytes), CV_8U);
+        _nb_buffer_growths++;
+    }
+    return cv::Mat(size, type, storage.data);
+}
+
+void PreprocessContext::prepareBuffers(cv::Size input_size) {
+    cv::Size size = input_size;
+    if (_opt.add_border) {
+        size = cv::Size(size.width + TAG_WIDTH, size.height + TAG_HEIGHT);
+        _buffers.bordered = scratch(_bordered_storage, size, CV_8U);
+    }
+    if (_opt.use_hist_eq) {
+        _buffers.equalized = scratch(_equalized_storage, size, CV_8U);
+    }
+    if (_opt.use_thresholding) {
+        _buffers.local_mean = scratch(_local_mean_storage, size, CV_8U);
+        _buffers.local_mean_float = scratch(_local_mean_float_storage, size, CV_32F);
+        if (_opt.use_simd) {
+            _buffers.simd.horizontal = scratch(_horizontal_storage, size, CV_32F);
+        }
+    }
+}
+
+cv::Mat PreprocessContext::process(const cv::Mat & input) {
+    prepareBuffers(input.size());
+    cv::Size output_size = input.size();
+    if (_opt.add_border) {
+        output_size = cv::Size(output_size.width + TAG_WIDTH, output_size.height + TAG_HEIGHT);
+    }
+    cv::Mat output = _outputs.acquire(output_size, input.type());
+    processImage(input, output, _opt, _buffers);
+    return output;
+}
+
+void PreprocessContext::releaseOutput(cv::Mat output) {
+    _outputs.release(output);
+}
+
+static size_t matBytes(const cv::Mat & mat) {
+    return mat.total() * mat.elemSize();
+}
+
+size_t PreprocessContext::scratchBytes() const {
+    return matBytes(_bordered_storage) + matBytes(_equalized_storage) +
+           matBytes(_local_mean_storage) + matBytes(_local_mean_float_storage) +
+           matBytes(_horizontal_storage) + matBytes(_buffers.simd.clahe_extended) +
+           matBytes(_buffers.simd.clahe_luts) + _file_buffer.capacity();
+}
+}
@@ -0,0 +1,190 @@
+
+#include "PreprocessManifest.h"
+
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+#include "utils.h"
+
+namespace deeplocalizer {
+
+namespace io = boost::filesystem;
+using json = nlohmann::json;
+
+const std::string PreprocessManifest::EXTENSION = ".manifest";
+
+bool ManifestEntry::stat() {
+    boost::system::error_code ec;
+    size = io::file_size(input, ec);
+    if (ec) {
+        return false;
+    }
+    mtime = io::last_write_time(input, ec);
+    return not ec;
+}
+
+static std::string hashToString(uint64_t hash) {
+    std::stringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return ss.str();
+}
+
+static uint64_t hashFromString(const std::string & str) {
+    return std::stoull(str, nullptr, 16);
+}
+
+json ManifestEntry::to_json() const {
+    json j;
+    j["input"] = input;
+    j["output"] = output;
+    if (not location.empty()) {
+        j["location"] = location;
+    }
+    j["size"] = size;
+    j["mtime"] = static_cast<long long>(mtime);
+    j["hash"] = hashToString(hash);
+    return j;
+}
+
+ManifestEntry ManifestEntry::from_json(const json & j) {
+    ManifestEntry entry;
+    entry.input = j["input"];
+    entry.output = j["output"];
+    if (j.find("location") != j.end()) {
+        entry.location = j["location"];
+    }
+    entry.size = j["size"];
+    long long mtime = j["mtime"];
+    entry.mtime = static_cast<std::time_t>(mtime);
+    entry.hash = hashFromString(j["hash"].get<std::string>());
+    return entry;
+}
+
+io::path PreprocessManifest::pathFor(const io::path & output_pathfile) {
+    io::path path = output_pathfile;
+    path += EXTENSION;
+    return path;
+}
+
+json PreprocessManifest::optionsToJson(const PreprocessOptions & opt) {
+    json j;
+    j["border"] = opt.add_border;
+    j["hist_eq"] = opt.use_hist_eq;
+    j["threshold"] = opt.use_thresholding;
+    j["binary_image"] = opt.use_binary_image;
+    j["format"] = format_to_str(opt.format);
+    j["compression"] = opt.compression;
+    // only set if enabled, so manifests of runs without them stay valid
+    if (opt.shard_size > 0) {
+        j["shards"] = true;
+    }
+    if (opt.use_simd) {
+        j["simd"] = true;
+    }
+    return j;
+}
+
+PreprocessManifest::PreprocessManifest(const io::path & path,
+                                       const PreprocessOptions & opt, bool reuse) :
+    _path(path), _options(optionsToJson(opt))
+{
+    if (reuse) {
+        _previous = read(_path, _options);
+    }
+    // start a fresh journal with the entries that are still valid
+    compact();
+    _journal.open(_path.string(), std::ios::app);
+}
+
+std::unordered_map<std::string, ManifestEntry> PreprocessManifest::read(
+        const io::path & path, const PreprocessOptions & opt) {
+    return read(path, optionsToJson(opt));
+}
+
+std::unordered_map<std::string, ManifestEntry> PreprocessManifest::read(
+        const io::path & path, const json & options) {
+    std::unordered_map<std::string, ManifestEntry> entries;
+    std::ifstream is(path.string());
+    std::string line;
+    if (not std::getline(is, line)) {
+        return entries;
+    }
+    json header;
+    try {
+        header = json::parse(line);
+        if (not header.is_object() || header.find("options") == header.end()) {
+            throw std::invalid_argument("no options");
+        }
+    } catch(const std::exception &) {
+        std::cerr << "Warning: cannot read the manifest " << path
+                  << ". Reprocessing all images." << std::endl;
+        return entries;
+    }
+    if (header["options"] != options) {
+        std::cout << "Options changed since the last run. Reprocessing all images." << std::endl;
+        return entries;
+    }
+    while(std::getline(is, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        try {
+            auto entry = ManifestEntry::from_json(json::parse(line));
+            entries[entry.input] = entry;
+        } catch(const std::exception &) {
+            // the last line may be cut off by a crash
+            break;
+        }
+    }
+    return entries;
+}
+
+const ManifestEntry * PreprocessManifest::previous(const std::string & input) const {
+    auto it = _previous.find(input);
+    if (it == _previous.end()) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+void PreprocessManifest::writeHeader(std::ostream & os) const {
+    json header;
+    header["options"] = _options;
+    os << header.dump() << '\n';
+}
+
+void PreprocessManifest::add(const ManifestEntry & entry) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _current[entry.input] = entry;
+    _journal << entry.to_json().dump() << std::endl;
+}
+
+void PreprocessManifest::compact() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (not _path.parent_path().empty()) {
+        io::create_directories(_path.parent_path());
+    }
+    io::path tmp_path = io::unique_path(_path.parent_path() / "%%%%%%%%%.manifest");
+    {
+        std::ofstream os(tmp_path.string());
+        writeHeader(os);
+        for(const auto & input_entry : _previous) {
+            if (_current.find(input_entry.first) == _current.end()) {
+                os << input_entry.second.to_json().dump() << '\n';
+            }
+        }
+        for(const auto & input_entry : _current) {
+            os << input_entry.second.to_json().dump() << '\n';
+        }
+    }
+    bool was_open = _journal.is_open();
+    if (was_open) {
+        _journal.close();
+    }
+    io::rename(tmp_path, _path);
+    if (was_open) {
+        _journal.open(_path.string(), std::ios::app);
+    }
+}
+}
@@ -0,0 +1,104 @@
+
+#include "StatusIndex.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <boost/filesystem.hpp>
+#include <json.hpp>
+
+#include "JsonPullParser.h"
+#include "utils.h"
+
+namespace deeplocalizer {
+
+namespace io = boost::filesystem;
+
+ImageStatus ImageStatus::probe(const std::string & desc_path) {
+    ImageStatus status;
+    boost::system::error_code error;
+    const std::time_t mtime = io::last_write_time(desc_path, error);
+    if (not error) {
+        status.has_desc = true;
+        status.desc_mtime = mtime;
+    }
+    return status;
+}
+
+static void parseStatus(JsonPullParser & parser,
+                        std::unordered_map<std::string, ImageStatus> & statuses) {
+    std::string key;
+    std::string filename;
+    ImageStatus status;
+    parser.beginObject();
+    while(parser.nextKey(key)) {
+        if (key == "filename") {
+            filename = parser.string();
+        } else if (key == "has_desc") {
+            status.has_desc = parser.boolean();
+        } else if (key == "nb_tags") {
+            status.nb_tags = parser.integer();
+        } else if (key == "nb_excluded") {
+            status.nb_excluded = parser.integer();
+        } else if (key == "desc_mtime") {
+            status.desc_mtime = static_cast<std::time_t>(parser.integer());
+        } else {
+            parser.skipValue();
+        }
+    }
+    statuses[filename] = status;
+}
+
+std::unordered_map<std::string, ImageStatus> StatusIndex::load(const std::string & path) {
+    std::unordered_map<std::string, ImageStatus> statuses;
+    std::ifstream is(path);
+    if (not is.is_open()) {
+        return statuses;
+    }
+    std::stringstream ss;
+    ss << is.rdbuf();
+    const std::string text = ss.str();
+    try {
+        JsonPullParser parser(text);
+        std::string key;
+        parser.beginObject();
+        while(parser.nextKey(key)) {
+            if (key == "images") {
+                parser.beginArray();
+                while(parser.nextElement()) {
+                    parseStatus(parser, statuses);
+                }
+            } else {
+                parser.skipValue();
+            }
+        }
+        parser.end();
+    } catch(const std::string & msg) {
+        // the index is only a cache, without it every image is looked at
+        std::cerr << "Ignoring the status index " << path << ": " << msg << std::endl;
+        statuses.clear();
+    }
+    return statuses;
+}
+
+void StatusIndex::save(const std::string & path,
+                       const std::vector<std::string> & filenames,
+                       const std::vector<ImageStatus> & statuses) {
+    ASSERT(filenames.size() == statuses.size(),
+           "Got " << filenames.size() << " filenames but " << statuses.size() << " statuses.");
+    nlohmann::json images = nlohmann::json::array();
+    for(size_t i = 0; i < filenames.size(); i++) {
+        nlohmann::json j;
+        j["filename"] = filenames.at(i);
+        j["has_desc"] = statuses.at(i).has_desc;
+        j["nb_tags"] = statuses.at(i).nb_tags;
+        j["nb_excluded"] = statuses.at(i).nb_excluded;
+        j["desc_mtime"] = static_cast<long>(statuses.at(i).desc_mtime);
+        images.push_back(j);
+    }
+    nlohmann::json index;
+    index["images"] = images;
+    safe_serialization(path, std::move(index));
+}
+}
@@ -5,6 +5,9 @@
 #include <mutex>
 #include <boost/optional.hpp>
 
+#include "JsonPullParser.h"
+#include "utils.h"
+
 namespace deeplocalizer {
 
 
@@ -38,6 +41,11 @@ Tag::Tag(cv::Rect boundingBox) :
         _boundingBox(boundingBox),
         _tag_type(IsTag) { }
 
+Tag Tag::fromCenter(cv::Point2i center) {
+    return Tag(cv::Rect(center.x - TAG_WIDTH/2, center.y - TAG_WIDTH/2,
+                        TAG_WIDTH, TAG_HEIGHT));
+}
+
 const cv::Rect & Tag::getBoundingBox() const {
     return _boundingBox;
 }
@@ -62,9 +70,18 @@ void Tag::toggleIsTag() {
     }
 }
 
+const boost::optional<TagEllipse> & Tag::ellipse() const {
+    return _ellipse;
+}
+
+void Tag::setEllipse(boost::optional<TagEllipse> ellipse) {
+    _ellipse = ellipse;
+}
+
 bool Tag::operator==(const Tag &other) const {
     return _boundingBox == other._boundingBox &&
-            _tag_type == other._tag_type;
+            _tag_type == other._tag_type &&
+            _ellipse == other._ellipse;
 }
 
 
@@ -114,7 +131,8 @@ std::string tagtype_to_string(TagType tagType) {
         case TagType::IsTag:
             return "istag";
         default:
-            throw "unknown tag type";
+            ASSERT(false, "unknown tag type " << static_cast<int>(tagType));
+            return "";
     }
 }
 
@@ -127,9 +145,58 @@ TagType tagtype_from_string(const std::string & str) {
         return TagType::Exclude;
     } else if (str == "istag") {
         return TagType::IsTag;
-    } else {
-        throw "unknown tag type";
     }
+    ASSERT(false, "unknown tag type " << str);
+    return TagType::NoTag;
+}
+
+bool TagEllipse::operator==(const TagEllipse & other) const {
+    return vote == other.vote && center == other.center &&
+            axis == other.axis && angle == other.angle;
+}
+
+json TagEllipse::to_json() const {
+    json j;
+    j["vote"] = vote;
+    j["center_x"] = center.x;
+    j["center_y"] = center.y;
+    j["axis_width"] = axis.width;
+    j["axis_height"] = axis.height;
+    j["angle"] = angle;
+    return j;
+}
+
+TagEllipse TagEllipse::from_json(const json & j) {
+    TagEllipse ellipse;
+    ellipse.vote = j["vote"];
+    ellipse.center = cv::Point2i(j["center_x"], j["center_y"]);
+    ellipse.axis = cv::Size(j["axis_width"], j["axis_height"]);
+    ellipse.angle = j["angle"];
+    return ellipse;
+}
+
+TagEllipse TagEllipse::parse(JsonPullParser & parser) {
+    TagEllipse ellipse{};
+    std::string key;
+    parser.beginObject();
+    while(parser.nextKey(key)) {
+        if (key == "vote") {
+            ellipse.vote = static_cast<int>(parser.integer());
+        } else if (key == "center_x") {
+            ellipse.center.x = static_cast<int>(parser.integer());
+        } else if (key == "center_y") {
+            ellipse.center.y = static_cast<int>(parser.integer());
+        } else if (key == "axis_width") {
+            ellipse.axis.width = static_cast<int>(parser.integer());
+        } else if (key == "axis_height") {
+            ellipse.axis.height = static_cast<int>(parser.integer());
+        } else if (key == "angle") {
+            ellipse.angle = parser.number();
+        } else {
+            parser.skipValue();
+        }
+    }
+    return ellipse;
 }
 
 json Tag::to_json() const {
@@ -137,17 +204,49 @@ json Tag::to_json() const {
     jtag["x"] = this->center().x;
     jtag["y"] = this->center().y;
     jtag["tagtype"] = tagtype_to_string(_tag_type);
+    if (_ellipse) {
+        jtag["ellipse"] = _ellipse->to_json();
+    }
     return jtag;
 }
 
 Tag Tag::from_json(const json &j) {
-    cv::Point2i center(j["x"], j["y"]);
-    cv::Rect boundingBox(center.x - TAG_WIDTH/2, center.y - TAG_WIDTH/2,
-                           TAG_WIDTH, TAG_HEIGHT);
-    Tag tag(boundingBox);
+    Tag tag = Tag::fromCenter(cv::Point2i(j["x"], j["y"]));
     tag.setType(tagtype_from_string(j["tagtype"]));
+    if (j.find("ellipse") != j.end()) {
+        tag.setEllipse(TagEllipse::from_json(j["ellipse"]));
+    }
     return tag;
 }
-}
-
 
+Tag Tag::parse(JsonPullParser & parser) {
+    cv::Point2i center;
+    bool has_x = false, has_y = false, has_tagtype = false;
+    std::string tagtype;
+    boost::optional<TagEllipse> ellipse;
+    std::string key;
+    parser.beginObject();
+    while(parser.nextKey(key)) {
+        if (key == "x") {
+            center.x = static_cast<int>(parser.integer());
+            has_x = true;
+        } else if (key == "y") {
+            center.y = static_cast<int>(parser.integer());
+            has_y = true;
+        } else if (key == "tagtype") {
+            tagtype = parser.string();
+            has_tagtype = true;
+        } else if (key == "ellipse") {
+            ellipse = TagEllipse::parse(parser);
+        } else {
+            parser.skipValue();
+        }
+    }
+    ASSERT(has_x && has_y, "Tag without position.");
+    ASSERT(has_tagtype, "Tag without type.");
+    Tag tag = Tag::fromCenter(center);
+    tag.setType(tagtype_from_string(tagtype));
+    tag.setEllipse(ellipse);
+    return tag;
+}
+}
@@ -0,0 +1,178 @@
+
+#include "TagGrid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+#include "utils.h"
+
+namespace deeplocalizer {
+
+static cv::Point2i boxCenter(const cv::Rect & box) {
+    return cv::Point2i(box.x + box.width / 2, box.y + box.height / 2);
+}
+
+static int64_t squaredDistance(cv::Point2i a, cv::Point2i b) {
+    const int64_t dx = a.x - b.x;
+    const int64_t dy = a.y - b.y;
+    return dx * dx + dy * dy;
+}
+
+// rounds towards negative infinity, also for negative coordinates
+static int floorDiv(int a, int b) {
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+TagGrid::TagGrid(int cell_size) : _cell_size(cell_size) {
+    ASSERT(cell_size > 0, "The cell size must be positive, got " << cell_size);
+}
+
+cv::Point2i TagGrid::cellOf(cv::Point2i point) const {
+    return cv::Point2i(floorDiv(point.x, _cell_size), floorDiv(point.y, _cell_size));
+}
+
+uint64_t TagGrid::cellKey(cv::Point2i cell) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(cell.x)) << 32) |
+            static_cast<uint32_t>(cell.y);
+}
+
+void TagGrid::insert(size_t key, const cv::Rect & box) {
+    erase(key);
+    const cv::Point2i center = boxCenter(box);
+    _max_extent = std::max({_max_extent,
+                            center.x - box.x, box.x + box.width - center.x,
+                            center.y - box.y, box.y + box.height - center.y});
+    _cells[cellKey(cellOf(center))].push_back(Entry{key, box});
+    _centers[key] = center;
+}
+
+bool TagGrid::erase(size_t key) {
+    auto it = _centers.find(key);
+    if (it == _centers.end()) {
+        return false;
+    }
+    auto cell = _cells.find(cellKey(cellOf(it->second)));
+    auto & entries = cell->second;
+    auto entry = std::find_if(entries.begin(), entries.end(),
+                              [key](const Entry & e) { return e.key == key; });
+    *entry = entries.back();
+    entries.pop_back();
+    if (entries.empty()) {
+        _cells.erase(cell);
+    }
+    _centers.erase(it);
+    return true;
+}
+
+void TagGrid::clear() {
+    _cells.clear();
+    _centers.clear();
+    _max_extent = 0;
+}
+
+template<typename Fn>
+void TagGrid::forEachEntry(const cv::Rect & area, Fn fn) const {
+    const cv::Point2i first = cellOf(area.tl());
+    const cv::Point2i last = cellOf(area.br());
+    const int64_t nb_cells = static_cast<int64_t>(last.x - first.x + 1) * (last.y - first.y + 1);
+    if (nb_cells > static_cast<int64_t>(_cells.size())) {
+        // cheaper to look at every occupied cell
+        for(const auto & pair : _cells) {
+            for(const auto & entry : pair.second) {
+                fn(entry);
+            }
+        }
+        return;
+    }
+    for(int y = first.y; y <= last.y; y++) {
+        for(int x = first.x; x <= last.x; x++) {
+            auto cell = _cells.find(cellKey(cv::Point2i(x, y)));
+            if (cell == _cells.end()) {
+                continue;
+            }
+            for(const auto & entry : cell->second) {
+                fn(entry);
+            }
+        }
+    }
+}
+
+boost::optional<size_t> TagGrid::at(cv::Point2i point) const {
+    const cv::Rect area(point.x - _max_extent, point.y - _max_extent,
+                        2 * _max_extent + 1, 2 * _max_extent + 1);
+    boost::optional<size_t> closest;
+    int64_t closest_distance = std::numeric_limits<int64_t>::max();
+    forEachEntry(area, [&](const Entry & entry) {
+        if (not entry.box.contains(point)) {
+            return;
+        }
+        const int64_t distance = squaredDistance(point, boxCenter(entry.box));
+        if (distance < closest_distance) {
+            closest_distance = distance;
+            closest = entry.key;
+        }
+    });
+    return closest;
+}
+
+std::vector<size_t> TagGrid::intersecting(const cv::Rect & rect) const {
+    std::vector<size_t> keys;
+    if (rect.area() <= 0) {
+        return keys;
+    }
+    const cv::Rect area(rect.x - _max_extent, rect.y - _max_extent,
+                        rect.width + 2 * _max_extent, rect.height + 2 * _max_extent);
+    forEachEntry(area, [&](const Entry & entry) {
+        if ((entry.box & rect).area() > 0) {
+            keys.push_back(entry.key);
+        }
+    });
+    return keys;
+}
+
+std::vector<size_t> TagGrid::within(cv::Point2i center, double radius) const {
+    std::vector<size_t> keys;
+    if (radius < 0) {
+        return keys;
+    }
+    const int r = static_cast<int>(std::ceil(radius));
+    const cv::Rect area(center.x - r, center.y - r, 2 * r + 1, 2 * r + 1);
+    forEachEntry(area, [&](const Entry & entry) {
+        if (squaredDistance(center, boxCenter(entry.box)) <= radius * radius) {
+            keys.push_back(entry.key);
+        }
+    });
+    return keys;
+}
+
+std::vector<Tag> mergeNearDuplicates(const std::vector<Tag> & tags, double distance) {
+    auto vote = [&](size_t i) {
+        const auto & ellipse = tags.at(i).ellipse();
+        return ellipse ? static_cast<int64_t>(ellipse->vote) : std::numeric_limits<int64_t>::min();
+    };
+    std::vector<size_t> order(tags.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return vote(a) > vote(b);
+    });
+    // a tag is kept unless a better one was already kept nearby
+    TagGrid kept(std::max(1, static_cast<int>(std::ceil(distance))));
+    std::vector<bool> keep(tags.size(), false);
+    for(size_t i : order) {
+        if (kept.within(tags.at(i).center(), distance).empty()) {
+            kept.insert(i, tags.at(i).getBoundingBox());
+            keep.at(i) = true;
+        }
+    }
+    std::vector<Tag> merged;
+    merged.reserve(kept.size());
+    for(size_t i = 0; i < tags.size(); i++) {
+        if (keep.at(i)) {
+            merged.push_back(tags.at(i));
+        }
+    }
+    return merged;
+}
+}
@@ -0,0 +1,265 @@
+
+#include "TagStore.h"
+
+#include <cstring>
+#include <fstream>
+
+#include "utils.h"
+
+namespace deeplocalizer {
+
+namespace io = boost::filesystem;
+namespace ipc = boost::interprocess;
+
+const std::string TagStore::EXTENSION = ".tags";
+
+static const char MAGIC[] = "BBTAGS";
+static const size_t MAGIC_SIZE = 6;
+static const uint16_t VERSION = 1;
+static const size_t HEADER_SIZE = MAGIC_SIZE + sizeof(uint16_t) + 2 * sizeof(uint64_t);
+static const size_t INDEX_ENTRY_SIZE = sizeof(uint64_t) + sizeof(uint32_t);
+// set in the type byte of tags with an ellipse
+static const uint8_t HAS_ELLIPSE = 0x80;
+
+static void putFixed(std::string & out, uint64_t value, size_t nb_bytes) {
+    for(size_t i = 0; i < nb_bytes; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+static uint64_t getFixed(const unsigned char * data, size_t nb_bytes) {
+    uint64_t value = 0;
+    for(size_t i = 0; i < nb_bytes; i++) {
+        value |= static_cast<uint64_t>(data[i]) << (8 * i);
+    }
+    return value;
+}
+
+static void putVarint(std::string & out, uint64_t value) {
+    while(value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+static void putSigned(std::string & out, int64_t value) {
+    putVarint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+// Reads the fields of a record and checks that it does not run past its end.
+class RecordReader {
+public:
+    RecordReader(const unsigned char * data, size_t size) :
+        _pos(data), _end(data + size) {}
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for(int shift = 0; shift < 64; shift += 7) {
+            ASSERT(_pos < _end, "Tag store record is truncated.");
+            const uint8_t byte = *_pos++;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                return value;
+            }
+        }
+        ASSERT(false, "Tag store record has a malformed varint.");
+        return 0;
+    }
+    int64_t signedVarint() {
+        const uint64_t value = varint();
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+    const unsigned char * bytes(size_t n) {
+        ASSERT(static_cast<size_t>(_end - _pos) >= n, "Tag store record is truncated.");
+        const unsigned char * begin = _pos;
+        _pos += n;
+        return begin;
+    }
+private:
+    const unsigned char * _pos;
+    const unsigned char * const _end;
+};
+
+static std::string encodeRecord(const ImageDesc & desc) {
+    std::string out;
+    putVarint(out, desc.filename.size());
+    out += desc.filename;
+    const auto & tags = desc.getTags();
+    putVarint(out, tags.size());
+    cv::Point2i previous(0, 0);
+    for(const auto & tag : tags) {
+        const cv::Point2i center = tag.center();
+        putSigned(out, center.x - previous.x);
+        putSigned(out, center.y - previous.y);
+        previous = center;
+        const auto & ellipse = tag.ellipse();
+        out.push_back(static_cast<char>(static_cast<uint8_t>(tag.type()) | (ellipse ? HAS_ELLIPSE : 0)));
+        if (ellipse) {
+            putSigned(out, ellipse->vote);
+            putSigned(out, ellipse->center.x);
+            putSigned(out, ellipse->center.y);
+            putSigned(out, ellipse->axis.width);
+            putSigned(out, ellipse->axis.height);
+            uint64_t angle_bits;
+            std::memcpy(&angle_bits, &ellipse->angle, sizeof(angle_bits));
+            putFixed(out, angle_bits, sizeof(angle_bits));
+        }
+    }
+    return out;
+}
+
+static ImageDesc decodeRecord(const unsigned char * data, size_t size) {
+    RecordReader reader(data, size);
+    const size_t filename_size = reader.varint();
+    const unsigned char * filename = reader.bytes(filename_size);
+    const size_t nb_tags = reader.varint();
+    std::vector<Tag> tags;
+    tags.reserve(nb_tags);
+    cv::Point2i center(0, 0);
+    for(size_t i = 0; i < nb_tags; i++) {
+        center.x += static_cast<int>(reader.signedVarint());
+        center.y += static_cast<int>(reader.signedVarint());
+        Tag tag = Tag::fromCenter(center);
+        const uint8_t type = *reader.bytes(1);
+        const uint8_t tag_type = type & ~HAS_ELLIPSE;
+        ASSERT(tag_type <= TagType::BeeWithoutTag,
+               "Tag store record has an unknown tag type " << static_cast<int>(tag_type) << ".");
+        tag.setType(static_cast<TagType>(tag_type));
+        if (type & HAS_ELLIPSE) {
+            TagEllipse ellipse;
+            ellipse.vote = static_cast<int>(reader.signedVarint());
+            ellipse.center.x = static_cast<int>(reader.signedVarint());
+            ellipse.center.y = static_cast<int>(reader.signedVarint());
+            ellipse.axis.width = static_cast<int>(reader.signedVarint());
+            ellipse.axis.height = static_cast<int>(reader.signedVarint());
+            const uint64_t angle_bits = getFixed(reader.bytes(sizeof(uint64_t)), sizeof(uint64_t));
+            std::memcpy(&ellipse.angle, &angle_bits, sizeof(angle_bits));
+            tag.setEllipse(ellipse);
+        }
+        tags.push_back(std::move(tag));
+    }
+    return ImageDesc(std::string(reinterpret_cast<const char *>(filename), filename_size), tags);
+}
+
+TagStore::TagStore(const io::path & path) {
+    ASSERT(io::exists(path), "Tag store " << path << " does not exists.");
+    _size = io::file_size(path);
+    ASSERT(_size >= HEADER_SIZE, "Tag store " << path << " is too small.");
+    _file = ipc::file_mapping(path.string().c_str(), ipc::read_only);
+    _region = ipc::mapped_region(_file, ipc::read_only);
+    _data = static_cast<const unsigned char *>(_region.get_address());
+    ASSERT(std::memcmp(_data, MAGIC, MAGIC_SIZE) == 0, path << " is not a tag store.");
+    const uint16_t version = static_cast<uint16_t>(getFixed(_data + MAGIC_SIZE, sizeof(uint16_t)));
+    ASSERT(version == VERSION, "Unsupported tag store version " << version << " of " << path);
+    _nb_images = getFixed(_data + MAGIC_SIZE + sizeof(uint16_t), sizeof(uint64_t));
+    const uint64_t index_offset = getFixed(_data + MAGIC_SIZE + sizeof(uint16_t) + sizeof(uint64_t),
+                                           sizeof(uint64_t));
+    ASSERT(index_offset <= _size && (_size - index_offset) / INDEX_ENTRY_SIZE >= _nb_images,
+           "The index of tag store " << path << " is truncated.");
+    _index = _data + index_offset;
+}
+
+std::pair<const unsigned char *, size_t> TagStore::record(size_t i) const {
+    ASSERT(i < _nb_images, "Image " << i << " is not in the tag store.");
+    const unsigned char * entry = _index + i * INDEX_ENTRY_SIZE;
+    const uint64_t offset = getFixed(entry, sizeof(uint64_t));
+    const uint64_t size = getFixed(entry + sizeof(uint64_t), sizeof(uint32_t));
+    ASSERT(offset >= HEADER_SIZE && offset + size <= _size, "Tag store record " << i << " is out of bounds.");
+    return std::make_pair(_data + offset, static_cast<size_t>(size));
+}
+
+std::string TagStore::filename(size_t i) const {
+    auto data = record(i);
+    RecordReader reader(data.first, data.second);
+    const size_t filename_size = reader.varint();
+    return std::string(reinterpret_cast<const char *>(reader.bytes(filename_size)), filename_size);
+}
+
+ImageDesc TagStore::at(size_t i) const {
+    auto data = record(i);
+    return decodeRecord(data.first, data.second);
+}
+
+boost::optional<size_t> TagStore::indexOf(const std::string & filename) const {
+    size_t begin = 0;
+    size_t end = _nb_images;
+    while(begin < end) {
+        const size_t middle = begin + (end - begin) / 2;
+        const int cmp = this->filename(middle).compare(filename);
+        if (cmp == 0) {
+            return middle;
+        } else if (cmp < 0) {
+            begin = middle + 1;
+        } else {
+            end = middle;
+        }
+    }
+    return boost::none;
+}
+
+boost::optional<ImageDesc> TagStore::find(const std::string & filename) const {
+    auto i = indexOf(filename);
+    if (not i) {
+        return boost::none;
+    }
+    return at(*i);
+}
+
+bool TagStore::contains(const std::string & filename) const {
+    return static_cast<bool>(indexOf(filename));
+}
+
+TagStoreWriter::TagStoreWriter(const io::path & path) : _path(path) {
+    if (not io::exists(_path)) {
+        return;
+    }
+    TagStore store(_path);
+    for(size_t i = 0; i < store.size(); i++) {
+        auto data = store.record(i);
+        _records[store.filename(i)] = std::string(reinterpret_cast<const char *>(data.first), data.second);
+    }
+}
+
+void TagStoreWriter::add(const ImageDesc & desc) {
+    std::string record = encodeRecord(desc);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _records[desc.filename] = std::move(record);
+}
+
+size_t TagStoreWriter::size() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _records.size();
+}
+
+void TagStoreWriter::save() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::string header(MAGIC, MAGIC_SIZE);
+    putFixed(header, VERSION, sizeof(uint16_t));
+    putFixed(header, _records.size(), sizeof(uint64_t));
+    std::string index;
+    uint64_t offset = HEADER_SIZE;
+    for(const auto & pair : _records) {
+        const std::string & record = pair.second;
+        putFixed(index, offset, sizeof(uint64_t));
+        putFixed(index, record.size(), sizeof(uint32_t));
+        offset += record.size();
+    }
+    putFixed(header, offset, sizeof(uint64_t));
+
+    if (not _path.parent_path().empty()) {
+        io::create_directories(_path.parent_path());
+    }
+    io::path tmp_path = io::unique_path(_path.parent_path() / "%%%%%%%%%.tags");
+    {
+        std::ofstream os(tmp_path.string(), std::ios::binary);
+        os.write(header.data(), header.size());
+        for(const auto & pair : _records) {
+            os.write(pair.second.data(), pair.second.size());
+        }
+        os.write(index.data(), index.size());
+        ASSERT(os.good(), "Cannot write tag store " << tmp_path);
+    }
+    io::rename(tmp_path, _path);
+}
+}
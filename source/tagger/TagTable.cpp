@@ -0,0 +1,253 @@
+
+#include "TagTable.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "TagStore.h"
+#include "utils.h"
+
+namespace deeplocalizer {
+
+const int32_t TagTable::NO_VOTE = std::numeric_limits<int32_t>::min();
+const uint32_t TagTable::NO_ELLIPSE = std::numeric_limits<uint32_t>::max();
+
+size_t TagView::image() const {
+    return _table->imageOf(_index);
+}
+
+cv::Point2i TagView::center() const {
+    return cv::Point2i(_table->_x.at(_index), _table->_y.at(_index));
+}
+
+cv::Rect TagView::getBoundingBox() const {
+    return Tag::fromCenter(center()).getBoundingBox();
+}
+
+TagType TagView::type() const {
+    return static_cast<TagType>(_table->_type.at(_index));
+}
+
+boost::optional<TagEllipse> TagView::ellipse() const {
+    const uint32_t ellipse = _table->_ellipse.at(_index);
+    if (ellipse == TagTable::NO_ELLIPSE) {
+        return boost::none;
+    }
+    return _table->_ellipses.at(ellipse);
+}
+
+Tag TagView::toTag() const {
+    Tag tag = Tag::fromCenter(center());
+    tag.setType(type());
+    tag.setEllipse(ellipse());
+    return tag;
+}
+
+TagTable TagTable::fromStore(const TagStore & store) {
+    TagTable table;
+    for(size_t i = 0; i < store.size(); i++) {
+        table.add(store.at(i));
+    }
+    table.shrinkToFit();
+    return table;
+}
+
+static void checkInt16(int value, const std::string & filename) {
+    ASSERT(value >= std::numeric_limits<int16_t>::min() &&
+           value <= std::numeric_limits<int16_t>::max(),
+           "Tag coordinate " << value << " of " << filename << " does not fit into 16 bits.");
+}
+
+uint32_t TagTable::internDirectory(const std::string & dir) {
+    auto it = _dir_ids.find(dir);
+    if (it != _dir_ids.end()) {
+        return it->second;
+    }
+    const uint32_t id = static_cast<uint32_t>(_dirs.size());
+    _dirs.push_back(dir);
+    _dir_ids.emplace(dir, id);
+    return id;
+}
+
+void TagTable::add(const ImageDesc & desc) {
+    const auto & tags = desc.getTags();
+    ASSERT(size() + tags.size() < std::numeric_limits<uint32_t>::max(),
+           "A TagTable cannot hold more than 2^32 tags.");
+    // check all tags first, so a failed add leaves the table unchanged
+    for(const auto & tag : tags) {
+        checkInt16(tag.center().x, desc.filename);
+        checkInt16(tag.center().y, desc.filename);
+    }
+    for(const auto & tag : tags) {
+        const cv::Point2i center = tag.center();
+        _x.push_back(static_cast<int16_t>(center.x));
+        _y.push_back(static_cast<int16_t>(center.y));
+        _type.push_back(static_cast<uint8_t>(tag.type()));
+        const auto & ellipse = tag.ellipse();
+        if (ellipse) {
+            _vote.push_back(ellipse->vote);
+            _ellipse.push_back(static_cast<uint32_t>(_ellipses.size()));
+            _ellipses.push_back(*ellipse);
+        } else {
+            _vote.push_back(NO_VOTE);
+            _ellipse.push_back(NO_ELLIPSE);
+        }
+    }
+    _tags_begin.push_back(static_cast<uint32_t>(size()));
+
+    // the directory keeps its trailing slash, so filename() is a concatenation
+    const size_t slash = desc.filename.rfind('/');
+    const size_t basename_begin = slash == std::string::npos ? 0 : slash + 1;
+    _dir.push_back(internDirectory(desc.filename.substr(0, basename_begin)));
+    _names.append(desc.filename, basename_begin, std::string::npos);
+    _name_begin.push_back(_names.size());
+}
+
+void TagTable::reserve(size_t nb_images, size_t nb_tags) {
+    _x.reserve(nb_tags);
+    _y.reserve(nb_tags);
+    _type.reserve(nb_tags);
+    _vote.reserve(nb_tags);
+    _ellipse.reserve(nb_tags);
+    _tags_begin.reserve(nb_images + 1);
+    _name_begin.reserve(nb_images + 1);
+    _dir.reserve(nb_images);
+}
+
+void TagTable::shrinkToFit() {
+    _x.shrink_to_fit();
+    _y.shrink_to_fit();
+    _type.shrink_to_fit();
+    _vote.shrink_to_fit();
+    _ellipse.shrink_to_fit();
+    _ellipses.shrink_to_fit();
+    _tags_begin.shrink_to_fit();
+    _names.shrink_to_fit();
+    _name_begin.shrink_to_fit();
+    _dir.shrink_to_fit();
+}
+
+std::string TagTable::filename(size_t image) const {
+    ASSERT(image < nbImages(), "Image " << image << " is not in the TagTable.");
+    const uint64_t begin = _name_begin[image];
+    return _dirs[_dir[image]] + _names.substr(begin, _name_begin[image + 1] - begin);
+}
+
+std::pair<size_t, size_t> TagTable::tagsOf(size_t image) const {
+    ASSERT(image < nbImages(), "Image " << image << " is not in the TagTable.");
+    return std::make_pair(_tags_begin[image], _tags_begin[image + 1]);
+}
+
+size_t TagTable::imageOf(size_t i) const {
+    ASSERT(i < size(), "Tag " << i << " is not in the TagTable.");
+    // the first image that starts after tag i is the one after its image
+    auto it = std::upper_bound(_tags_begin.cbegin(), _tags_begin.cend(), static_cast<uint32_t>(i));
+    return static_cast<size_t>(it - _tags_begin.cbegin()) - 1;
+}
+
+ImageDesc TagTable::imageDesc(size_t image) const {
+    auto range = tagsOf(image);
+    std::vector<Tag> tags;
+    tags.reserve(range.second - range.first);
+    for(size_t i = range.first; i < range.second; i++) {
+        tags.push_back(tag(i).toTag());
+    }
+    return ImageDesc(filename(image), std::move(tags));
+}
+
+// Tags are filtered in blocks of this many tags. The mask of a block fits
+// into a few cache lines.
+static const size_t SELECT_BLOCK_SIZE = 256;
+
+// Writes `keep(begin + j)` as 0 or 1 to `mask[j]` and returns the number of
+// ones. Both loops have no branch and are vectorized if `keep` reads a column.
+template<typename Predicate>
+static size_t maskBlock(size_t begin, size_t len, Predicate keep, uint8_t * mask) {
+    for(size_t j = 0; j < len; j++) {
+        mask[j] = keep(begin + j) ? 1 : 0;
+    }
+    size_t count = 0;
+    for(size_t j = 0; j < len; j++) {
+        count += mask[j];
+    }
+    return count;
+}
+
+// `index(i)` of every `i` in [0, n) for which `keep(i)` is true. Blocks
+// without a match are skipped and blocks that match completely are copied,
+// so only the mixed blocks are compacted one index at a time.
+template<typename Predicate, typename Index>
+static std::vector<uint32_t> select(size_t n, Predicate keep, Index index) {
+    std::vector<uint32_t> selected;
+    uint8_t mask[SELECT_BLOCK_SIZE];
+    uint32_t compacted[SELECT_BLOCK_SIZE];
+    for(size_t begin = 0; begin < n; begin += SELECT_BLOCK_SIZE) {
+        const size_t len = std::min(SELECT_BLOCK_SIZE, n - begin);
+        const size_t count = maskBlock(begin, len, keep, mask);
+        if (count == 0) {
+            continue;
+        }
+        const size_t nb_selected = selected.size();
+        selected.resize(nb_selected + count);
+        uint32_t * out = selected.data() + nb_selected;
+        if (count == len) {
+            for(size_t j = 0; j < len; j++) {
+                out[j] = index(begin + j);
+            }
+            continue;
+        }
+        // writes every index and advances only where the mask is set, so
+        // it may write past `count` and goes to a buffer of a whole block
+        size_t k = 0;
+        for(size_t j = 0; j < len; j++) {
+            compacted[k] = index(begin + j);
+            k += mask[j];
+        }
+        std::copy(compacted, compacted + count, out);
+    }
+    return selected;
+}
+
+static uint32_t identity(size_t i) {
+    return static_cast<uint32_t>(i);
+}
+
+std::vector<uint32_t> TagTable::withType(TagType type) const {
+    const uint8_t * types = _type.data();
+    const uint8_t wanted = static_cast<uint8_t>(type);
+    return select(size(), [&](size_t i) { return types[i] == wanted; }, identity);
+}
+
+std::vector<uint32_t> TagTable::withVote(int32_t min_vote) const {
+    const int32_t * votes = _vote.data();
+    // NO_VOTE is below every vote, but not below min_vote == NO_VOTE
+    const int32_t threshold = std::max(min_vote, NO_VOTE + 1);
+    return select(size(), [&](size_t i) { return votes[i] >= threshold; }, identity);
+}
+
+std::vector<uint32_t> TagTable::withType(const std::vector<uint32_t> & indices, TagType type) const {
+    const uint8_t * types = _type.data();
+    const uint32_t * from = indices.data();
+    const uint8_t wanted = static_cast<uint8_t>(type);
+    // the mask pass gathers bytes, which is not vectorized
+    return select(indices.size(), [&](size_t i) { return types[from[i]] == wanted; },
+                  [&](size_t i) { return from[i]; });
+}
+
+size_t TagTable::memoryUsage() const {
+    size_t bytes = _x.capacity() * sizeof(int16_t) +
+            _y.capacity() * sizeof(int16_t) +
+            _type.capacity() * sizeof(uint8_t) +
+            _vote.capacity() * sizeof(int32_t) +
+            _ellipse.capacity() * sizeof(uint32_t) +
+            _ellipses.capacity() * sizeof(TagEllipse) +
+            _tags_begin.capacity() * sizeof(uint32_t) +
+            _names.capacity() +
+            _name_begin.capacity() * sizeof(uint64_t) +
+            _dir.capacity() * sizeof(uint32_t);
+    for(const auto & dir : _dirs) {
+        bytes += 2 * (sizeof(std::string) + dir.capacity());
+    }
+    return bytes;
+}
+}
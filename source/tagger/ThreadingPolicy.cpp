@@ -0,0 +1,213 @@
+
+#include "ThreadingPolicy.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <boost/filesystem.hpp>
+#include <opencv2/core/core.hpp>
+
+#include "parallel.h"
+#include "utils.h"
+
+namespace deeplocalizer {
+
+namespace io = boost::filesystem;
+
+std::string parallelism_to_str(Parallelism parallelism) {
+    switch(parallelism) {
+        case Parallelism::Frames: return "frames";
+        case Parallelism::IntraFrame: return "intra-frame";
+        case Parallelism::Auto: return "auto";
+    }
+    return "wrong";
+}
+
+Parallelism parallelism_from_str(const std::string & str) {
+    for(auto parallelism : {Parallelism::Frames, Parallelism::IntraFrame, Parallelism::Auto}) {
+        if (str == parallelism_to_str(parallelism)) {
+            return parallelism;
+        }
+    }
+    ASSERT(false, "Expected `frames`, `intra-frame` or `auto` parallelism. But got: " << str);
+    return Parallelism::Frames;
+}
+
+// Parses a kernel cpu list like "0-3,8,10-11".
+static std::vector<int> parseCpuList(const std::string & list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while(std::getline(ss, range, ',')) {
+        if (range.empty() || range == "\n") {
+            continue;
+        }
+        int first = 0, last = 0;
+        char dash = 0;
+        std::stringstream rs(range);
+        rs >> first;
+        if (rs >> dash >> last) {
+            for(int cpu = first; cpu <= last; cpu++) {
+                cpus.push_back(cpu);
+            }
+        } else {
+            cpus.push_back(first);
+        }
+    }
+    return cpus;
+}
+
+static std::set<int> allowedCpus() {
+    std::set<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.insert(cpu);
+            }
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        for(size_t cpu = 0; cpu < defaultNumberOfThreads(); cpu++) {
+            cpus.insert(static_cast<int>(cpu));
+        }
+    }
+    return cpus;
+}
+
+// The ids of the NUMA nodes in /sys, sorted. Node ids need not be
+// contiguous, e.g. with memory-only nodes or sub-NUMA clustering.
+static std::vector<int> numaNodeIds(const io::path & node_dir) {
+    std::vector<int> ids;
+    boost::system::error_code error;
+    for(io::directory_iterator it(node_dir, error); not error && it != io::directory_iterator();
+            it.increment(error)) {
+        const std::string name = it->path().filename().string();
+        if (name.size() <= 4 || name.compare(0, 4, "node") != 0 ||
+                not std::all_of(name.begin() + 4, name.end(), ::isdigit)) {
+            continue;
+        }
+        ids.push_back(std::stoi(name.substr(4)));
+    }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+std::vector<std::vector<int>> cpusByNumaNode() {
+    const std::set<int> allowed = allowedCpus();
+    std::vector<std::vector<int>> nodes;
+    const io::path node_dir("/sys/devices/system/node");
+    for(int node : numaNodeIds(node_dir)) {
+        io::path cpulist = node_dir / ("node" + std::to_string(node)) / "cpulist";
+        std::ifstream is(cpulist.string());
+        std::string list;
+        std::getline(is, list);
+        std::vector<int> cpus;
+        for(int cpu : parseCpuList(list)) {
+            if (allowed.count(cpu)) {
+                cpus.push_back(cpu);
+            }
+        }
+        if (not cpus.empty()) {
+            nodes.push_back(cpus);
+        }
+    }
+    if (nodes.empty()) {
+        nodes.emplace_back(allowed.begin(), allowed.end());
+    }
+    return nodes;
+}
+
+ThreadingPolicy::ThreadingPolicy(Parallelism parallelism, bool pin_threads) :
+    _parallelism(parallelism), _pin_threads(pin_threads)
+{
+    ASSERT(parallelism != Parallelism::Auto,
+           "Resolve the `auto` parallelism before creating a threading policy.");
+    const auto nodes = cpusByNumaNode();
+    size_t max_node_size = 0;
+    for(const auto & node : nodes) {
+        max_node_size = std::max(max_node_size, node.size());
+    }
+    for(size_t i = 0; i < max_node_size; i++) {
+        for(const auto & node : nodes) {
+            if (i < node.size()) {
+                _cpus.push_back(node.at(i));
+            }
+        }
+    }
+}
+
+size_t ThreadingPolicy::frameThreads(size_t requested) const {
+    if (requested > 0) {
+        return requested;
+    }
+    if (_parallelism == Parallelism::IntraFrame) {
+        return 1;
+    }
+    return nbCores();
+}
+
+size_t ThreadingPolicy::workerThreads(size_t requested) const {
+    if (requested > 0) {
+        return requested;
+    }
+    return std::max<size_t>(nbCores(), 1);
+}
+
+int ThreadingPolicy::opencvThreads() const {
+    if (_parallelism == Parallelism::IntraFrame) {
+        return static_cast<int>(nbCores());
+    }
+    return 1;
+}
+
+void ThreadingPolicy::apply() const {
+    // 0 runs OpenCV's functions sequentially without a thread pool
+    const int nb_threads = opencvThreads();
+    cv::setNumThreads(nb_threads > 1 ? nb_threads : 0);
+}
+
+bool ThreadingPolicy::pinWorker(size_t worker_idx) const {
+    if (not _pin_threads || _cpus.empty()) {
+        return false;
+    }
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(_cpus.at(worker_idx % _cpus.size()), &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void) worker_idx;
+    return false;
+#endif
+}
+
+static std::mutex process_policy_mutex;
+
+static ThreadingPolicy & processPolicyStorage() {
+    static ThreadingPolicy policy;
+    return policy;
+}
+
+ThreadingPolicy processPolicy() {
+    std::lock_guard<std::mutex> lock(process_policy_mutex);
+    return processPolicyStorage();
+}
+
+void setProcessPolicy(const ThreadingPolicy & policy) {
+    std::lock_guard<std::mutex> lock(process_policy_mutex);
+    processPolicyStorage() = policy;
+    policy.apply();
+}
+}
@@ -0,0 +1,103 @@
+
+#include "ThumbnailStore.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#include <opencv2/core/version.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "ImageShard.h"
+#include "utils.h"
+
+namespace deeplocalizer {
+
+namespace io = boost::filesystem;
+
+// bytes hashed at the start and at the end of a file
+static const std::streamoff KEY_SAMPLE_BYTES = 64 * 1024;
+
+ThumbnailStore::ThumbnailStore(const io::path & dir) : _dir(dir) {
+    io::create_directories(_dir);
+}
+
+io::path ThumbnailStore::defaultDirectory() {
+    const char * cache_home = std::getenv("XDG_CACHE_HOME");
+    io::path cache;
+    if (cache_home && *cache_home) {
+        cache = cache_home;
+    } else {
+        const char * home = std::getenv("HOME");
+        cache = io::path(home ? home : ".") / ".cache";
+    }
+    return cache / "deeplocalizer" / "thumbnails";
+}
+
+std::string ThumbnailStore::contentKey(const std::string & filename) {
+    uint64_t hash;
+    if (ShardRef::parse(filename)) {
+        hash = fnv1aHash(filename);
+    } else {
+        std::ifstream is(filename, std::ios::binary);
+        ASSERT(is, "Cannot open file: " << filename);
+        is.seekg(0, std::ios::end);
+        const std::streamoff size = is.tellg();
+        hash = fnv1aHash(&size, sizeof(size));
+        std::vector<char> buffer(static_cast<size_t>(std::min(size, KEY_SAMPLE_BYTES)));
+        is.seekg(0);
+        is.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        hash = fnv1aHash(buffer.data(), buffer.size(), hash);
+        is.seekg(std::max<std::streamoff>(0, size - KEY_SAMPLE_BYTES));
+        is.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        hash = fnv1aHash(buffer.data(), buffer.size(), hash);
+    }
+    std::stringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return ss.str();
+}
+
+io::path ThumbnailStore::pathOf(const std::string & filename) const {
+    const std::string key = contentKey(filename);
+    // two levels, so no directory gets too many files
+    return _dir / key.substr(0, 2) / (key + ".png");
+}
+
+cv::Mat ThumbnailStore::make(const std::string & filename) {
+#if CV_VERSION_MAJOR > 3 || (CV_VERSION_MAJOR == 3 && CV_VERSION_MINOR >= 2)
+    // libjpeg scales by 1/8 while decoding, without the full frame in memory
+    const cv::Mat reduced = readImage(filename, cv::IMREAD_REDUCED_GRAYSCALE_8);
+    const int remaining = SCALE_DOWN / 8;
+#else
+    const cv::Mat reduced = readImage(filename, cv::IMREAD_GRAYSCALE);
+    const int remaining = SCALE_DOWN;
+#endif
+    ASSERT(not reduced.empty(), "Cannot decode image: " << filename);
+    cv::Mat thumbnail;
+    const cv::Size size((reduced.cols + remaining - 1) / remaining,
+                        (reduced.rows + remaining - 1) / remaining);
+    cv::resize(reduced, thumbnail, size, 0, 0, cv::INTER_AREA);
+    return thumbnail;
+}
+
+ImagePtr ThumbnailStore::load(const std::string & filename) const {
+    const io::path path = pathOf(filename);
+    cv::Mat thumbnail;
+    if (io::exists(path)) {
+        thumbnail = cv::imread(path.string(), cv::IMREAD_GRAYSCALE);
+    }
+    if (thumbnail.empty()) {
+        thumbnail = make(filename);
+        io::create_directories(path.parent_path());
+        // written aside and renamed, so a concurrent reader never sees half a file
+        const io::path tmp_path = io::unique_path(path.parent_path() / "%%%%%%%%.tmp.png");
+        if (cv::imwrite(tmp_path.string(), thumbnail)) {
+            io::rename(tmp_path, path);
+        }
+    }
+    return std::make_shared<Image>(filename, thumbnail);
+}
+}
@@ -0,0 +1,56 @@
+
+#include "TilePyramid.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "utils.h"
+
+namespace deeplocalizer {
+
+TilePyramid::TilePyramid(cv::Mat mat, int tile_size, size_t max_levels) :
+    _tile_size(tile_size)
+{
+    ASSERT(tile_size > 0, "Tile size must be positive, got " << tile_size);
+    _levels.push_back(mat);
+    while((max_levels == 0 || _levels.size() < max_levels) &&
+            std::max(_levels.back().cols, _levels.back().rows) > _tile_size) {
+        cv::Mat smaller;
+        cv::pyrDown(_levels.back(), smaller);
+        _levels.push_back(smaller);
+    }
+}
+
+size_t TilePyramid::levelFor(double scale) const {
+    if (scale >= 1 || scale <= 0) {
+        return 0;
+    }
+    const size_t level = static_cast<size_t>(std::floor(std::log2(1 / scale)));
+    return std::min(level, _levels.size() - 1);
+}
+
+std::vector<cv::Rect> TilePyramid::tiles(size_t level, const cv::Rect & area) const {
+    const cv::Mat & mat = _levels.at(level);
+    const cv::Rect visible = area & cv::Rect(0, 0, mat.cols, mat.rows);
+    std::vector<cv::Rect> tiles;
+    if (visible.area() == 0) {
+        return tiles;
+    }
+    const int first_col = visible.x / _tile_size;
+    const int last_col = (visible.x + visible.width - 1) / _tile_size;
+    const int first_row = visible.y / _tile_size;
+    const int last_row = (visible.y + visible.height - 1) / _tile_size;
+    tiles.reserve(size_t(last_col - first_col + 1) * size_t(last_row - first_row + 1));
+    for(int row = first_row; row <= last_row; row++) {
+        for(int col = first_col; col <= last_col; col++) {
+            const int x = col * _tile_size;
+            const int y = row * _tile_size;
+            tiles.emplace_back(x, y, std::min(_tile_size, mat.cols - x),
+                               std::min(_tile_size, mat.rows - y));
+        }
+    }
+    return tiles;
+}
+}
@@ -2,6 +2,7 @@
 #include "WholeImageWidget.h"
 
 #include "utils.h"
+#include <cmath>
 #include <QPainter>
 #include <QScrollArea>
 #include <QGuiApplication>
@@ -37,11 +38,16 @@ WholeImageWidget::WholeImageWidget(QScrollArea * parent,
     }
 }
 
+WholeImageWidget::~WholeImageWidget() {
+    // the queued build is skipped, only a running one is waited for
+    ++_pyramid_generation;
+}
+
 
 optional<Tag> WholeImageWidget::createTag(int x, int y) {
     if(x < TAG_WIDTH / 2 || y < TAG_HEIGHT / 2 ||
-        x > _pixmap.size().width() - TAG_WIDTH / 2 ||
-        y > _pixmap.size().height() - TAG_HEIGHT / 2
+        x > _mat.cols - TAG_WIDTH / 2 ||
+        y > _mat.rows - TAG_HEIGHT / 2
             ) {
         return optional<Tag>();
     }
@@ -57,24 +63,68 @@ void WholeImageWidget::tagProcessed(Tag tag) {
         return;
     }
     eraseTag(tag.id(), _newly_added_tags);
-    _tags->push_back(tag);
+    addTag(tag);
     repaint();
 }
 
-void WholeImageWidget::paintEvent(QPaintEvent *) {
-    _pixmap = cvMatToQPixmap(_mat);
+void WholeImageWidget::paintEvent(QPaintEvent * event) {
+    const QRect region = event->rect();
     _painter.begin(this);
+    if (_pyramid) {
+        // only the tiles in the repainted region, from the level closest to the zoom
+        const size_t level = _pyramid->levelFor(_scale);
+        const double level_scale = _scale * double(size_t(1) << level);
+        const cv::Rect area(int(region.x() / level_scale), int(region.y() / level_scale),
+                            int(std::ceil(region.width() / level_scale)) + 1,
+                            int(std::ceil(region.height() / level_scale)) + 1);
+        for(const auto & tile : _pyramid->tiles(level, area)) {
+            // round the edges, not the sizes, so neighbouring tiles leave no gaps
+            const int x0 = int(std::round(tile.x * level_scale));
+            const int y0 = int(std::round(tile.y * level_scale));
+            const int x1 = int(std::round((tile.x + tile.width) * level_scale));
+            const int y1 = int(std::round((tile.y + tile.height) * level_scale));
+            _painter.drawPixmap(QRect(x0, y0, x1 - x0, y1 - y0), tilePixmap(level, tile));
+        }
+    }
 
     _painter.scale(_scale, _scale);
-    _painter.drawPixmap(0, 0, _pixmap);
-    for(auto & t: *_tags) {
-        t.draw(_painter);
+    // only draw the tags in the repainted region. The margin covers the pen width.
+    const int margin = 4;
+    const cv::Rect visible(int(region.x() / _scale) - margin, int(region.y() / _scale) - margin,
+                           int(region.width() / _scale) + 2 * margin,
+                           int(region.height() / _scale) + 2 * margin);
+    updateGrid();
+    for(size_t idx : _grid.intersecting(visible)) {
+        _tags->at(idx).draw(_painter);
     }
     for(auto & t: _newly_added_tags) {
-        t.draw(_painter);
+        if ((t.getBoundingBox() & visible).area() > 0) {
+            t.draw(_painter);
+        }
     }
     _painter.end();
 }
+
+const QPixmap & WholeImageWidget::tilePixmap(size_t level, const cv::Rect & tile) {
+    const int size = _pyramid->tileSize();
+    const uint64_t key = (uint64_t(level) << 48) | (uint64_t(tile.y / size) << 24) |
+                         uint64_t(tile.x / size);
+    auto it = _tile_pixmaps.find(key);
+    if (it == _tile_pixmaps.end()) {
+        it = _tile_pixmaps.emplace(key, cvMatToQPixmap(_pyramid->tile(level, tile))).first;
+    }
+    return it->second;
+}
+
+void WholeImageWidget::pyramidBuilt(int generation) {
+    std::lock_guard<std::mutex> lock(_built_mutex);
+    if (generation != _pyramid_generation || generation != _built_generation) {
+        return;
+    }
+    _pyramid = std::move(_built_pyramid);
+    _built_pyramid.reset();
+    update();
+}
 void adjustScrollBarRelToMouse(QScrollBar *scrollBar, double mouse_rel_in_viewport, double factor)
 {
     scrollBar->setValue(int(factor*scrollBar->value()
@@ -112,11 +162,11 @@ void WholeImageWidget::zoomInRelToMouse(QPoint mouse_pos) {
     double factor = 1.25;
     auto vert = _parent->verticalScrollBar();
     auto horz = _parent->horizontalScrollBar();
-    auto img_size = _pixmap.size();
+    QSize img_size(_mat.cols, _mat.rows);
     QSize viewport(_parent->viewport()->size());
     if (img_size.width() < viewport.width())  viewport.setWidth(img_size.width());
     if (img_size.height() < viewport.height()) viewport.setHeight(img_size.height());
-    QSize max_viewport(_pixmap.size() - viewport);
+    QSize max_viewport(img_size - viewport);
     QPointF scroll_ratio(horz->value() / double(horz->maximum() - horz->minimum()),
                          vert->value() / double(vert->maximum() - vert->minimum()));
     if (std::isnan(scroll_ratio.x()))  scroll_ratio.setX(0);
@@ -146,48 +196,125 @@ void WholeImageWidget::wheelEvent(QWheelEvent * event) {
     }
 }
 
+// The type chosen with the pressed modifiers: Ctrl for an excluded region,
+// Alt for a bee without a tag.
+static optional<TagType> modifierType(Qt::KeyboardModifiers modifier) {
+    if (modifier.testFlag(Qt::ControlModifier)) {
+        return TagType::Exclude;
+    } else if (modifier.testFlag(Qt::AltModifier)) {
+        return TagType::BeeWithoutTag;
+    }
+    return optional<TagType>();
+}
+
 void WholeImageWidget::mousePressEvent(QMouseEvent * event) {
     auto pos = event->pos() / _scale;
+    const auto type = modifierType(QGuiApplication::queryKeyboardModifiers());
     boost::optional<Tag> opt_tag = getTag(pos.x(), pos.y());
     if (opt_tag) {
-        eraseTag(opt_tag.get().id(), *_tags);
-        eraseTag(opt_tag.get().id(), _newly_added_tags);
+        updateGrid();
+        auto idx = _grid.at(cv::Point2i(pos.x(), pos.y()));
+        if (idx && type) {
+            // a click with a modifier changes the type instead of erasing
+            setTagType(*idx, *type);
+        } else {
+            if (idx) {
+                eraseTag(*idx);
+            }
+            eraseTag(opt_tag.get().id(), _newly_added_tags);
+        }
     } else {
-        auto modifier = QGuiApplication::queryKeyboardModifiers();
         opt_tag = createTag(pos.x(), pos.y());
         if(!opt_tag) return;
         auto tag = opt_tag.get();
-        if (modifier.testFlag(Qt::ControlModifier)) {
-            tag.setType(TagType::Exclude);
-        } else if (modifier.testFlag(Qt::AltModifier)) {
-            tag.setType(TagType::BeeWithoutTag);
+        if (type) {
+            tag.setType(*type);
         }
-        _tags->push_back(tag);
+        addTag(tag);
     }
     emit changed();
     repaint();
 }
 
 boost::optional<Tag> WholeImageWidget::getTag(int x, int y) {
-    auto getTagIfContainsPoint = [x, y](auto & tags) {
-        cv::Point point(x, y);
-        for(auto & tag : tags) {
-            if(tag.getBoundingBox().contains(point)) {
-                return optional<Tag>(tag);
-            }
+    cv::Point point(x, y);
+    updateGrid();
+    auto idx = _grid.at(point);
+    if (idx) {
+        return _tags->at(*idx);
+    }
+    for(auto & tag : _newly_added_tags) {
+        if(tag.getBoundingBox().contains(point)) {
+            return optional<Tag>(tag);
         }
-        return optional<Tag>();
-    };
-    boost::optional<Tag> tag = getTagIfContainsPoint(*_tags);
-    if (tag) {
-        return tag;
     }
-    return getTagIfContainsPoint(_newly_added_tags);
+    return optional<Tag>();
+}
+
+void WholeImageWidget::addTag(const Tag & tag) {
+    _tags->push_back(tag);
+    _grid.insert(_tags->size() - 1, tag.getBoundingBox());
+    emit tagAdded(tag);
+}
+
+void WholeImageWidget::eraseTag(size_t idx) {
+    _deleted_Ids.insert(_tags->at(idx).id());
+    emit tagErased(_tags->at(idx));
+    const size_t last = _tags->size() - 1;
+    _grid.erase(last);
+    if (idx != last) {
+        _tags->at(idx) = std::move(_tags->back());
+        _grid.insert(idx, _tags->at(idx).getBoundingBox());
+    }
+    _tags->pop_back();
+}
+
+void WholeImageWidget::setTagType(size_t idx, TagType type) {
+    Tag & tag = _tags->at(idx);
+    if (tag.type() == type) {
+        return;
+    }
+    tag.setType(type);
+    emit tagTypeChanged(tag);
+}
+
+void WholeImageWidget::updateGrid() {
+    if (_grid.size() == _tags->size()) {
+        return;
+    }
+    _grid.clear();
+    for(size_t i = 0; i < _tags->size(); i++) {
+        _grid.insert(i, _tags->at(i).getBoundingBox());
+    }
 }
+
 void WholeImageWidget::setTags(cv::Mat mat, std::vector<Tag> * tags) {
     _mat = mat;
-    _pixmap = cvMatToQPixmap(mat);
     _tags = tags;
+    // Level 0 is shown right away. The smaller levels, which zooming out
+    // needs, are built in the background. Their tiles are converted on the
+    // first paint that shows them.
+    _tile_pixmaps.clear();
+    _pyramid = std::make_shared<const TilePyramid>(mat, TilePyramid::DEFAULT_TILE_SIZE, 1);
+    const int generation = ++_pyramid_generation;
+    _pyramid_builder.submit("pyramid", [this, mat, generation]() {
+        if (generation != _pyramid_generation) {
+            return;
+        }
+        auto pyramid = std::make_shared<const TilePyramid>(mat);
+        {
+            std::lock_guard<std::mutex> lock(_built_mutex);
+            if (generation != _pyramid_generation) {
+                return;
+            }
+            _built_pyramid = std::move(pyramid);
+            _built_generation = generation;
+        }
+        QMetaObject::invokeMethod(this, "pyramidBuilt", Qt::QueuedConnection,
+                                  Q_ARG(int, generation));
+    });
+    _grid.clear();
+    updateGrid();
     setFixedSize(sizeHint());
 }
 
@@ -3,8 +3,31 @@
 #include <opencv2/opencv.hpp>
 #include <chrono>
 #include <thread>
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <functional>
 #include <mutex>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
 #include "Image.h"
+#include "ImageShard.h"
+#include "PathfileReader.h"
+#include "BoundedQueue.h"
+#include "DirectoryWatcher.h"
+#include "MemoryBudget.h"
+#include "PreprocessContext.h"
+#include "PreprocessManifest.h"
+#include "ThreadingPolicy.h"
+#include "parallel.h"
+#include "preprocessing.h"
 #include "utils.h"
 
 using namespace deeplocalizer;
@@ -25,225 +48,648 @@ void setupOptions() {
             ("output-pathfile", po::value<std::string>()->default_value("images.txt"),
                  "Write output_pathfile to this directory. Default is <output_dir>/images.txt")
             ("pathfile",        po::value<std::vector<std::string>>(), "File with paths")
+            ("watch",           po::value<std::string>(),
+                 "Run as daemon and process every image written to this directory. "
+                 "The output pathfile is appended as images are done. Stop with Ctrl-C")
             ("border",          po::value<bool>()->default_value(true), "Add a border around the image.")
             ("use-hist-eq",     po::value<bool>()->default_value(false), "Apply local histogram equalization (CLAHE) to samples")
             ("use-threshold",   po::value<bool>()->default_value(false), "Apply adaptive thresholding to samples")
             ("binary-image",    po::value<bool>()->default_value(false), "Save binary image from thresholding")
             ("format,f",        po::value<std::string>()->default_value("jpeg"), "image output format. `png` or `jpeg`")
             ("compression,c",   po::value<int>(), "compression ratio")
-            ("benchmark",       po::value<bool>()->default_value(false), "Try out different compression ratios and formats");
+            ("threads,j",       po::value<size_t>()->default_value(0),
+                 "Number of threads processing the images. Default is the number of cores")
+            ("read-threads",    po::value<size_t>()->default_value(0),
+                 "Number of threads reading and decoding images. Default is the number of cores")
+            ("write-threads",   po::value<size_t>()->default_value(0),
+                 "Number of threads encoding and writing images. Default is the number of cores")
+            ("parallelism",     po::value<std::string>()->default_value("frames"),
+                 "`frames` processes one frame per thread with single threaded OpenCV calls. "
+                 "`intra-frame` processes one frame at a time with OpenCV using all cores. "
+                 "`auto` measures both at startup and picks the faster one")
+            ("pin-threads",     po::value<bool>()->default_value(false),
+                 "Bind every worker thread to one CPU, spread over the NUMA nodes")
+            ("queue-size",      po::value<size_t>()->default_value(0),
+                 "Number of images buffered between two stages. Default is 2*<number of processing threads>")
+            ("shard-size",      po::value<size_t>()->default_value(0),
+                 "Append the images to shard files of this many MB instead of writing one file per image. "
+                 "The output pathfile then lists <shard>:<offset> references")
+            ("simd",            po::value<bool>()->default_value(false),
+                 "Use the vectorized CLAHE and thresholding kernels. Faster, but not bit identical to OpenCV")
+            ("shard",           po::value<std::string>(),
+                 "Process only part i/N of the images, e.g. `--shard 2/8` on the third of eight machines. "
+                 "Images are split by filename, so every machine may get the pathfile in any order. "
+                 "Writes <output-pathfile>.<i>-of-<N>.txt and its manifest and summary")
+            ("merge-shards",    po::value<size_t>(),
+                 "Merge the output pathfiles of N machines that ran with `--shard i/N` into <output-pathfile>, "
+                 "in the order of the pathfile, and sum up their timings")
+            ("max-memory",      po::value<size_t>()->default_value(0),
+                 "Decode new images only while the images in flight and the scratch buffers "
+                 "of the processing threads use less than this many MB. Default is unlimited")
+            ("force",           po::value<bool>()->default_value(false),
+                 "Reprocess all images. By default images whose output is up to date are skipped")
+            ("benchmark",       po::value<bool>()->default_value(false),
+                 "Compare different formats and compression ratios in memory and write a report to <output_dir>/benchmark.json")
+            ("benchmark-samples", po::value<size_t>()->default_value(16),
+                 "Number of images encoded by the benchmark");
     positional_opt.add("pathfile", 1);
 }
 
-enum ImageFormat {
-    PNG,
-    JPEG
+io::path add_extension(const io::path & filename, const PreprocessOptions & opt) {
+    io::path output_path(filename);
+    output_path.replace_extension();
+    output_path += opt.extension() + std::string(".") + format_to_str(opt.format);
+    return output_path;
+}
+
+void writeOutputPathfile(io::path pathfile, const std::vector<std::string> &output_paths) {
+    std::ofstream of(pathfile.string());
+    size_t nb_images = 0;
+    for (const auto & path : output_paths) {
+        // images that failed to be written leave an empty slot
+        if (path.empty()) {
+            continue;
+        }
+        of << path << '\n';
+        nb_images++;
+    }
+    of << std::flush;
+
+    std::cout << std::endl;
+    std::cout << "Add border to " << nb_images << " images. Saved new images paths to: " << pathfile.string() << std::endl;
+    std::cout << std::endl;
+}
+
+// Readers claim chunks of this many consecutive images from the pathfile.
+// Small chunks keep the threads busy until the very end of the pathfile,
+// even if some cameras' frames take much longer to decode than others.
+static const size_t WORK_CHUNK_SIZE = 4;
 
+// An image travelling through the pipeline. `idx` is the position of the
+// image in the input pathfile. After processing, `context` is the context
+// whose output pool the image belongs to. `start` is when a reader picked
+// the image up. `reserved_bytes` is the memory budget the image holds.
+struct Frame {
+    size_t idx;
+    ManifestEntry entry;
+    std::shared_ptr<Image> img;
+    PreprocessContext * context;
+    time_point<steady_clock> start;
+    size_t reserved_bytes;
 };
 
-std::string format_to_str(ImageFormat format) {
-    if (format == ImageFormat::JPEG) {
-        return "jpeg";
-    } else if(format == ImageFormat::PNG) {
-        return "png";
-    } else {
-        return "wrong";
-    }
+using FrameQueue = BoundedQueue<Frame>;
+
+static size_t matBytes(const cv::Mat & mat) {
+    return mat.total() * mat.elemSize();
 }
 
-struct PreprocessOptions {
-    io::path output_dir;
-    bool use_hist_eq;
-    bool use_thresholding;
-    bool use_binary_image;
-    bool add_border;
-    ImageFormat format;
-    int compression;
-    bool benchmark;
-    std::pair<int, int> opencv_compression()const {
-        int f;
-        if (format == ImageFormat::JPEG) {
-            f = CV_IMWRITE_JPEG_QUALITY;
-        } else {
-            f = CV_IMWRITE_PNG_COMPRESSION;
-        }
-        return std::make_pair(f, compression);
-    };
+// Lets readers decode an image only if it fits into the memory budget.
+// The size of an image is known only after decoding, so a reader reserves
+// the size of the last image and corrects the reservation afterwards.
+// A frame holds its input and its output image until the input is processed,
+// then only the output until it is written. The pools reuse the released
+// images, so no more frame buffers are allocated than were in flight at once.
+class FrameAdmission {
+public:
+    explicit FrameAdmission(size_t max_bytes) : _budget(max_bytes) {}
 
-    std::string extension() const {
-        std::vector<std::string> parts;
-        if (use_hist_eq) {
-            parts.push_back("clahe");
+    size_t admit() {
+        size_t bytes = _expected_bytes;
+        // until the first image is decoded, take the whole budget
+        if (bytes == 0) {
+            bytes = _budget.maxBytes();
         }
-        if (use_thresholding) {
-            parts.push_back("t");
+        _budget.acquire(bytes);
+        return bytes;
+    }
+    // Changes the reservation to `bytes`. Never blocks, the memory is in use.
+    void correct(size_t & reserved, size_t bytes) {
+        if (bytes > reserved) {
+            _budget.force(bytes - reserved);
+        } else {
+            _budget.release(reserved - bytes);
         }
-        if (add_border) {
-            parts.push_back("b");
+        reserved = bytes;
+    }
+    void decoded(size_t & reserved, const cv::Mat & input) {
+        // the output is about as large as the input
+        const size_t bytes = 2 * matBytes(input);
+        _expected_bytes = bytes;
+        correct(reserved, bytes);
+    }
+    // The scratch buffers of the processing threads only grow and stay
+    // allocated until the end of the run.
+    void scratchGrew(size_t bytes) {
+        _budget.pin(bytes);
+    }
+    void release(size_t bytes) {
+        _budget.release(bytes);
+    }
+    size_t peak() const {
+        return _budget.peak();
+    }
+private:
+    MemoryBudget _budget;
+    std::atomic<size_t> _expected_bytes{0};
+};
+
+struct StageStats {
+    StageStats(std::string name, size_t nb_threads) :
+        name(name), nb_threads(nb_threads) {}
+    const std::string name;
+    const size_t nb_threads;
+    std::atomic<long> busy_ns{0};
+    std::atomic<size_t> nb_running{0};
+
+    void addBusyTime(time_point<steady_clock> begin) {
+        busy_ns += duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+    }
+    // fraction of the wall time the threads of this stage were working
+    double occupancy(double wall_seconds) const {
+        return busy_ns / (1e9 * wall_seconds * nb_threads);
+    }
+};
+
+// The output path of every image at the image's position in the input
+// pathfile, so the output pathfile keeps the input order no matter which
+// thread finished first. Grows as the pathfile is read.
+// Alternatively, every path is appended to the output pathfile right away,
+// in the order the images are done. The paths already in the file, e.g. from
+// before a restart, are kept and not appended again.
+class OutputPaths {
+public:
+    OutputPaths() {}
+    explicit OutputPaths(const io::path & incremental_pathfile) {
+        std::ifstream is(incremental_pathfile.string());
+        std::string line;
+        while(std::getline(is, line)) {
+            if (not line.empty()) {
+                _appended.insert(line);
+            }
         }
-        if (parts.empty()) {
-            return "";
-        } else {
-            std::stringstream ss;
-            for(const auto & part : parts) {
-                ss << "." << part;
+        is.close();
+        _incremental.open(incremental_pathfile.string(), std::ios::app);
+    }
+
+    void set(size_t idx, const std::string & path) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_incremental.is_open()) {
+            if (_appended.insert(path).second) {
+                _incremental << path << std::endl;
             }
-            return ss.str();
+            return;
         }
+        if (idx >= _paths.size()) {
+            _paths.resize(idx + 1);
+        }
+        _paths.at(idx) = path;
+    }
+    std::vector<std::string> paths() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _paths;
+    }
+private:
+    mutable std::mutex _mutex;
+    std::vector<std::string> _paths;
+    std::ofstream _incremental;
+    std::unordered_set<std::string> _appended;
+};
+
+// End-to-end latencies of the written images, from a reader picking an image
+// up until its output is written.
+class LatencyStats {
+public:
+    void add(time_point<steady_clock> start) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _latencies.push_back(duration_cast<duration<double>>(steady_clock::now() - start).count());
     }
 
+    // Prints the percentiles of the latencies since the last report.
     void print() {
-        std::cout << "output-dir:       " << output_dir << std::endl;
-        std::cout << "use-hist-eq:      " << use_hist_eq << std::endl;
-        std::cout << "use-thresholding: " << use_thresholding << std::endl;
-        std::cout << "add-border:       " << add_border << std::endl;
+        std::vector<double> latencies;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            latencies.swap(_latencies);
+            _last_report = steady_clock::now();
+        }
+        if (latencies.empty()) {
+            return;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p) {
+            size_t i = static_cast<size_t>(p * (latencies.size() - 1) + 0.5);
+            return 1000 * latencies.at(i);
+        };
+        std::cout << "Latency of " << latencies.size() << " images: "
+                  << std::fixed << std::setprecision(1)
+                  << "p50 " << percentile(0.5) << "ms, "
+                  << "p90 " << percentile(0.9) << "ms, "
+                  << "p99 " << percentile(0.99) << "ms, "
+                  << "max " << 1000 * latencies.back() << "ms"
+                  << std::defaultfloat << std::endl;
+    }
+
+    // Prints the percentiles if the last report is longer than `interval` ago.
+    void printEvery(steady_clock::duration interval) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (steady_clock::now() - _last_report < interval) {
+                return;
+            }
+        }
+        print();
     }
+private:
+    std::mutex _mutex;
+    std::vector<double> _latencies;
+    time_point<steady_clock> _last_report = steady_clock::now();
 };
 
-// opencv default values
-static const int DEFAULT_JPEG_COMPRESSION = 95;
-static const int DEFAULT_PNG_COMPRESSION = 3;
+// How often the daemon mode reports the latencies.
+static const auto LATENCY_REPORT_INTERVAL = seconds(10);
 
-io::path add_extension(const io::path & filename, const PreprocessOptions & opt) {
-    io::path output_path(filename);
-    output_path.replace_extension();
-    output_path += opt.extension() + std::string(".") + format_to_str(opt.format);
-    return output_path;
+struct WorkProgress {
+    std::atomic<size_t> nb_done{0};
+    std::atomic<size_t> nb_reused{0};
+    std::atomic<size_t> nb_written{0};
+    std::atomic<size_t> nb_failed{0};
+    std::atomic<bool> printing{false};
+};
+
+// The total number of images is only known once the whole pathfile is read.
+// Until then it is extrapolated from the fraction of the pathfile read.
+void reportProgress(WorkProgress & progress, const PathSource & pathfile) {
+    size_t nb_done = progress.nb_done.fetch_add(1, std::memory_order_relaxed) + 1;
+    // only one thread at a time draws the progress bar, the others just count
+    if (not progress.printing.exchange(true, std::memory_order_acquire)) {
+        size_t nb_read = std::max(pathfile.nbRead(), nb_done);
+        printProgress(start_time, pathfile.fractionRead() * nb_done / nb_read);
+        progress.printing.store(false, std::memory_order_release);
+    }
 }
 
-using pathss_t = std::vector<std::shared_ptr<std::vector<std::string>>>;
+// The last thread to leave a stage closes the stage's output queue.
+void leaveStage(StageStats & stats, FrameQueue & output) {
+    if (stats.nb_running.fetch_sub(1) == 1) {
+        output.close();
+    }
+}
 
-void writeOutputPathfile(io::path pathfile, const pathss_t &output_pathss) {
-    std::ofstream of(pathfile.string());
-    size_t nb_images = 0;
-    for (const auto &paths : output_pathss) {
-        nb_images += paths->size();
-        for (const auto & path : *paths) {
-            of << path << '\n';
+void readerFn(PathSource & pathfile,
+              FrameQueue & decoded,
+              OutputPaths & output_paths,
+              const PreprocessOptions & opt,
+              PreprocessManifest & manifest,
+              PreprocessContext & context,
+              FramePool & input_pool,
+              FrameAdmission & admission,
+              WorkProgress & progress,
+              StageStats & stats) {
+    std::vector<std::string> paths;
+    while(true) {
+        size_t start = pathfile.next(WORK_CHUNK_SIZE, paths);
+        if (paths.empty()) {
+            break;
+        }
+        for(size_t i = start; i < start + paths.size(); i++) {
+            if (not opt.isOnThisNode(paths.at(i - start))) {
+                progress.nb_done++;
+                continue;
+            }
+            auto begin = steady_clock::now();
+            ManifestEntry entry;
+            entry.input = paths.at(i - start);
+            entry.output = add_extension(opt.output_dir / io::path(entry.input).filename(), opt).string();
+            bool file_read = false;
+            bool up_to_date = entry.stat() && manifest.isUpToDate(entry, [&]() {
+                file_read = context.readFile(entry.input);
+                return file_read ? context.fileHash() : 0;
+            });
+            if (up_to_date) {
+                // only the mtime changed, remember the new one for the next run
+                if (file_read) {
+                    manifest.add(entry);
+                }
+                output_paths.set(i, entry.storedAt());
+                progress.nb_reused++;
+                stats.addBusyTime(begin);
+                reportProgress(progress, pathfile);
+                continue;
+            }
+            cv::Mat mat;
+            size_t reserved_bytes = 0;
+            if (file_read || context.readFile(entry.input)) {
+                entry.hash = context.fileHash();
+                // waiting for memory is not busy time
+                auto admit_begin = steady_clock::now();
+                reserved_bytes = admission.admit();
+                begin += steady_clock::now() - admit_begin;
+                mat = context.decodeFile(input_pool);
+            }
+            stats.addBusyTime(begin);
+            if (mat.empty()) {
+                admission.release(reserved_bytes);
+                std::cerr << "Fail to read image : " << entry.input << std::endl;
+                progress.nb_failed++;
+                reportProgress(progress, pathfile);
+                continue;
+            }
+            admission.decoded(reserved_bytes, mat);
+            auto img = std::make_shared<Image>(entry.input, mat);
+            decoded.push(Frame{i, std::move(entry), img, nullptr, begin, reserved_bytes});
         }
     }
-    of << std::flush;
+    leaveStage(stats, decoded);
+}
 
-    std::cout << std::endl;
-    std::cout << "Add border to " << nb_images << " images. Saved new images paths to: " << pathfile.string() << std::endl;
-    std::cout << std::endl;
+void processorFn(FrameQueue & decoded, FrameQueue & processed,
+                 PreprocessContext & context,
+                 FramePool & input_pool,
+                 FrameAdmission & admission,
+                 StageStats & stats) {
+    Frame frame;
+    while(decoded.pop(frame)) {
+        auto begin = steady_clock::now();
+        cv::Mat input = frame.img->getCvMat();
+        const size_t scratch_bytes = context.scratchBytes();
+        frame.img->getCvMatRef() = context.process(input);
+        frame.context = &context;
+        input_pool.release(input);
+        admission.scratchGrew(context.scratchBytes() - scratch_bytes);
+        admission.correct(frame.reserved_bytes, matBytes(frame.img->getCvMat()));
+        stats.addBusyTime(begin);
+        processed.push(std::move(frame));
+    }
+    leaveStage(stats, processed);
 }
 
-void adaptiveTresholding(cv::Mat & mat, bool use_binary_image) {
-    static double max_value = 255;
-    static size_t block_size = 51;
-    static double weight_original = 0.7;
-    static double weight_threshold = 0.3;
-
-    cv::Mat mat_threshold(mat.rows, mat.cols, CV_8UC1);
-    cv::adaptiveThreshold(mat, mat_threshold, max_value,
-                          cv::ADAPTIVE_THRESH_GAUSSIAN_C,
-                          cv::THRESH_BINARY, block_size, 0);
-    if (use_binary_image) {
-        mat = mat_threshold;
-    } else {
-        cv::addWeighted(mat, weight_original, mat_threshold, weight_threshold, 0 /*gamma*/, mat);
+// Encodes the image and appends it to a shard. Sets the shard reference as
+// the location of the frame's output.
+bool appendToShard(Frame & frame, const PreprocessOptions & opt,
+                   ShardWriter & shards, std::vector<uchar> & buffer) {
+    auto compression = opt.opencv_compression();
+    if (not cv::imencode("." + format_to_str(opt.format), frame.img->getCvMat(), buffer,
+                         {compression.first, compression.second})) {
+        return false;
     }
+    frame.entry.location = shards.append(frame.entry.input, buffer);
+    return true;
 }
 
-void localHistogramEq(cv::Mat & mat) {
-    std::cout << "CLAHE" << std::endl;
-    static const int clip_limit = 2;
-    thread_local int i = 0;
-    static const cv::Size tile_size(deeplocalizer::TAG_WIDTH / 2, deeplocalizer::TAG_HEIGHT / 2);
-    auto clahe = cv::createCLAHE(clip_limit, tile_size);
-    cv::Mat image_clahe;
-    clahe->apply(mat, image_clahe);
-    mat = image_clahe;
-    //clahe->apply(mat, mat);
-    //cv::imwrite("out_clahe.jpeg", image_clahe);
-    //cv::imwrite("out_mat.jpeg", mat);
+void writerFn(FrameQueue & processed,
+              const PathSource & pathfile,
+              OutputPaths & output_paths,
+              LatencyStats & latencies,
+              bool watch,
+              const PreprocessOptions & opt,
+              PreprocessManifest & manifest,
+              ShardWriter * shards,
+              FrameAdmission & admission,
+              WorkProgress & progress,
+              StageStats & stats) {
+    Frame frame;
+    std::vector<uchar> buffer;
+    while(processed.pop(frame)) {
+        auto begin = steady_clock::now();
+        const std::string & output = frame.entry.output;
+        bool written;
+        if (shards) {
+            written = appendToShard(frame, opt, *shards, buffer);
+        } else {
+            written = frame.img->write(output, opt.opencv_compression());
+        }
+        if(written) {
+            output_paths.set(frame.idx, frame.entry.storedAt());
+            manifest.add(frame.entry);
+            latencies.add(frame.start);
+            progress.nb_written++;
+        } else {
+            std::cerr << "Fail to write image : " << output << std::endl;
+            progress.nb_failed++;
+        }
+        cv::Mat mat = frame.img->getCvMat();
+        frame.img.reset();
+        frame.context->releaseOutput(mat);
+        admission.release(frame.reserved_bytes);
+        stats.addBusyTime(begin);
+        reportProgress(progress, pathfile);
+        if (watch) {
+            latencies.printEvery(LATENCY_REPORT_INTERVAL);
+        }
+    }
 }
 
-void makeBorder(cv::Mat & mat) {
-    auto mat_with_border = cv::Mat(mat.rows + TAG_HEIGHT,
-                                   mat.cols + TAG_WIDTH, CV_8U);
-    cv::copyMakeBorder(mat, mat_with_border,
-                       TAG_HEIGHT / 2, TAG_HEIGHT / 2,
-                       TAG_WIDTH  / 2, TAG_WIDTH  / 2,
-                       cv::BORDER_REPLICATE | cv::BORDER_ISOLATED);
-    mat = mat_with_border;
+void printStageReport(const std::vector<const StageStats *> & stages,
+                      const std::vector<const FrameQueue *> & queues,
+                      double wall_seconds) {
+    std::cout << "Stage occupancy:" << std::endl;
+    for(size_t i = 0; i < stages.size(); i++) {
+        const auto & stage = *stages.at(i);
+        std::cout << "    " << std::setw(8) << std::left << stage.name
+                  << " threads: " << std::setw(3) << stage.nb_threads
+                  << " busy: " << std::fixed << std::setprecision(1)
+                  << 100 * stage.occupancy(wall_seconds) << "%";
+        if (i < queues.size()) {
+            std::cout << "    output queue fill: "
+                      << 100 * queues.at(i)->meanOccupancy() << "%";
+        }
+        std::cout << std::defaultfloat << std::endl;
+    }
 }
-void processImage(Image & img, const PreprocessOptions & opt) {
-    cv::Mat & mat = img.getCvMatRef();
 
-    if (opt.add_border) {
-        makeBorder(mat);
+// Counts and timing of a run, saved next to the output pathfile, so the runs
+// of several machines can be summed up.
+struct RunSummary {
+    size_t nb_written = 0;
+    size_t nb_reused = 0;
+    size_t nb_failed = 0;
+    double wall_seconds = 0;
+    size_t peak_rss_bytes = 0;
+
+    size_t nbImages() const {
+        return nb_written + nb_reused + nb_failed;
+    }
+    nlohmann::json to_json() const {
+        nlohmann::json j;
+        j["nb_images"] = nbImages();
+        j["nb_written"] = nb_written;
+        j["nb_reused"] = nb_reused;
+        j["nb_failed"] = nb_failed;
+        j["wall_seconds"] = wall_seconds;
+        j["images_per_second"] = wall_seconds > 0 ? nb_written / wall_seconds : 0;
+        j["peak_rss_bytes"] = peak_rss_bytes;
+        return j;
+    }
+    static RunSummary from_json(const nlohmann::json & j) {
+        RunSummary summary;
+        summary.nb_written = j["nb_written"].get<size_t>();
+        summary.nb_reused = j["nb_reused"].get<size_t>();
+        summary.nb_failed = j["nb_failed"].get<size_t>();
+        summary.wall_seconds = j["wall_seconds"].get<double>();
+        if (j.find("peak_rss_bytes") != j.end()) {
+            summary.peak_rss_bytes = j["peak_rss_bytes"].get<size_t>();
+        }
+        return summary;
     }
-    if (opt.use_hist_eq) {
-        localHistogramEq(mat);
+    static io::path pathFor(const io::path & output_pathfile) {
+        io::path path(output_pathfile);
+        path += ".summary.json";
+        return path;
     }
-    if (opt.use_thresholding) {
-        adaptiveTresholding(mat, opt.use_binary_image);
+};
+
+// Peak resident memory of this process in bytes. 0 if unknown.
+size_t peakResidentBytes() {
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
     }
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+    return 0;
+#endif
 }
-void threadWorkerFn(const std::vector<ImageDesc> & image_descs,
-                    const size_t start, const size_t end,
-                    std::shared_ptr<std::vector<std::string>>  output_paths,
-                    const PreprocessOptions & opt,
-                    size_t & nb_done,
-                    std::mutex & cout_mutex) {
-    for(size_t i = start; i < end; i++) {
-        const ImageDesc & desc = image_descs.at(i);
-        Image img(desc);
-        processImage(img, opt);
-        auto input_path =  io::path(desc.filename);
-        auto output = add_extension(opt.output_dir / input_path.filename(), opt);
-        if(not img.write(output, opt.opencv_compression())) {
-            std::lock_guard<std::mutex> look(cout_mutex);
-            std::cerr << "Fail to write image : " << output.string() << std::endl;
-            return;
-        }
-        output_paths->push_back(output.string());
-        {
-            std::lock_guard<std::mutex> look(cout_mutex);
-            nb_done++;
-            printProgress(start_time, static_cast<double>(nb_done)/image_descs.size());
-        }
+
+// Size of the frames used to probe the parallelism, the resolution of the
+// recording cameras.
+static const cv::Size PROBE_FRAME_SIZE(4000, 3000);
+
+// Resolves the `auto` parallelism and makes the result the policy of the
+// process, which also sets OpenCV's number of threads.
+ThreadingPolicy threadingPolicy(const PreprocessOptions & opt) {
+    Parallelism parallelism = opt.parallelism;
+    if (parallelism == Parallelism::Auto) {
+        cv::Mat sample(PROBE_FRAME_SIZE, CV_8U);
+        cv::randu(sample, 0, 256);
+        parallelism = probeParallelism(sample, opt);
+        std::cout << "Using " << parallelism_to_str(parallelism) << " parallelism." << std::endl;
     }
+    ThreadingPolicy policy(parallelism, opt.pin_threads);
+    setProcessPolicy(policy);
+    return policy;
 }
 
-double preprocess(const std::vector<ImageDesc> image_descs,
+// Starts `fn(args...)` on a new thread, pinned to a CPU by `policy`.
+template<typename Fn, typename... Args>
+void startWorker(std::vector<std::thread> & threads, const ThreadingPolicy & policy,
+                 Fn fn, Args &&... args) {
+    const size_t worker_idx = threads.size();
+    auto task = std::bind(fn, std::forward<Args>(args)...);
+    threads.emplace_back([&policy, worker_idx, task]() mutable {
+        policy.pinWorker(worker_idx);
+        task();
+    });
+}
+
+// Runs the images through three stages joined by bounded queues:
+// read & decode -> process -> encode & write.
+// Every stage has its own thread pool, so disk I/O and CPU work overlap.
+// The readers consume the pathfile as they go, so the first images are
+// processed before the whole pathfile has been read.
+// With `watch`, the output paths are appended to the output pathfile as soon
+// as the images are written and the latencies are reported regularly.
+RunSummary preprocess(PathSource & pathfile,
         const io::path &  output_pathfile,
-        const PreprocessOptions  & opt) {
+        const PreprocessOptions  & opt,
+        bool watch = false) {
     auto start = std::chrono::system_clock::now();
     io::create_directories(opt.output_dir);
+    const ThreadingPolicy policy = threadingPolicy(opt);
     start_time = system_clock::now();
     printProgress(start_time, 0);
-    const size_t nb_cpus = std::max(2*std::thread::hardware_concurrency(), 1u);
+    StageStats read_stats("read", policy.workerThreads(opt.nb_read_threads));
+    StageStats process_stats("process", policy.frameThreads(opt.nb_threads));
+    StageStats write_stats("write", policy.workerThreads(opt.nb_write_threads));
+    size_t queue_size = opt.queue_size;
+    if (queue_size == 0) {
+        queue_size = 2*process_stats.nb_threads;
+    }
+    FrameQueue decoded(queue_size);
+    FrameQueue processed(queue_size);
+    WorkProgress progress;
+    PreprocessManifest manifest(PreprocessManifest::pathFor(output_pathfile), opt, not opt.force);
+    std::unique_ptr<ShardWriter> shards;
+    if (opt.shard_size > 0) {
+        shards = std::make_unique<ShardWriter>(opt.output_dir / output_pathfile.stem(), opt.shard_size);
+    }
+
+    std::unique_ptr<OutputPaths> output_paths = watch ?
+            std::make_unique<OutputPaths>(output_pathfile) : std::make_unique<OutputPaths>();
+    LatencyStats latencies;
+    FrameAdmission admission(opt.max_memory);
+    // decoded images go back to the input pool once they are processed
+    FramePool input_pool;
+    std::vector<std::unique_ptr<PreprocessContext>> contexts;
     std::vector<std::thread> threads;
-    size_t nb_done = 0;
-
-    pathss_t output_pathss;
-    size_t part = image_descs.size()/nb_cpus;
-    for(size_t i = 0; i < nb_cpus; i++) {
-        std::shared_ptr<std::vector<std::string>> out_paths = std::make_shared<std::vector<std::string>>();
-        out_paths->reserve(part);
-        output_pathss.push_back(out_paths);
-    }
-    for(size_t i = 0; i < nb_cpus; i++) {
-        size_t start = i*part;
-        size_t end = (i+1)*part;
-        if (i + 1 == nb_cpus)  {
-            end = image_descs.size();
-        }
-        std::mutex cout_look;
-        threads.push_back(std::thread(&threadWorkerFn, std::cref(image_descs),
-                                      start, end,
-                                      output_pathss.at(i),
-                                      std::cref(opt), std::ref(nb_done), std::ref(cout_look)));
+    read_stats.nb_running = read_stats.nb_threads;
+    process_stats.nb_running = process_stats.nb_threads;
+    for(size_t i = 0; i < read_stats.nb_threads; i++) {
+        contexts.emplace_back(std::make_unique<PreprocessContext>(opt));
+        startWorker(threads, policy, &readerFn, std::ref(pathfile), std::ref(decoded),
+                    std::ref(*output_paths), std::cref(opt), std::ref(manifest),
+                    std::ref(*contexts.back()), std::ref(input_pool),
+                    std::ref(admission), std::ref(progress), std::ref(read_stats));
+    }
+    for(size_t i = 0; i < process_stats.nb_threads; i++) {
+        contexts.emplace_back(std::make_unique<PreprocessContext>(opt));
+        startWorker(threads, policy, &processorFn, std::ref(decoded), std::ref(processed),
+                    std::ref(*contexts.back()), std::ref(input_pool),
+                    std::ref(admission), std::ref(process_stats));
+    }
+    for(size_t i = 0; i < write_stats.nb_threads; i++) {
+        startWorker(threads, policy, &writerFn, std::ref(processed), std::cref(pathfile),
+                    std::ref(*output_paths), std::ref(latencies), watch,
+                    std::cref(opt), std::ref(manifest), shards.get(),
+                    std::ref(admission), std::ref(progress), std::ref(write_stats));
     }
     for(auto & thread : threads) {
         thread.join();
     }
-    writeOutputPathfile(output_pathfile, output_pathss);
+    if (watch) {
+        std::cout << std::endl << "Appended new images paths to: " << output_pathfile.string() << std::endl;
+    } else {
+        writeOutputPathfile(output_pathfile, output_paths->paths());
+    }
+    manifest.compact();
+    std::cout << "Skipped " << progress.nb_reused << " images with up to date output." << std::endl;
+    if (shards) {
+        std::cout << "Wrote " << shards->nbShards() << " new shards." << std::endl;
+    }
     std::chrono::duration<double> duration = std::chrono::system_clock::now() - start;
-    return duration.count();
+    printStageReport({&read_stats, &process_stats, &write_stats},
+                     {&decoded, &processed}, duration.count());
+    size_t nb_growths = 0;
+    for(const auto & context : contexts) {
+        nb_growths += context->bufferGrowths();
+    }
+    std::cout << "Frame and scratch buffer growths: " << nb_growths << std::endl;
+    const size_t MB = 1024 * 1024;
+    std::cout << "Peak memory of images in flight: " << admission.peak() / MB << "MB";
+    if (opt.max_memory > 0) {
+        std::cout << " (budget: " << opt.max_memory / MB << "MB)";
+    }
+    std::cout << std::endl;
+    std::cout << "Peak resident memory: " << peakResidentBytes() / MB << "MB" << std::endl;
+    latencies.print();
+    RunSummary summary;
+    summary.nb_written = progress.nb_written;
+    summary.nb_reused = progress.nb_reused;
+    summary.nb_failed = progress.nb_failed;
+    summary.wall_seconds = duration.count();
+    summary.peak_rss_bytes = peakResidentBytes();
+    nlohmann::json summary_json = summary.to_json();
+    if (opt.nb_nodes > 1) {
+        summary_json["node_index"] = opt.node_index;
+        summary_json["nb_nodes"] = opt.nb_nodes;
+    }
+    safe_serialization(RunSummary::pathFor(output_pathfile).string(), std::move(summary_json));
+    return summary;
 }
 
 std::vector<std::pair<ImageFormat, int>> benchmark_formats() {
@@ -257,63 +703,255 @@ std::vector<std::pair<ImageFormat, int>> benchmark_formats() {
     return formats;
 }
 
-std::string mean_file_size(io::path dir) {
-    io::directory_iterator end_itr;
-    size_t nb_files = 0;
-    size_t total_size = 0;
-
-    for (io::directory_iterator itr(dir); itr != end_itr; ++itr)
-    {
-        const io::path & file = itr->path();
-        if (io::is_regular_file(file)) {
-            total_size += io::file_size(file);
-            nb_files++;
+struct EncodeResult {
+    size_t nb_bytes = 0;
+    double encode_seconds = 0;
+    double decode_seconds = 0;
+    double psnr = 0;
+    double ssim = 0;
+};
+
+double secondsSince(time_point<steady_clock> begin) {
+    return duration_cast<duration<double>>(steady_clock::now() - begin).count();
+}
+
+// Decodes and processes a sample of the images once, keeps them in memory and
+// then encodes them with every format and compression of `benchmark_formats`.
+std::vector<cv::Mat> benchmarkSamples(const std::vector<std::string> & paths,
+                                      const PreprocessOptions & opt,
+                                      size_t nb_threads) {
+    const size_t nb_samples = std::min(opt.benchmark_samples, paths.size());
+    std::vector<std::unique_ptr<PreprocessContext>> contexts;
+    for(size_t t = 0; t < nb_threads; t++) {
+        contexts.emplace_back(std::make_unique<PreprocessContext>(opt));
+    }
+    std::vector<cv::Mat> samples(nb_samples);
+    parallelFor(nb_samples, nb_threads, [&](size_t i, size_t t) {
+        // spread the samples evenly over the pathfile
+        const std::string & filename = paths.at(i * paths.size() / nb_samples);
+        FramePool input_pool;
+        cv::Mat input = contexts.at(t)->decode(filename, input_pool);
+        if (input.empty()) {
+            std::cerr << "Fail to read image : " << filename << std::endl;
+            return;
+        }
+        samples.at(i) = contexts.at(t)->process(input);
+    });
+    samples.erase(std::remove_if(samples.begin(), samples.end(),
+                                 [](const cv::Mat & m) { return m.empty(); }),
+                  samples.end());
+    return samples;
+}
+
+nlohmann::json summarizeEncodeResults(ImageFormat format, int compression,
+                                      const std::vector<EncodeResult> & results,
+                                      size_t nb_pixels) {
+    size_t total_bytes = 0;
+    double encode_seconds = 0, decode_seconds = 0;
+    double sum_psnr = 0, min_psnr = std::numeric_limits<double>::infinity();
+    double sum_ssim = 0, min_ssim = 1;
+    size_t nb_finite_psnr = 0;
+    for(const auto & r : results) {
+        total_bytes += r.nb_bytes;
+        encode_seconds += r.encode_seconds;
+        decode_seconds += r.decode_seconds;
+        if (std::isfinite(r.psnr)) {
+            sum_psnr += r.psnr;
+            nb_finite_psnr++;
         }
+        min_psnr = std::min(min_psnr, r.psnr);
+        sum_ssim += r.ssim;
+        min_ssim = std::min(min_ssim, r.ssim);
     }
-    double mean_size = total_size / static_cast<double>(nb_files);
-    const static size_t one_mb = 1 << 20;
-    double size_in_mb = mean_size / one_mb;
-    std::stringstream ss;
-    ss << size_in_mb << "MB";
-    return ss.str();
+    const double n = results.size();
+    nlohmann::json j;
+    j["format"] = format_to_str(format);
+    j["compression"] = compression;
+    j["mean_bytes"] = total_bytes / n;
+    j["bits_per_pixel"] = 8.0 * total_bytes / nb_pixels;
+    j["encode_ms"] = 1000 * encode_seconds / n;
+    j["encode_megapixels_per_s"] = nb_pixels / (1e6 * encode_seconds);
+    j["decode_ms"] = 1000 * decode_seconds / n;
+    // identical images have an infinite PSNR, which JSON can not represent
+    j["mean_psnr"] = nb_finite_psnr == results.size() ? nlohmann::json(sum_psnr / n) : nlohmann::json();
+    j["min_psnr"] = std::isfinite(min_psnr) ? nlohmann::json(min_psnr) : nlohmann::json();
+    j["mean_ssim"] = sum_ssim / n;
+    j["min_ssim"] = min_ssim;
+    return j;
 }
 
-void benchmark(const std::vector<ImageDesc> image_descs,
-        const io::path &  output_pathfile,
-        const PreprocessOptions  & opt) {
-    auto formats = benchmark_formats();
-    std::vector<std::pair<PreprocessOptions, double>> results;
-    for(auto & format_compression : formats) {
-        PreprocessOptions bench_opt = opt;
-        bench_opt.format = std::get<ImageFormat>(format_compression);
-        bench_opt.compression = std::get<int>(format_compression);
-        std::stringstream ss;
-        ss << format_to_str(bench_opt.format) << "_c_" << bench_opt.compression;
-        bench_opt.output_dir = opt.output_dir / ss.str();
-        std::cout << "Benchmark: " << format_to_str(bench_opt.format) << ", Compression: " << bench_opt.compression << std::endl;
-        double duration = preprocess(image_descs, output_pathfile, bench_opt);
-        std::cout << "Done in: " << duration << "s" << std::endl;
-        results.push_back(std::make_pair(bench_opt, duration));
-    }
-    for(size_t i = 0; i < formats.size(); i++) {
-        PreprocessOptions bench_opt = std::get<PreprocessOptions>(results.at(i));
-        std::cout << "Format: " << format_to_str(bench_opt.format) << ", Compression: " << bench_opt.compression << std::endl;
-        std::cout << "file size: " << mean_file_size(bench_opt.output_dir) << std::endl;
-        std::cout << "duration: " << std::get<double>(results.at(i)) << "s" << std::endl;
-        std::cout << std::endl;
+// Writes a JSON report comparing the formats to <output_dir>/benchmark.json.
+void benchmark(PathfileReader & pathfile,
+               const PreprocessOptions  & opt) {
+    const std::vector<std::string> paths = pathfile.readAll();
+    io::create_directories(opt.output_dir);
+    std::cout << "Decoding and processing " << std::min(opt.benchmark_samples, paths.size())
+              << " sample images." << std::endl;
+    const ThreadingPolicy policy = threadingPolicy(opt);
+    const std::vector<cv::Mat> samples = benchmarkSamples(paths, opt, policy.frameThreads(opt.nb_threads));
+    if (samples.empty()) {
+        std::cerr << "No images to benchmark." << std::endl;
+        return;
+    }
+    size_t nb_pixels = 0;
+    for(const auto & sample : samples) {
+        nb_pixels += sample.total();
+    }
+    const auto formats = benchmark_formats();
+    std::vector<EncodeResult> results(formats.size() * samples.size());
+    auto start = steady_clock::now();
+    parallelFor(results.size(), policy.frameThreads(opt.nb_threads), [&](size_t i, size_t) {
+        PreprocessOptions format_opt = opt;
+        std::tie(format_opt.format, format_opt.compression) = formats.at(i / samples.size());
+        const cv::Mat & original = samples.at(i % samples.size());
+        auto compression = format_opt.opencv_compression();
+        EncodeResult & result = results.at(i);
+        std::vector<uchar> buffer;
+        auto begin = steady_clock::now();
+        cv::imencode("." + format_to_str(format_opt.format), original, buffer,
+                     {compression.first, compression.second});
+        result.encode_seconds = secondsSince(begin);
+        result.nb_bytes = buffer.size();
+        begin = steady_clock::now();
+        cv::Mat decoded = cv::imdecode(buffer, cv::IMREAD_GRAYSCALE);
+        result.decode_seconds = secondsSince(begin);
+        result.psnr = psnr(original, decoded);
+        result.ssim = ssim(original, decoded);
+    });
+    double wall_seconds = secondsSince(start);
+
+    nlohmann::json report;
+    report["nb_samples"] = samples.size();
+    report["options"] = PreprocessManifest::optionsToJson(opt);
+    report["wall_seconds"] = wall_seconds;
+    report["formats"] = nlohmann::json::array();
+    for(size_t f = 0; f < formats.size(); f++) {
+        std::vector<EncodeResult> format_results(results.begin() + f * samples.size(),
+                                                 results.begin() + (f + 1) * samples.size());
+        auto summary = summarizeEncodeResults(formats.at(f).first, formats.at(f).second,
+                                              format_results, nb_pixels);
+        std::cout << "Format: " << summary["format"].dump() << ", Compression: " << summary["compression"].dump()
+                  << ", size: " << summary["mean_bytes"].dump() << " bytes"
+                  << ", encode: " << summary["encode_ms"].dump() << "ms"
+                  << ", decode: " << summary["decode_ms"].dump() << "ms"
+                  << ", PSNR: " << summary["mean_psnr"].dump()
+                  << ", SSIM: " << summary["mean_ssim"].dump() << std::endl;
+        report["formats"].push_back(summary);
     }
+    io::path report_path = opt.output_dir / "benchmark.json";
+    safe_serialization(report_path.string(), std::move(report));
+    std::cout << "Saved benchmark report to: " << report_path.string() << std::endl;
 }
 
-int run(const std::vector<ImageDesc> image_descs,
+int run(PathfileReader & pathfile,
         const io::path &  output_pathfile,
         const PreprocessOptions  & opt
         ) {
     if (opt.benchmark) {
-        benchmark(image_descs, output_pathfile, opt);
+        benchmark(pathfile, opt);
     } else {
-        double duration = preprocess(image_descs, output_pathfile, opt);
-        std::cout << "Done in: " << duration << "s" << std::endl;
+        RunSummary summary = preprocess(pathfile, output_pathfile, opt);
+        std::cout << "Done in: " << summary.wall_seconds << "s" << std::endl;
+    }
+    return 0;
+}
+
+// Output pathfile of the machine `node_index`: images.txt -> images.2-of-8.txt
+io::path nodePathfile(const io::path & output_pathfile, size_t node_index, size_t nb_nodes) {
+    io::path path = output_pathfile.parent_path() / output_pathfile.stem();
+    path += "." + std::to_string(node_index) + "-of-" + std::to_string(nb_nodes);
+    path += output_pathfile.extension();
+    return path;
+}
+
+// Merges the runs of `nb_nodes` machines into one output pathfile, manifest
+// and summary, as if a single machine had processed the whole pathfile.
+// The machines ran in parallel, so the merged wall time is the one of the
+// slowest machine.
+int merge(PathfileReader & pathfile,
+          const io::path & output_pathfile,
+          size_t nb_nodes,
+          const PreprocessOptions & opt) {
+    std::unordered_map<std::string, ManifestEntry> entries;
+    RunSummary total;
+    double node_seconds = 0;
+    nlohmann::json nodes = nlohmann::json::array();
+    for(size_t i = 0; i < nb_nodes; i++) {
+        io::path node_pathfile = nodePathfile(output_pathfile, i, nb_nodes);
+        io::path manifest_path = PreprocessManifest::pathFor(node_pathfile);
+        io::path summary_path = RunSummary::pathFor(node_pathfile);
+        ASSERT(io::exists(manifest_path) && io::exists(summary_path),
+               "Missing output of machine " << i << "/" << nb_nodes << ": " << manifest_path);
+        auto node_entries = PreprocessManifest::read(manifest_path, opt);
+        entries.insert(node_entries.begin(), node_entries.end());
+
+        nlohmann::json node_json;
+        std::ifstream(summary_path.string()) >> node_json;
+        RunSummary node = RunSummary::from_json(node_json);
+        total.nb_written += node.nb_written;
+        total.nb_reused += node.nb_reused;
+        total.nb_failed += node.nb_failed;
+        total.wall_seconds = std::max(total.wall_seconds, node.wall_seconds);
+        total.peak_rss_bytes = std::max(total.peak_rss_bytes, node.peak_rss_bytes);
+        node_seconds += node.wall_seconds;
+        nodes.push_back(node_json);
+    }
+
+    PreprocessManifest manifest(PreprocessManifest::pathFor(output_pathfile), opt, false);
+    std::vector<std::string> output_paths;
+    size_t nb_missing = 0;
+    for(const auto & path : pathfile.readAll()) {
+        auto it = entries.find(path);
+        if (it == entries.end()) {
+            nb_missing++;
+            continue;
+        }
+        output_paths.push_back(it->second.storedAt());
+        manifest.add(it->second);
+    }
+    manifest.compact();
+    writeOutputPathfile(output_pathfile, output_paths);
+    if (nb_missing > 0) {
+        std::cerr << nb_missing << " images of the pathfile have no output on any machine." << std::endl;
     }
+
+    nlohmann::json summary_json = total.to_json();
+    summary_json["nb_nodes"] = nb_nodes;
+    summary_json["node_seconds"] = node_seconds;
+    summary_json["nodes"] = nodes;
+    std::cout << "Merged " << nb_nodes << " machines: " << total.nbImages() << " images, "
+              << total.nb_written << " written, " << total.nb_reused << " reused, "
+              << total.nb_failed << " failed in " << total.wall_seconds << "s ("
+              << summary_json["images_per_second"].dump() << " images/s)." << std::endl;
+    safe_serialization(RunSummary::pathFor(output_pathfile).string(), std::move(summary_json));
+    return nb_missing == 0 ? 0 : 1;
+}
+
+std::atomic<DirectoryWatcher *> running_watcher{nullptr};
+
+void stopWatching(int) {
+    DirectoryWatcher * watcher = running_watcher.load();
+    if (watcher) {
+        watcher->stop();
+    }
+}
+
+// Processes the images written to `dir` until SIGINT or SIGTERM. The readers
+// wait on the directory, so every new image goes straight to a warm worker.
+int watch(const io::path & dir,
+          const io::path & output_pathfile,
+          const PreprocessOptions & opt) {
+    io::create_directories(opt.output_dir);
+    ASSERT(not io::equivalent(dir, opt.output_dir),
+           "The output directory must not be the watched directory.");
+    DirectoryWatcher watcher(dir);
+    running_watcher = &watcher;
+    std::signal(SIGINT, stopWatching);
+    std::signal(SIGTERM, stopWatching);
+    std::cout << "Watching " << dir.string() << " for new images. Stop with Ctrl-C." << std::endl;
+    RunSummary summary = preprocess(watcher, output_pathfile, opt, true);
+    running_watcher = nullptr;
+    std::cout << "Stopped after: " << summary.wall_seconds << "s" << std::endl;
     return 0;
 }
 
@@ -327,13 +965,11 @@ int main(int argc, char* argv[])
     if (vm.count("help")) {
         std::cout << "Usage: add_border [options] pathfile.txt "<< std::endl;
         std::cout << "    where pathfile.txt contains paths to images."<< std::endl;
+        std::cout << "    Use `-` to read the paths from the standard input."<< std::endl;
         std::cout << desc_option << std::endl;
         return 0;
     }
-    if(vm.count("pathfile") && vm.count("output-dir")) {
-        std::string pathfile =
-                vm.at("pathfile").as<std::vector<std::string>>().at(0);
-        auto image_descs = ImageDesc::fromPathFile(pathfile);
+    if((vm.count("pathfile") || vm.count("watch")) && vm.count("output-dir")) {
         auto output_dir = io::path(vm.at("output-dir").as<std::string>());
 
         io::path output_pathfile = vm.at("output-pathfile").as<std::string>();
@@ -364,6 +1000,30 @@ int main(int argc, char* argv[])
             compression = DEFAULT_PNG_COMPRESSION;
         }
         bool add_border = vm.at("border").as<bool>();
+        size_t nb_read_threads = vm.at("read-threads").as<size_t>();
+        size_t nb_threads = vm.at("threads").as<size_t>();
+        size_t nb_write_threads = vm.at("write-threads").as<size_t>();
+        size_t queue_size = vm.at("queue-size").as<size_t>();
+        bool force = vm.at("force").as<bool>();
+        size_t benchmark_samples = vm.at("benchmark-samples").as<size_t>();
+        uint64_t shard_size = vm.at("shard-size").as<size_t>() * 1024 * 1024;
+        bool use_simd = vm.at("simd").as<bool>();
+        uint64_t max_memory = vm.at("max-memory").as<size_t>() * 1024 * 1024;
+        Parallelism parallelism = parallelism_from_str(vm.at("parallelism").as<std::string>());
+        bool pin_threads = vm.at("pin-threads").as<bool>();
+        size_t node_index = 0;
+        size_t nb_nodes = 0;
+        if (vm.count("shard")) {
+            std::string shard = vm.at("shard").as<std::string>();
+            char slash = 0;
+            std::istringstream ss(shard);
+            if (not (ss >> node_index >> slash >> nb_nodes) || slash != '/' || not ss.eof()
+                    || node_index >= nb_nodes) {
+                std::cout << "Expected --shard i/N with i < N. But got: " << shard << std::endl;
+                exit(1);
+            }
+            output_pathfile = nodePathfile(output_pathfile, node_index, nb_nodes);
+        }
         PreprocessOptions opt {
                 output_dir,
                 use_hist_eq,
@@ -372,10 +1032,30 @@ int main(int argc, char* argv[])
                 add_border,
                 format,
                 compression,
-                benchmark
+                benchmark,
+                nb_read_threads,
+                nb_threads,
+                nb_write_threads,
+                queue_size,
+                force,
+                benchmark_samples,
+                shard_size,
+                use_simd,
+                node_index,
+                nb_nodes,
+                max_memory,
+                parallelism,
+                pin_threads
         };
         opt.print();
-        run(image_descs, output_pathfile, opt);
+        if (vm.count("watch")) {
+            return watch(vm.at("watch").as<std::string>(), output_pathfile, opt);
+        }
+        PathfileReader pathfile(vm.at("pathfile").as<std::vector<std::string>>().at(0));
+        if (vm.count("merge-shards")) {
+            return merge(pathfile, output_pathfile, vm.at("merge-shards").as<size_t>(), opt);
+        }
+        run(pathfile, output_pathfile, opt);
     } else {
         std::cout << "No pathfile or output_dir are given" << std::endl;
         std::cout << "Usage: add_border [options] pathfile.txt "<< std::endl;
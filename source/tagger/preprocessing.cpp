@@ -0,0 +1,348 @@
+
+#include "preprocessing.h"
+
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include <opencv2/core/version.hpp>
+#include <opencv2/opencv.hpp>
+
+#include "deeplocalizer_tagger.h"
+#include "parallel.h"
+#include "utils.h"
+
+namespace deeplocalizer {
+
+static const double THRESHOLD_MAX_VALUE = 255;
+static const int THRESHOLD_BLOCK_SIZE = 51;
+static const double WEIGHT_ORIGINAL = 0.7;
+static const double WEIGHT_THRESHOLD = 0.3;
+static const int CLAHE_CLIP_LIMIT = 2;
+static const cv::Size CLAHE_TILE_SIZE(TAG_WIDTH / 2, TAG_HEIGHT / 2);
+
+std::string format_to_str(ImageFormat format) {
+    if (format == ImageFormat::JPEG) {
+        return "jpeg";
+    } else if(format == ImageFormat::PNG) {
+        return "png";
+    } else {
+        return "wrong";
+    }
+}
+
+std::pair<int, int> PreprocessOptions::opencv_compression() const {
+    int f;
+    if (format == ImageFormat::JPEG) {
+        f = CV_IMWRITE_JPEG_QUALITY;
+    } else {
+        f = CV_IMWRITE_PNG_COMPRESSION;
+    }
+    return std::make_pair(f, compression);
+}
+
+std::string PreprocessOptions::extension() const {
+    std::vector<std::string> parts;
+    if (use_hist_eq) {
+        parts.push_back("clahe");
+    }
+    if (use_thresholding) {
+        parts.push_back("t");
+    }
+    if (add_border) {
+        parts.push_back("b");
+    }
+    if (parts.empty()) {
+        return "";
+    } else {
+        std::stringstream ss;
+        for(const auto & part : parts) {
+            ss << "." << part;
+        }
+        return ss.str();
+    }
+}
+
+bool PreprocessOptions::isOnThisNode(const std::string & image_path) const {
+    if (nb_nodes <= 1) {
+        return true;
+    }
+    const std::string filename = boost::filesystem::path(image_path).filename().string();
+    return fnv1aHash(filename) % nb_nodes == node_index;
+}
+
+void PreprocessOptions::print() const {
+    std::cout << "output-dir:       " << output_dir << std::endl;
+    std::cout << "use-hist-eq:      " << use_hist_eq << std::endl;
+    std::cout << "use-thresholding: " << use_thresholding << std::endl;
+    std::cout << "add-border:       " << add_border << std::endl;
+    std::cout << "read-threads:     " << nb_read_threads << std::endl;
+    std::cout << "threads:          " << nb_threads << std::endl;
+    std::cout << "write-threads:    " << nb_write_threads << std::endl;
+    std::cout << "queue-size:       " << queue_size << std::endl;
+    std::cout << "force:            " << force << std::endl;
+    if (shard_size > 0) {
+        std::cout << "shard-size:       " << shard_size / (1024*1024) << "MB" << std::endl;
+    }
+    std::cout << "simd:             " << use_simd;
+    if (use_simd) {
+        std::cout << " (" << simd_level_to_str(detectSimdLevel()) << ")";
+    }
+    std::cout << std::endl;
+    std::cout << "parallelism:      " << parallelism_to_str(parallelism);
+    if (pin_threads) {
+        std::cout << ", pinned threads";
+    }
+    std::cout << std::endl;
+    if (max_memory > 0) {
+        std::cout << "max-memory:       " << max_memory / (1024 * 1024) << "MB" << std::endl;
+    }
+    if (nb_nodes > 1) {
+        std::cout << "node:             " << node_index << "/" << nb_nodes << std::endl;
+    }
+    if (benchmark) {
+        std::cout << "benchmark-samples: " << benchmark_samples << std::endl;
+    }
+}
+
+void adaptiveTresholding(cv::Mat & mat, bool use_binary_image) {
+    cv::Mat mat_threshold(mat.rows, mat.cols, CV_8UC1);
+    cv::adaptiveThreshold(mat, mat_threshold, THRESHOLD_MAX_VALUE,
+                          cv::ADAPTIVE_THRESH_GAUSSIAN_C,
+                          cv::THRESH_BINARY, THRESHOLD_BLOCK_SIZE, 0);
+    if (use_binary_image) {
+        mat = mat_threshold;
+    } else {
+        cv::addWeighted(mat, WEIGHT_ORIGINAL, mat_threshold, WEIGHT_THRESHOLD, 0 /*gamma*/, mat);
+    }
+}
+
+void localHistogramEq(cv::Mat & mat) {
+    auto clahe = cv::createCLAHE(CLAHE_CLIP_LIMIT, CLAHE_TILE_SIZE);
+    cv::Mat image_clahe;
+    clahe->apply(mat, image_clahe);
+    mat = image_clahe;
+}
+
+void makeBorder(cv::Mat & mat) {
+    auto mat_with_border = cv::Mat(mat.rows + TAG_HEIGHT,
+                                   mat.cols + TAG_WIDTH, CV_8U);
+    cv::copyMakeBorder(mat, mat_with_border,
+                       TAG_HEIGHT / 2, TAG_HEIGHT / 2,
+                       TAG_WIDTH  / 2, TAG_WIDTH  / 2,
+                       cv::BORDER_REPLICATE | cv::BORDER_ISOLATED);
+    mat = mat_with_border;
+}
+
+void processImage(Image & img, const PreprocessOptions & opt) {
+    cv::Mat & mat = img.getCvMatRef();
+
+    if (opt.add_border) {
+        makeBorder(mat);
+    }
+    if (opt.use_hist_eq) {
+        localHistogramEq(mat);
+    }
+    if (opt.use_thresholding) {
+        adaptiveTresholding(mat, opt.use_binary_image);
+    }
+}
+
+// cv::addWeighted computes every pixel only from the two input pixels.
+// The thresholded image is either 0 or 255, so the blend reduces to two
+// lookup tables. They are filled by cv::addWeighted itself to get exactly
+// the same rounding.
+struct BlendTables {
+    uchar below[256];
+    uchar above[256];
+};
+
+static const BlendTables & blendTables() {
+    static const BlendTables tables = []() {
+        BlendTables t;
+        cv::Mat ramp(1, 256, CV_8U);
+        for(int i = 0; i < 256; i++) {
+            ramp.at<uchar>(0, i) = static_cast<uchar>(i);
+        }
+        cv::Mat zeros(1, 256, CV_8U, cv::Scalar(0));
+        cv::Mat maxs(1, 256, CV_8U, cv::Scalar(THRESHOLD_MAX_VALUE));
+        cv::Mat below, above;
+        cv::addWeighted(ramp, WEIGHT_ORIGINAL, zeros, WEIGHT_THRESHOLD, 0, below);
+        cv::addWeighted(ramp, WEIGHT_ORIGINAL, maxs, WEIGHT_THRESHOLD, 0, above);
+        std::copy(below.ptr<uchar>(), below.ptr<uchar>() + 256, t.below);
+        std::copy(above.ptr<uchar>(), above.ptr<uchar>() + 256, t.above);
+        return t;
+    }();
+    return tables;
+}
+
+// Computes the local mean exactly like cv::adaptiveThreshold does internally.
+static void gaussianLocalMean(const cv::Mat & src, ProcessingBuffers & buffers) {
+    const cv::Size block(THRESHOLD_BLOCK_SIZE, THRESHOLD_BLOCK_SIZE);
+#if CV_MAJOR_VERSION >= 3
+    src.convertTo(buffers.local_mean_float, CV_32F);
+    cv::GaussianBlur(buffers.local_mean_float, buffers.local_mean_float, block, 0, 0,
+                     cv::BORDER_REPLICATE | cv::BORDER_ISOLATED);
+    buffers.local_mean_float.convertTo(buffers.local_mean, src.type());
+#else
+    cv::GaussianBlur(src, buffers.local_mean, block, 0, 0, cv::BORDER_REPLICATE);
+#endif
+}
+
+// Fused cv::adaptiveThreshold with a delta of 0 and cv::addWeighted.
+// A pixel is set by the threshold if it is brighter than its local mean.
+static void thresholdAndBlend(const cv::Mat & src, cv::Mat & dst,
+                              bool use_binary_image, ProcessingBuffers & buffers) {
+    gaussianLocalMean(src, buffers);
+    dst.create(src.size(), CV_8U);
+    const BlendTables & tables = blendTables();
+    const uchar max_value = static_cast<uchar>(THRESHOLD_MAX_VALUE);
+    for(int y = 0; y < src.rows; y++) {
+        const uchar * s = src.ptr<uchar>(y);
+        const uchar * m = buffers.local_mean.ptr<uchar>(y);
+        uchar * d = dst.ptr<uchar>(y);
+        if (use_binary_image) {
+            for(int x = 0; x < src.cols; x++) {
+                d[x] = s[x] > m[x] ? max_value : 0;
+            }
+        } else {
+            for(int x = 0; x < src.cols; x++) {
+                d[x] = s[x] > m[x] ? tables.above[s[x]] : tables.below[s[x]];
+            }
+        }
+    }
+}
+
+void processImage(const cv::Mat & input, cv::Mat & output,
+                  const PreprocessOptions & opt,
+                  ProcessingBuffers & buffers) {
+    const cv::Mat * current = &input;
+    // every step writes directly into `output` if it is the last one
+    if (opt.add_border) {
+        cv::Mat & dst = (opt.use_hist_eq || opt.use_thresholding) ? buffers.bordered : output;
+        cv::copyMakeBorder(*current, dst,
+                           TAG_HEIGHT / 2, TAG_HEIGHT / 2,
+                           TAG_WIDTH  / 2, TAG_WIDTH  / 2,
+                           cv::BORDER_REPLICATE | cv::BORDER_ISOLATED);
+        current = &dst;
+    }
+    if (opt.use_hist_eq) {
+        cv::Mat & dst = opt.use_thresholding ? buffers.equalized : output;
+        if (opt.use_simd) {
+            claheSimd(*current, dst, CLAHE_CLIP_LIMIT, CLAHE_TILE_SIZE, buffers.simd);
+        } else {
+            if (buffers.clahe.empty()) {
+                buffers.clahe = cv::createCLAHE(CLAHE_CLIP_LIMIT, CLAHE_TILE_SIZE);
+            }
+            buffers.clahe->apply(*current, dst);
+        }
+        current = &dst;
+    }
+    if (opt.use_thresholding) {
+        if (opt.use_simd) {
+            gaussianLocalMeanSimd(*current, buffers.local_mean_float, THRESHOLD_BLOCK_SIZE, buffers.simd);
+            thresholdBlendSimd(*current, buffers.local_mean_float, output, THRESHOLD_MAX_VALUE,
+                               opt.use_binary_image, WEIGHT_ORIGINAL, WEIGHT_THRESHOLD);
+        } else {
+            thresholdAndBlend(*current, output, opt.use_binary_image, buffers);
+        }
+        current = &output;
+    }
+    if (current != &output) {
+        current->copyTo(output);
+    }
+}
+
+static size_t matBytes(const cv::Mat & mat) {
+    return mat.total() * mat.elemSize();
+}
+
+// Memory a processing thread holds: its scratch buffers and its output.
+static size_t threadBytes(const ProcessingBuffers & buffers, const cv::Mat & output) {
+    return matBytes(buffers.bordered) + matBytes(buffers.equalized) +
+           matBytes(buffers.local_mean) + matBytes(buffers.local_mean_float) +
+           matBytes(buffers.simd.horizontal) + matBytes(buffers.simd.clahe_extended) +
+           matBytes(buffers.simd.clahe_luts) + matBytes(output);
+}
+
+// Seconds `policy` takes to process `nb_frames` copies of `sample` on at
+// most `max_threads` frame threads.
+static double probeSeconds(const cv::Mat & sample, const PreprocessOptions & opt,
+                           const ThreadingPolicy & policy, size_t nb_frames,
+                           size_t max_threads) {
+    policy.apply();
+    const size_t nb_threads = std::min(policy.frameThreads(0), max_threads);
+    std::vector<ProcessingBuffers> buffers(nb_threads);
+    std::vector<cv::Mat> outputs(nb_threads);
+    auto process = [&](size_t, size_t t) {
+        processImage(sample, outputs.at(t), opt, buffers.at(t));
+    };
+    // the first frame of every thread allocates its buffers
+    parallelFor(nb_threads, nb_threads, process);
+    auto begin = std::chrono::steady_clock::now();
+    parallelFor(nb_frames, nb_threads, process);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+Parallelism probeParallelism(const cv::Mat & sample, const PreprocessOptions & opt) {
+    const ThreadingPolicy frames(Parallelism::Frames);
+    const ThreadingPolicy intra_frame(Parallelism::IntraFrame);
+    const size_t nb_frames = frames.nbCores();
+    // Every frame thread holds its own buffers, over 100MB for a frame of
+    // the cameras. The probe keeps to --max-memory like the run does.
+    size_t max_threads = nb_frames;
+    if (opt.max_memory > 0) {
+        ProcessingBuffers buffers;
+        cv::Mat output;
+        processImage(sample, output, opt, buffers);
+        const size_t available = opt.max_memory - std::min<size_t>(opt.max_memory, matBytes(sample));
+        const size_t per_thread = std::max<size_t>(threadBytes(buffers, output), 1);
+        max_threads = std::max<size_t>(std::min(max_threads, available / per_thread), 1);
+    }
+    const double frames_seconds = probeSeconds(sample, opt, frames, nb_frames, max_threads);
+    const double intra_frame_seconds = probeSeconds(sample, opt, intra_frame, nb_frames, max_threads);
+    std::cout << "Probe of " << nb_frames << " frames: " << frames_seconds << "s with frame parallelism ("
+              << std::min(frames.frameThreads(0), max_threads) << " threads), "
+              << intra_frame_seconds << "s with intra-frame parallelism." << std::endl;
+    return intra_frame_seconds < frames_seconds ? Parallelism::IntraFrame : Parallelism::Frames;
+}
+
+double psnr(const cv::Mat & a, const cv::Mat & b) {
+    double l2 = cv::norm(a, b, cv::NORM_L2);
+    if (l2 == 0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    double mse = l2*l2 / (a.total() * a.channels());
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+double ssim(const cv::Mat & a, const cv::Mat & b) {
+    static const double C1 = 6.5025;  // (0.01*255)^2
+    static const double C2 = 58.5225;  // (0.03*255)^2
+    static const cv::Size window(11, 11);
+    static const double sigma = 1.5;
+    cv::Mat x, y;
+    a.convertTo(x, CV_32F);
+    b.convertTo(y, CV_32F);
+    cv::Mat mu_x, mu_y;
+    cv::GaussianBlur(x, mu_x, window, sigma);
+    cv::GaussianBlur(y, mu_y, window, sigma);
+    cv::Mat mu_x_sq = mu_x.mul(mu_x);
+    cv::Mat mu_y_sq = mu_y.mul(mu_y);
+    cv::Mat mu_xy = mu_x.mul(mu_y);
+
+    cv::Mat sigma_x_sq, sigma_y_sq, sigma_xy;
+    cv::GaussianBlur(x.mul(x), sigma_x_sq, window, sigma);
+    sigma_x_sq -= mu_x_sq;
+    cv::GaussianBlur(y.mul(y), sigma_y_sq, window, sigma);
+    sigma_y_sq -= mu_y_sq;
+    cv::GaussianBlur(x.mul(y), sigma_xy, window, sigma);
+    sigma_xy -= mu_xy;
+
+    cv::Mat numerator = (2 * mu_xy + C1).mul(2 * sigma_xy + C2);
+    cv::Mat denominator = (mu_x_sq + mu_y_sq + C1).mul(sigma_x_sq + sigma_y_sq + C2);
+    cv::Mat ssim_map;
+    cv::divide(numerator, denominator, ssim_map);
+    return cv::mean(ssim_map)[0];
+}
+}
@@ -0,0 +1,362 @@
+
+#include "simd.h"
+
+#include <algorithm>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "utils.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   define DEEPLOCALIZER_X86_DISPATCH 1
+#   define SIMD_INLINE inline __attribute__((always_inline))
+#   define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#   define SIMD_INLINE inline
+#endif
+
+namespace deeplocalizer {
+
+std::string simd_level_to_str(SimdLevel level) {
+    switch(level) {
+        case SimdLevel::Scalar: return "scalar";
+        case SimdLevel::SSE42: return "sse4.2";
+        case SimdLevel::AVX2: return "avx2";
+        case SimdLevel::AVX512: return "avx512";
+    }
+    return "wrong";
+}
+
+SimdLevel detectSimdLevel() {
+#ifdef DEEPLOCALIZER_X86_DISPATCH
+    static const SimdLevel level = []() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+            return SimdLevel::AVX512;
+        }
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            return SimdLevel::AVX2;
+        }
+        if (__builtin_cpu_supports("sse4.2")) {
+            return SimdLevel::SSE42;
+        }
+        return SimdLevel::Scalar;
+    }();
+    return level;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+std::vector<SimdLevel> supportedSimdLevels() {
+    std::vector<SimdLevel> levels;
+    const SimdLevel best = detectSimdLevel();
+    for(SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512}) {
+        if (level <= best) {
+            levels.push_back(level);
+        }
+    }
+    return levels;
+}
+
+// The kernels are plain loops over contiguous, non-aliasing rows, which the
+// compiler vectorizes. They are inlined into one set of wrappers per
+// instruction set further below, each compiled for its target.
+
+// Rows are summed in blocks that stay in the L1 cache.
+static const int ROW_BLOCK = 1024;
+
+// dst[x] = sum_k weights[k] * srcs[k][x]
+SIMD_INLINE void weightedRowSumKernel(float * dst, const float * const * srcs,
+                                      const float * weights, int nb_weights, int n) {
+    for(int x0 = 0; x0 < n; x0 += ROW_BLOCK) {
+        const int len = std::min(ROW_BLOCK, n - x0);
+        float * __restrict d = dst + x0;
+        const float * __restrict s0 = srcs[0] + x0;
+        const float w0 = weights[0];
+        for(int i = 0; i < len; i++) {
+            d[i] = w0 * s0[i];
+        }
+        for(int k = 1; k < nb_weights; k++) {
+            const float * __restrict s = srcs[k] + x0;
+            const float w = weights[k];
+            for(int i = 0; i < len; i++) {
+                d[i] += w * s[i];
+            }
+        }
+    }
+}
+
+SIMD_INLINE void u8ToFloatKernel(const uchar * __restrict src, float * __restrict dst, int n) {
+    for(int i = 0; i < n; i++) {
+        dst[i] = src[i];
+    }
+}
+
+// `src > round(mean)` is `src - 0.5 > mean` for integer `src`.
+SIMD_INLINE void thresholdBlendKernel(const uchar * __restrict src, const float * __restrict mean,
+                                      uchar * __restrict dst, int n, float max_value, bool binary,
+                                      float weight_original, float weight_threshold) {
+    if (binary) {
+        const uchar max_u8 = cv::saturate_cast<uchar>(max_value);
+        for(int i = 0; i < n; i++) {
+            dst[i] = static_cast<float>(src[i]) - 0.5f > mean[i] ? max_u8 : 0;
+        }
+    } else {
+        // the 0.5 rounds the blend to the nearest integer
+        const float above = max_value * weight_threshold + 0.5f;
+        const float below = 0.5f;
+        for(int i = 0; i < n; i++) {
+            const float s = src[i];
+            float v = s * weight_original + (s - 0.5f > mean[i] ? above : below);
+            dst[i] = static_cast<uchar>(std::min(std::max(v, 0.f), 255.f));
+        }
+    }
+}
+
+// Bilinear interpolation between the lookup tables of the four tiles around
+// every pixel, like cv::CLAHE does it.
+SIMD_INLINE void claheInterpolateKernel(const uchar * __restrict src, uchar * __restrict dst, int n,
+                                        const uchar * lut1, const uchar * lut2,
+                                        const int * __restrict offsets_x1, const int * __restrict offsets_x2,
+                                        const float * __restrict weights_x, float weight_y) {
+    const float weight_y1 = 1.0f - weight_y;
+    for(int x = 0; x < n; x++) {
+        const int v = src[x];
+        const float xa = weights_x[x];
+        const float xa1 = 1.0f - xa;
+        const int i1 = offsets_x1[x] + v;
+        const int i2 = offsets_x2[x] + v;
+        float res = (lut1[i1] * xa1 + lut1[i2] * xa) * weight_y1 +
+                    (lut2[i1] * xa1 + lut2[i2] * xa) * weight_y;
+        dst[x] = static_cast<uchar>(std::min(std::max(res + 0.5f, 0.f), 255.f));
+    }
+}
+
+struct Kernels {
+    void (*weightedRowSum)(float *, const float * const *, const float *, int, int);
+    void (*u8ToFloat)(const uchar *, float *, int);
+    void (*thresholdBlend)(const uchar *, const float *, uchar *, int, float, bool, float, float);
+    void (*claheInterpolate)(const uchar *, uchar *, int, const uchar *, const uchar *,
+                             const int *, const int *, const float *, float);
+};
+
+#define DEFINE_KERNELS(NAME, TARGET) \
+    TARGET static void NAME##WeightedRowSum(float * dst, const float * const * srcs, \
+                                            const float * weights, int nb_weights, int n) { \
+        weightedRowSumKernel(dst, srcs, weights, nb_weights, n); \
+    } \
+    TARGET static void NAME##U8ToFloat(const uchar * src, float * dst, int n) { \
+        u8ToFloatKernel(src, dst, n); \
+    } \
+    TARGET static void NAME##ThresholdBlend(const uchar * src, const float * mean, uchar * dst, int n, \
+                                            float max_value, bool binary, \
+                                            float weight_original, float weight_threshold) { \
+        thresholdBlendKernel(src, mean, dst, n, max_value, binary, weight_original, weight_threshold); \
+    } \
+    TARGET static void NAME##ClaheInterpolate(const uchar * src, uchar * dst, int n, \
+                                              const uchar * lut1, const uchar * lut2, \
+                                              const int * offsets_x1, const int * offsets_x2, \
+                                              const float * weights_x, float weight_y) { \
+        claheInterpolateKernel(src, dst, n, lut1, lut2, offsets_x1, offsets_x2, weights_x, weight_y); \
+    } \
+    static const Kernels NAME##_kernels = { \
+        &NAME##WeightedRowSum, &NAME##U8ToFloat, &NAME##ThresholdBlend, &NAME##ClaheInterpolate \
+    };
+
+DEFINE_KERNELS(scalar, )
+#ifdef DEEPLOCALIZER_X86_DISPATCH
+DEFINE_KERNELS(sse42, SIMD_TARGET("sse4.2"))
+DEFINE_KERNELS(avx2, SIMD_TARGET("avx2,fma"))
+DEFINE_KERNELS(avx512, SIMD_TARGET("avx512f,avx512bw,avx2,fma"))
+#endif
+
+// Levels the CPU does not support fall back to the best supported one.
+static const Kernels & kernelsFor(SimdLevel level) {
+    level = std::min(level, detectSimdLevel());
+#ifdef DEEPLOCALIZER_X86_DISPATCH
+    switch(level) {
+        case SimdLevel::AVX512: return avx512_kernels;
+        case SimdLevel::AVX2: return avx2_kernels;
+        case SimdLevel::SSE42: return sse42_kernels;
+        case SimdLevel::Scalar: return scalar_kernels;
+    }
+#endif
+    return scalar_kernels;
+}
+
+void gaussianLocalMeanSimd(const cv::Mat & src, cv::Mat & mean, int block_size,
+                           SimdBuffers & buffers, SimdLevel level) {
+    ASSERT(src.type() == CV_8U, "Expected an 8 bit grayscale image.");
+    ASSERT(block_size % 2 == 1, "Block size must be odd.");
+    const Kernels & kernels = kernelsFor(level);
+    // the kernel cv::adaptiveThreshold uses
+    static thread_local cv::Mat gaussian;
+    if (gaussian.rows != block_size) {
+        gaussian = cv::getGaussianKernel(block_size, 0, CV_32F);
+    }
+    const float * weights = gaussian.ptr<float>();
+    const int radius = block_size / 2;
+    const int rows = src.rows;
+    const int cols = src.cols;
+    mean.create(src.size(), CV_32F);
+    buffers.horizontal.create(src.size(), CV_32F);
+    buffers.padded_row.resize(cols + 2*radius);
+    buffers.rows.resize(block_size);
+
+    float * padded = buffers.padded_row.data();
+    for(int k = 0; k < block_size; k++) {
+        buffers.rows[k] = padded + k;
+    }
+    for(int y = 0; y < rows; y++) {
+        kernels.u8ToFloat(src.ptr<uchar>(y), padded + radius, cols);
+        std::fill(padded, padded + radius, padded[radius]);
+        std::fill(padded + radius + cols, padded + 2*radius + cols, padded[radius + cols - 1]);
+        kernels.weightedRowSum(buffers.horizontal.ptr<float>(y), buffers.rows.data(),
+                               weights, block_size, cols);
+    }
+    for(int y = 0; y < rows; y++) {
+        for(int k = 0; k < block_size; k++) {
+            int row = std::min(std::max(y + k - radius, 0), rows - 1);
+            buffers.rows[k] = buffers.horizontal.ptr<float>(row);
+        }
+        kernels.weightedRowSum(mean.ptr<float>(y), buffers.rows.data(), weights, block_size, cols);
+    }
+}
+
+void thresholdBlendSimd(const cv::Mat & src, const cv::Mat & mean, cv::Mat & dst,
+                        double max_value, bool binary,
+                        double weight_original, double weight_threshold,
+                        SimdLevel level) {
+    ASSERT(src.type() == CV_8U && mean.type() == CV_32F && src.size() == mean.size(),
+           "Expected an 8 bit image and its 32 bit float local mean.");
+    const Kernels & kernels = kernelsFor(level);
+    dst.create(src.size(), CV_8U);
+    for(int y = 0; y < src.rows; y++) {
+        kernels.thresholdBlend(src.ptr<uchar>(y), mean.ptr<float>(y), dst.ptr<uchar>(y), src.cols,
+                               static_cast<float>(max_value), binary,
+                               static_cast<float>(weight_original),
+                               static_cast<float>(weight_threshold));
+    }
+}
+
+static const int HIST_SIZE = 256;
+
+// Clips the histogram and redistributes the clipped counts over all bins
+// exactly like cv::CLAHE.
+static void clipHistogram(int * hist, int clip_limit) {
+    int clipped = 0;
+    for(int i = 0; i < HIST_SIZE; i++) {
+        if (hist[i] > clip_limit) {
+            clipped += hist[i] - clip_limit;
+            hist[i] = clip_limit;
+        }
+    }
+    const int redist_batch = clipped / HIST_SIZE;
+    int residual = clipped - redist_batch * HIST_SIZE;
+    for(int i = 0; i < HIST_SIZE; i++) {
+        hist[i] += redist_batch;
+    }
+    if (residual != 0) {
+        const int residual_step = std::max(HIST_SIZE / residual, 1);
+        for(int i = 0; i < HIST_SIZE && residual > 0; i += residual_step, residual--) {
+            hist[i]++;
+        }
+    }
+}
+
+// Histogram of a tile. Consecutive pixels go to four separate histograms,
+// so equal neighbours do not have to wait on each other's increment.
+static void tileHistogram(const cv::Mat & tile, int * hist) {
+    int partial[4][HIST_SIZE] = {};
+    for(int y = 0; y < tile.rows; y++) {
+        const uchar * row = tile.ptr<uchar>(y);
+        int x = 0;
+        for(; x + 4 <= tile.cols; x += 4) {
+            partial[0][row[x]]++;
+            partial[1][row[x + 1]]++;
+            partial[2][row[x + 2]]++;
+            partial[3][row[x + 3]]++;
+        }
+        for(; x < tile.cols; x++) {
+            partial[0][row[x]]++;
+        }
+    }
+    for(int i = 0; i < HIST_SIZE; i++) {
+        hist[i] = partial[0][i] + partial[1][i] + partial[2][i] + partial[3][i];
+    }
+}
+
+void claheSimd(const cv::Mat & src, cv::Mat & dst, double clip_limit, cv::Size tile_grid,
+               SimdBuffers & buffers, SimdLevel level) {
+    ASSERT(src.type() == CV_8U, "Expected an 8 bit grayscale image.");
+    const Kernels & kernels = kernelsFor(level);
+    const int tiles_x = tile_grid.width;
+    const int tiles_y = tile_grid.height;
+    // like cv::CLAHE, the lookup tables come from an image extended to a
+    // multiple of the tile grid
+    cv::Mat src_for_lut = src;
+    if (src.cols % tiles_x != 0 || src.rows % tiles_y != 0) {
+        cv::copyMakeBorder(src, buffers.clahe_extended,
+                           0, tiles_y - (src.rows % tiles_y),
+                           0, tiles_x - (src.cols % tiles_x), cv::BORDER_REFLECT_101);
+        src_for_lut = buffers.clahe_extended;
+    }
+    const cv::Size tile_size(src_for_lut.cols / tiles_x, src_for_lut.rows / tiles_y);
+    const int tile_area = tile_size.area();
+    const float lut_scale = static_cast<float>(HIST_SIZE - 1) / tile_area;
+    int clip = 0;
+    if (clip_limit > 0) {
+        clip = std::max(static_cast<int>(clip_limit * tile_area / HIST_SIZE), 1);
+    }
+
+    buffers.clahe_luts.create(tiles_x * tiles_y, HIST_SIZE, CV_8U);
+    int hist[HIST_SIZE];
+    for(int ty = 0; ty < tiles_y; ty++) {
+        for(int tx = 0; tx < tiles_x; tx++) {
+            cv::Rect tile_rect(tx * tile_size.width, ty * tile_size.height,
+                               tile_size.width, tile_size.height);
+            tileHistogram(src_for_lut(tile_rect), hist);
+            if (clip > 0) {
+                clipHistogram(hist, clip);
+            }
+            uchar * lut = buffers.clahe_luts.ptr<uchar>(ty * tiles_x + tx);
+            int sum = 0;
+            for(int i = 0; i < HIST_SIZE; i++) {
+                sum += hist[i];
+                lut[i] = cv::saturate_cast<uchar>(sum * lut_scale);
+            }
+        }
+    }
+
+    const float inv_tw = 1.0f / tile_size.width;
+    const float inv_th = 1.0f / tile_size.height;
+    buffers.lut_offsets_x1.resize(src.cols);
+    buffers.lut_offsets_x2.resize(src.cols);
+    buffers.weights_x.resize(src.cols);
+    for(int x = 0; x < src.cols; x++) {
+        float txf = x * inv_tw - 0.5f;
+        int tx1 = cvFloor(txf);
+        int tx2 = tx1 + 1;
+        buffers.weights_x[x] = txf - tx1;
+        tx1 = std::max(tx1, 0);
+        tx2 = std::min(tx2, tiles_x - 1);
+        buffers.lut_offsets_x1[x] = tx1 * HIST_SIZE;
+        buffers.lut_offsets_x2[x] = tx2 * HIST_SIZE;
+    }
+    dst.create(src.size(), CV_8U);
+    for(int y = 0; y < src.rows; y++) {
+        float tyf = y * inv_th - 0.5f;
+        int ty1 = cvFloor(tyf);
+        int ty2 = ty1 + 1;
+        float weight_y = tyf - ty1;
+        ty1 = std::max(ty1, 0);
+        ty2 = std::min(ty2, tiles_y - 1);
+        kernels.claheInterpolate(src.ptr<uchar>(y), dst.ptr<uchar>(y), src.cols,
+                                 buffers.clahe_luts.ptr<uchar>(ty1 * tiles_x),
+                                 buffers.clahe_luts.ptr<uchar>(ty2 * tiles_x),
+                                 buffers.lut_offsets_x1.data(), buffers.lut_offsets_x2.data(),
+                                 buffers.weights_x.data(), weight_y);
+    }
+}
+}
@@ -2,6 +2,7 @@
 #include "ManuallyTaggerWindow.h"
 #include "Image.h"
 #include "qt_helper.h"
+#include "ThreadingPolicy.h"
 #include <QApplication>
 #include "utils.h"
 #include <boost/program_options.hpp>
@@ -28,14 +29,10 @@ int run(QApplication & qapp, std::string pathfile) {
         window = std::make_unique<ManuallyTaggerWindow>(std::move(tagger));
     } else {
         const auto filenames = parsePathfile(pathfile);
+        // the tagger loads the proposals of an image when it is opened
         std::vector<ImageDescPtr> img_desc;
         for(const auto & fname : filenames) {
-            auto proposal_name = fname + ".proposal.json";
-            if (io::exists(proposal_name)) {
-                img_desc.push_back(ImageDesc::load(proposal_name));
-            } else {
-                img_desc.push_back(std::make_shared<ImageDesc>(fname));
-            }
+            img_desc.push_back(std::make_shared<ImageDesc>(fname));
         }
         window = std::make_unique<ManuallyTaggerWindow>(std::move(img_desc));
     }
@@ -52,6 +49,8 @@ int main(int argc, char* argv[])
 {
     QApplication qapp(argc, argv);
     deeplocalizer::registerQMetaTypes();
+    // the tagger decodes several images at once, each on a single thread
+    setProcessPolicy(ThreadingPolicy(Parallelism::Frames));
     setupOptions();
     po::variables_map vm;
     po::store(po::command_line_parser(argc, argv).options(desc_option)
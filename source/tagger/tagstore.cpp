@@ -0,0 +1,196 @@
+#include <boost/program_options.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+
+#include "Image.h"
+#include "PathfileReader.h"
+#include "TagStore.h"
+#include "TagTable.h"
+#include "ThreadingPolicy.h"
+#include "parallel.h"
+#include "utils.h"
+
+using namespace deeplocalizer;
+using namespace std::chrono;
+namespace po = boost::program_options;
+namespace io = boost::filesystem;
+
+po::options_description desc_option("Options");
+po::positional_options_description positional_opt;
+
+void setupOptions() {
+    desc_option.add_options()
+            ("help,h", "Print help messages")
+            ("command",     po::value<std::string>(), "`import`, `export` or `stats`")
+            ("store",       po::value<std::string>(), "The tag store file, e.g. tags.tags")
+            ("pathfile",    po::value<std::string>(), "File with image paths. Only needed for `import`")
+            ("extension,e", po::value<std::string>()->default_value("tagger.json"),
+                 "Extension of the JSON files next to the images")
+            ("threads,j",   po::value<size_t>()->default_value(0),
+                 "Number of threads parsing or writing JSON files. Default is the number of cores")
+            ("min-vote",    po::value<int>()->default_value(0),
+                 "`stats` also counts the tags whose ellipse has at least this vote");
+    positional_opt.add("command", 1);
+    positional_opt.add("store", 1);
+    positional_opt.add("pathfile", 1);
+}
+
+void printUsage() {
+    std::cout << "Usage: bb_tagstore import STORE PATHFILE" << std::endl;
+    std::cout << "           Adds the JSON files of the images in PATHFILE to STORE." << std::endl;
+    std::cout << "       bb_tagstore export STORE" << std::endl;
+    std::cout << "           Writes a JSON file next to every image of STORE." << std::endl;
+    std::cout << "       bb_tagstore stats STORE" << std::endl;
+    std::cout << "           Counts the images and tags of STORE." << std::endl;
+    std::cout << desc_option << std::endl;
+}
+
+// at most this many failed images are listed
+static const size_t MAX_LISTED_ERRORS = 10;
+
+// Collects the errors of the images of a parallelFor, by index.
+class ItemErrors {
+public:
+    explicit ItemErrors(size_t n) : _messages(n) {}
+
+    template<typename Fn>
+    void run(size_t i, Fn fn) {
+        try {
+            fn();
+        } catch(const std::string & msg) {
+            _messages.at(i) = msg;
+        } catch(const std::exception & e) {
+            _messages.at(i) = e.what();
+        } catch(...) {
+            // nothing may escape the worker thread
+            _messages.at(i) = "Unknown error.";
+        }
+    }
+    // Prints the failed images to stderr. Returns their number.
+    template<typename NameFn>
+    size_t report(const std::string & action, NameFn name) const {
+        std::vector<LoadError> failed;
+        for(size_t i = 0; i < _messages.size(); i++) {
+            if (not _messages.at(i).empty()) {
+                failed.push_back(LoadError{name(i), _messages.at(i)});
+            }
+        }
+        if (failed.empty()) {
+            return 0;
+        }
+        std::cerr << "Could not " << action << " " << failed.size() << " of "
+                  << _messages.size() << " images:" << std::endl;
+        for(size_t i = 0; i < std::min(failed.size(), MAX_LISTED_ERRORS); i++) {
+            std::cerr << "    " << failed.at(i).path << ": " << failed.at(i).message << std::endl;
+        }
+        return failed.size();
+    }
+private:
+    std::vector<std::string> _messages;
+};
+
+// Images without a JSON file are skipped.
+int importTags(const io::path & store_path, const std::string & pathfile,
+               const std::string & extension, size_t nb_threads) {
+    const std::vector<std::string> paths = PathfileReader(pathfile).readAll();
+    TagStoreWriter store(store_path);
+    std::atomic<size_t> nb_imported{0};
+    std::atomic<size_t> nb_done{0};
+    auto start_time = system_clock::now();
+    ItemErrors errors(paths.size());
+    parallelFor(paths.size(), nb_threads, [&](size_t i, size_t) {
+        errors.run(i, [&]() {
+            ImageDesc desc(paths.at(i));
+            desc.setSavePathExtension(extension);
+            if (io::exists(desc.savePath())) {
+                auto loaded = ImageDesc::load(desc.savePath());
+                loaded->filename = desc.filename;
+                loaded->save(store);
+                nb_imported++;
+            }
+        });
+        size_t done = ++nb_done;
+        if (done % 1000 == 0) {
+            printProgress(start_time, static_cast<double>(done) / paths.size());
+        }
+    }, 16);
+    store.save();
+    std::cout << std::endl;
+    const size_t nb_failed = errors.report("import", [&](size_t i) { return paths.at(i); });
+    std::cout << "Imported " << nb_imported << " of " << paths.size()
+              << " images. The store has " << store.size() << " images: " << store_path.string() << std::endl;
+    return nb_failed > 0 ? 1 : 0;
+}
+
+int exportTags(const io::path & store_path, const std::string & extension, size_t nb_threads) {
+    TagStore store(store_path);
+    std::atomic<size_t> nb_done{0};
+    auto start_time = system_clock::now();
+    ItemErrors errors(store.size());
+    parallelFor(store.size(), nb_threads, [&](size_t i, size_t) {
+        errors.run(i, [&]() {
+            ImageDesc desc = store.at(i);
+            desc.setSavePathExtension(extension);
+            desc.save();
+        });
+        size_t done = ++nb_done;
+        if (done % 1000 == 0) {
+            printProgress(start_time, static_cast<double>(done) / store.size());
+        }
+    }, 16);
+    std::cout << std::endl;
+    const size_t nb_failed = errors.report("export", [&](size_t i) {
+        try {
+            return store.filename(i);
+        } catch(...) {
+            // the record itself may be corrupt
+            return "record " + std::to_string(i);
+        }
+    });
+    std::cout << "Exported " << store.size() - nb_failed << " of "
+              << store.size() << " images." << std::endl;
+    return nb_failed > 0 ? 1 : 0;
+}
+
+int printStats(const io::path & store_path, int min_vote) {
+    const TagTable table = TagTable::fromStore(TagStore(store_path));
+    const auto voted = table.withVote(min_vote);
+    std::cout << "images: " << table.nbImages() << std::endl
+              << "tags: " << table.size() << std::endl
+              << "  istag: " << table.withType(IsTag).size() << std::endl
+              << "  notag: " << table.withType(NoTag).size() << std::endl
+              << "  exclude: " << table.withType(Exclude).size() << std::endl
+              << "  bee_without_tag: " << table.withType(BeeWithoutTag).size() << std::endl
+              << "with vote >= " << min_vote << ": " << voted.size()
+              << ", of them istag: " << table.withType(voted, IsTag).size() << std::endl
+              << "memory of the tag table: " << table.memoryUsage() / (1024. * 1024.) << " MB" << std::endl;
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setupOptions();
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc_option)
+                      .positional(positional_opt).run(), vm);
+    po::notify(vm);
+    if (vm.count("help") || not vm.count("command") || not vm.count("store")) {
+        printUsage();
+        return 0;
+    }
+    const std::string command = vm.at("command").as<std::string>();
+    const io::path store = vm.at("store").as<std::string>();
+    const std::string extension = vm.at("extension").as<std::string>();
+    const size_t nb_threads = processPolicy().workerThreads(vm.at("threads").as<size_t>());
+    if (command == "import" && vm.count("pathfile")) {
+        return importTags(store, vm.at("pathfile").as<std::string>(), extension, nb_threads);
+    } else if (command == "export") {
+        return exportTags(store, extension, nb_threads);
+    } else if (command == "stats") {
+        return printStats(store, vm.at("min-vote").as<int>());
+    }
+    printUsage();
+    return 1;
+}
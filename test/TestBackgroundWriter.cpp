@@ -0,0 +1,80 @@
+#include "BackgroundWriter.h"
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+using namespace deeplocalizer;
+
+TEST_CASE( "BackgroundWriter", "[BackgroundWriter]" ) {
+    SECTION( "runs the jobs in order" ) {
+        std::vector<int> order;
+        {
+            BackgroundWriter writer;
+            for(int i = 0; i < 100; i++) {
+                writer.submit([&order, i]() { order.push_back(i); });
+            }
+        }
+        REQUIRE(order.size() == 100);
+        for(int i = 0; i < 100; i++) {
+            REQUIRE(order.at(i) == i);
+        }
+    }
+    SECTION( "flush waits for the jobs" ) {
+        BackgroundWriter writer;
+        std::atomic<bool> done{false};
+        writer.submit([&done]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            done = true;
+        });
+        writer.flush();
+        REQUIRE(done);
+        REQUIRE(writer.pending() == 0);
+    }
+    SECTION( "coalesces queued jobs with the same key" ) {
+        std::promise<void> started;
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        std::vector<std::string> order;
+        BackgroundWriter writer;
+        writer.submit("snapshot", [&order, &started, released]() {
+            started.set_value();
+            released.wait();
+            order.push_back("first snapshot");
+        });
+        // a running job is not dropped
+        started.get_future().wait();
+        writer.submit("snapshot", [&order]() { order.push_back("second snapshot"); });
+        writer.submit([&order]() { order.push_back("journal"); });
+        writer.submit("snapshot", [&order]() { order.push_back("third snapshot"); });
+        REQUIRE(writer.coalesced() == 1);
+        release.set_value();
+        writer.flush();
+        const std::vector<std::string> expected{"first snapshot", "journal", "third snapshot"};
+        REQUIRE(order == expected);
+    }
+    SECTION( "reports errors through the callback" ) {
+        std::vector<std::string> keys;
+        std::vector<boost::optional<std::string>> errors;
+        {
+            BackgroundWriter writer([&](const std::string & key,
+                                        const boost::optional<std::string> & error) {
+                keys.push_back(key);
+                errors.push_back(error);
+            });
+            writer.submit("ok", []() {});
+            writer.submit("fails", []() { throw std::string("disk full"); });
+            writer.submit([]() {});
+        }
+        const std::vector<std::string> expected{"ok", "fails", ""};
+        REQUIRE(keys == expected);
+        REQUIRE(not errors.at(0));
+        REQUIRE((errors.at(1) == std::string("disk full")));
+        REQUIRE(not errors.at(2));
+    }
+}
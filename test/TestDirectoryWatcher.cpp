@@ -0,0 +1,69 @@
+
+#include "DirectoryWatcher.h"
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <fstream>
+#include <future>
+
+using namespace deeplocalizer;
+
+namespace io = boost::filesystem;
+
+#ifdef __linux__
+void touch(const io::path & path) {
+    std::ofstream os(path.string());
+    os << "content";
+}
+
+TEST_CASE( "DirectoryWatcher", "[DirectoryWatcher]" ) {
+    io::path dir = io::unique_path("/tmp/test_watch_%%%%%%%%");
+    io::create_directories(dir);
+    touch(dir / "Cam_0_b.jpeg");
+    touch(dir / "Cam_0_a.jpeg");
+    touch(dir / "notes.txt");
+    std::vector<std::string> paths;
+    {
+        DirectoryWatcher watcher(dir);
+        GIVEN( "images already in the directory" ) {
+            THEN( "they are reported first, sorted by name" ) {
+                REQUIRE(watcher.next(10, paths) == 0);
+                REQUIRE(paths == std::vector<std::string>({
+                        (dir / "Cam_0_a.jpeg").string(), (dir / "Cam_0_b.jpeg").string()}));
+            }
+        }
+        GIVEN( "new files written to the directory" ) {
+            watcher.next(10, paths);
+            touch(dir / "other.txt");
+            touch(dir / "Cam_1_c.jpeg");
+            THEN( "only the images are reported" ) {
+                REQUIRE(watcher.next(10, paths) == 2);
+                REQUIRE(paths == std::vector<std::string>({(dir / "Cam_1_c.jpeg").string()}));
+                REQUIRE(watcher.nbRead() == 3);
+            }
+        }
+        GIVEN( "a watcher waiting for new images" ) {
+            watcher.next(10, paths);
+            auto waiting = std::async(std::launch::async, [&]() {
+                std::vector<std::string> new_paths;
+                return watcher.next(10, new_paths);
+            });
+            THEN( "the number of read images can be queried meanwhile" ) {
+                const size_t nb_read = watcher.nbRead();
+                watcher.stop();
+                REQUIRE(nb_read == 2);
+                REQUIRE(waiting.get() == 2);
+            }
+        }
+        GIVEN( "a stopped watcher" ) {
+            watcher.stop();
+            THEN( "no paths are reported" ) {
+                REQUIRE(watcher.next(10, paths) == 0);
+                REQUIRE(paths.empty());
+            }
+        }
+    }
+    io::remove_all(dir);
+}
+#endif
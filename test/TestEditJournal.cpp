@@ -0,0 +1,99 @@
+#include "EditJournal.h"
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+
+using namespace deeplocalizer;
+
+namespace io = boost::filesystem;
+
+static JournalEvent tagEvent(JournalEvent::Kind kind, const std::string & image, int x) {
+    Tag tag = Tag::fromCenter(cv::Point2i(x, 2 * x));
+    tag.setType(TagType::Exclude);
+    return JournalEvent{kind, image, tag};
+}
+
+static void requireEqual(const JournalEvent & a, const JournalEvent & b) {
+    REQUIRE(a.kind == b.kind);
+    REQUIRE(a.image == b.image);
+    REQUIRE((a.tag == b.tag));
+}
+
+TEST_CASE( "EditJournal", "[journal]" ) {
+    io::path dir = io::unique_path("/tmp/test_journal_%%%%%%%%");
+    io::create_directories(dir);
+    const std::string path = (dir / "progress.json.journal").string();
+    std::vector<JournalEvent> events{
+        tagEvent(JournalEvent::AddTag, "a.jpeg", 100),
+        tagEvent(JournalEvent::SetTagType, "a.jpeg", 100),
+        tagEvent(JournalEvent::EraseTag, "b.jpeg", 300),
+        JournalEvent{JournalEvent::Done, "a.jpeg", boost::none},
+    };
+
+    SECTION( "events are written in batches" ) {
+        EditJournal journal(path, 3);
+        for(size_t i = 0; i < 3; i++) {
+            journal.append(events.at(i));
+        }
+        REQUIRE(EditJournal::read(path).size() == 3);
+        journal.append(events.at(3));
+        REQUIRE(EditJournal::read(path).size() == 3);
+        journal.flush();
+        auto read = EditJournal::read(path);
+        REQUIRE(read.size() == 4);
+        for(size_t i = 0; i < events.size(); i++) {
+            requireEqual(read.at(i), events.at(i));
+        }
+    }
+    SECTION( "the destructor flushes" ) {
+        {
+            EditJournal journal(path);
+            journal.append(events.at(0));
+        }
+        REQUIRE(EditJournal::read(path).size() == 1);
+    }
+    SECTION( "rotated events are read until the compaction finishes" ) {
+        EditJournal journal(path);
+        journal.append(events.at(0));
+        journal.append(events.at(1));
+        journal.rotate();
+        REQUIRE(journal.size() == 0);
+        journal.append(events.at(2));
+        journal.flush();
+        auto read = EditJournal::read(path);
+        REQUIRE(read.size() == 3);
+        requireEqual(read.at(0), events.at(0));
+        requireEqual(read.at(2), events.at(2));
+
+        // a second rotation before the first compaction finished
+        journal.rotate();
+        REQUIRE(not io::exists(path));
+        REQUIRE(EditJournal::read(path).size() == 3);
+
+        EditJournal::finishCompaction(path);
+        REQUIRE(EditJournal::read(path).empty());
+    }
+    SECTION( "a torn last line is skipped" ) {
+        {
+            EditJournal journal(path);
+            journal.append(events.at(0));
+        }
+        {
+            std::ofstream os(path, std::ios::app);
+            os << events.at(1).to_json().dump().substr(0, 20);
+        }
+        REQUIRE(EditJournal::read(path).size() == 1);
+        {
+            EditJournal journal(path);
+            journal.append(events.at(2));
+        }
+        auto read = EditJournal::read(path);
+        REQUIRE(read.size() == 2);
+        requireEqual(read.at(1), events.at(2));
+    }
+    io::remove_all(dir);
+}
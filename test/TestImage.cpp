@@ -45,3 +45,41 @@ TEST_CASE( "ImageDesc", "[ImageDesc]" ) {
         io::remove(uniquePath);
     }
 }
+
+TEST_CASE( "ImageDesc::fromPaths", "[ImageDesc]" ) {
+    io::path dir = io::unique_path("/tmp/test_from_paths_%%%%%%%%");
+    io::create_directories(dir);
+    std::vector<std::string> paths;
+    for(size_t i = 0; i < 50; i++) {
+        std::string path = (dir / ("image_" + std::to_string(i) + ".jpeg")).string();
+        std::ofstream(path) << "not really an image";
+        ImageDesc desc(path, {Tag(cv::Rect(10 * i, 20, TAG_WIDTH, TAG_HEIGHT))});
+        desc.setSavePathExtension("desc");
+        desc.save();
+        paths.push_back(path);
+    }
+    SECTION( "keeps the order of the paths" ) {
+        auto descs = ImageDesc::fromPaths(paths, "desc", nullptr, 4);
+        REQUIRE(descs.size() == paths.size());
+        for(size_t i = 0; i < paths.size(); i++) {
+            REQUIRE(descs.at(i).filename == paths.at(i));
+            REQUIRE(descs.at(i).getTags().at(0).getBoundingBox().x == static_cast<int>(10 * i));
+        }
+    }
+    SECTION( "collects all errors" ) {
+        std::ofstream(paths.at(3) + ".desc") << "{ broken json";
+        std::ofstream(paths.at(5) + ".desc")
+            << R"({"filename": "image_5.jpeg", "tags": [{"x": 50, "y": 50, "tagtype": "bogus"}]})";
+        paths.insert(paths.begin() + 10, (dir / "missing.jpeg").string());
+        std::vector<LoadError> errors;
+        auto descs = ImageDesc::fromPaths(paths, "desc", &errors, 4);
+        REQUIRE(descs.size() == paths.size() - 3);
+        REQUIRE(errors.size() == 3);
+        REQUIRE(errors.at(0).path == paths.at(3));
+        REQUIRE(errors.at(1).path == paths.at(5));
+        REQUIRE(errors.at(1).message.find("unknown tag type bogus") != std::string::npos);
+        REQUIRE(errors.at(2).path == paths.at(10));
+        REQUIRE_THROWS(ImageDesc::fromPaths(paths, "desc"));
+    }
+    io::remove_all(dir);
+}
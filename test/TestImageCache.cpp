@@ -0,0 +1,144 @@
+#include "ImageCache.h"
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <future>
+#include <thread>
+
+using namespace deeplocalizer;
+
+// A loader that makes 10x10 images of 100 bytes and counts its calls.
+struct FakeLoader {
+    std::atomic<int> * calls;
+    int delay_ms;
+    ImagePtr operator()(const std::string & filename) {
+        (*calls)++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+        if (filename == "missing.jpeg") {
+            throw std::string("Cannot open file: ") + filename;
+        }
+        return std::make_shared<Image>(filename, cv::Mat(10, 10, CV_8U, cv::Scalar(0)));
+    }
+};
+
+// A loader that blocks until `release` is ready, so a test can act while
+// an image is being decoded. Signals `started` when it is called.
+struct BlockingLoader {
+    std::promise<void> * started;
+    std::shared_future<void> release;
+    ImagePtr operator()(const std::string & filename) {
+        started->set_value();
+        release.wait();
+        return std::make_shared<Image>(filename, cv::Mat(10, 10, CV_8U, cv::Scalar(0)));
+    }
+};
+
+static void waitForPrefetch(const ImageCache & cache, size_t n) {
+    for(int i = 0; i < 500 && cache.stats().prefetched < n; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+}
+
+TEST_CASE( "ImageCache", "[ImageCache]" ) {
+    std::atomic<int> calls{0};
+    SECTION( "get decodes once and then hits the cache" ) {
+        ImageCache cache(1000, FakeLoader{&calls, 0});
+        auto first = cache.get("a.jpeg");
+        auto second = cache.get("a.jpeg");
+        REQUIRE(first == second);
+        REQUIRE(first->filename() == "a.jpeg");
+        REQUIRE(calls == 1);
+        REQUIRE(cache.stats().hits == 1);
+        REQUIRE(cache.stats().misses == 1);
+        REQUIRE(cache.usedBytes() == 100);
+    }
+    SECTION( "evicts the least recently used images" ) {
+        ImageCache cache(250, FakeLoader{&calls, 0});
+        cache.get("a.jpeg");
+        cache.get("b.jpeg");
+        cache.get("a.jpeg");
+        cache.get("c.jpeg");
+        REQUIRE(cache.contains("a.jpeg"));
+        REQUIRE_FALSE(cache.contains("b.jpeg"));
+        REQUIRE(cache.contains("c.jpeg"));
+        REQUIRE(cache.usedBytes() == 200);
+        REQUIRE(cache.stats().evictions == 1);
+    }
+    SECTION( "keeps an image larger than the limit" ) {
+        ImageCache cache(50, FakeLoader{&calls, 0});
+        cache.get("a.jpeg");
+        cache.get("b.jpeg");
+        REQUIRE_FALSE(cache.contains("a.jpeg"));
+        REQUIRE(cache.contains("b.jpeg"));
+    }
+    SECTION( "prefetched images are hits" ) {
+        ImageCache cache(1000, FakeLoader{&calls, 0});
+        cache.prefetch({"a.jpeg", "b.jpeg"});
+        waitForPrefetch(cache, 2);
+        REQUIRE(cache.contains("a.jpeg"));
+        REQUIRE(cache.contains("b.jpeg"));
+        cache.get("b.jpeg");
+        REQUIRE(cache.stats().hits == 1);
+        REQUIRE(cache.stats().misses == 0);
+        REQUIRE(calls == 2);
+    }
+    SECTION( "get waits for an image being prefetched" ) {
+        std::promise<void> started;
+        std::promise<void> release;
+        ImageCache cache(1000, BlockingLoader{&started, release.get_future().share()});
+        cache.prefetch({"a.jpeg"});
+        started.get_future().wait();
+        auto image = std::async(std::launch::async, [&]() { return cache.get("a.jpeg"); });
+        // get counts the wait before it blocks on the decoding image
+        while(cache.stats().waits == 0) {
+            std::this_thread::yield();
+        }
+        release.set_value();
+        REQUIRE(image.get()->filename() == "a.jpeg");
+        REQUIRE(cache.stats().waits == 1);
+        REQUIRE(cache.stats().misses == 0);
+    }
+    SECTION( "prefetches on several threads and reports each image" ) {
+        std::mutex mutex;
+        std::vector<std::string> reported;
+        ImageCache cache(100000, FakeLoader{&calls, 10}, 4, [&](const std::string & filename) {
+            std::lock_guard<std::mutex> lock(mutex);
+            reported.push_back(filename);
+        });
+        std::vector<std::string> filenames;
+        for(int i = 0; i < 16; i++) {
+            filenames.push_back(std::to_string(i) + ".jpeg");
+        }
+        REQUIRE(cache.find("0.jpeg") == nullptr);
+        cache.prefetch(filenames);
+        waitForPrefetch(cache, 16);
+        REQUIRE(calls == 16);
+        REQUIRE(cache.find("0.jpeg") != nullptr);
+        // the callback runs right after the image is cached
+        for(int i = 0; i < 500; i++) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (reported.size() == filenames.size()) {
+                    break;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        std::sort(reported.begin(), reported.end());
+        std::sort(filenames.begin(), filenames.end());
+        REQUIRE(reported == filenames);
+    }
+    SECTION( "errors are reported by get" ) {
+        ImageCache cache(1000, FakeLoader{&calls, 0});
+        cache.prefetch({"missing.jpeg"});
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        REQUIRE_THROWS(cache.get("missing.jpeg"));
+        REQUIRE_FALSE(cache.contains("missing.jpeg"));
+    }
+}
@@ -0,0 +1,94 @@
+#define CATCH_CONFIG_RUNNER
+
+#include <QCoreApplication>
+#include <boost/filesystem.hpp>
+#include <fstream>
+
+#include "catch.hpp"
+#include "ImageListModel.h"
+
+using namespace deeplocalizer;
+namespace io = boost::filesystem;
+
+TEST_CASE( "ImageListModel", "[ImageListModel]" ) {
+    io::path dir = io::unique_path("/tmp/test_image_list_model_%%%%%%%%");
+    io::create_directories(dir);
+    std::vector<ImageDesc> descs;
+    for(int i = 0; i < 3; i++) {
+        const std::string filename = (dir / (std::to_string(i) + ".jpeg")).string();
+        {
+            std::ofstream o(filename);
+            o << "" << std::endl;
+        }
+        descs.emplace_back(filename, std::vector<Tag>{Tag::fromCenter(cv::Point2i(100, 100))});
+    }
+    {
+        // proposals with an excluded region, never loaded by the test
+        Tag excluded = Tag::fromCenter(cv::Point2i(200, 200));
+        excluded.setType(TagType::Exclude);
+        ImageDesc proposals(descs.at(2).filename, {excluded});
+        proposals.save(descs.at(2).filename + ".proposal.json");
+    }
+    {
+        ManuallyTagger tagger(descs, (dir / "progress.json").string());
+        ImageListModel model(&tagger);
+        QObject::connect(&tagger, &ManuallyTagger::imageChanged,
+                         &model, &ImageListModel::imageChanged);
+        REQUIRE(model.rowCount() == 3);
+        const QString first = model.data(model.index(0)).toString();
+        REQUIRE(first.startsWith("#1:"));
+        REQUIRE(first.contains(QString::fromStdString(descs.at(0).filename)));
+
+        std::vector<unsigned long> changed;
+        QObject::connect(&tagger, &ManuallyTagger::imageChanged,
+                         [&changed](unsigned long idx) { changed.push_back(idx); });
+        tagger.imageDesc(1);
+        tagger.imageDesc(1);
+        const std::vector<unsigned long> loaded{1};
+        REQUIRE(changed == loaded);
+        // the proposals, but image 2 stays unloaded
+        auto stored = ManuallyTagger::readImageDesc(descs.at(2).filename);
+        REQUIRE(stored);
+        REQUIRE(stored->getTags().size() == 1);
+        REQUIRE(stored->getTags().at(0).type() == TagType::Exclude);
+        REQUIRE_FALSE(tagger.isLoaded(2));
+        REQUIRE_FALSE(ManuallyTagger::readImageDesc(descs.at(0).filename));
+
+        Tag excluded = Tag::fromCenter(cv::Point2i(300, 300));
+        excluded.setType(TagType::Exclude);
+        tagger.imageDesc(0)->getTags().push_back(excluded);
+        tagger.tagAdded(excluded);
+        REQUIRE(tagger.status(0).nb_tags == 2);
+        REQUIRE(tagger.status(0).nb_excluded == 1);
+        REQUIRE(model.data(model.index(0)).toString().endsWith("(2)"));
+
+        REQUIRE(tagger.status(2).nb_excluded == -1);
+        model.setFilter(ImageListModel::WithExcluded);
+        REQUIRE(tagger.status(2).nb_excluded == 1);
+        REQUIRE(model.rowCount() == 2);
+        REQUIRE(model.imageIdx(0) == 0);
+        REQUIRE(model.imageIdx(1) == 2);
+        REQUIRE_FALSE(model.indexOf(1).isValid());
+
+        model.setFilter(ImageListModel::NotDone);
+        REQUIRE(model.rowCount() == 3);
+        tagger.doneTagging(1);
+        REQUIRE(model.rowCount() == 2);
+        REQUIRE_FALSE(model.indexOf(1).isValid());
+        REQUIRE(model.imageIdx(1) == 2);
+        REQUIRE(model.indexOf(2).row() == 1);
+
+        model.setFilter(ImageListModel::All);
+        REQUIRE(model.rowCount() == 3);
+        REQUIRE(model.data(model.index(1)).toString().contains("\u2713"));
+        REQUIRE(model.indexOf(2).row() == 2);
+    }
+    io::remove_all(dir);
+}
+
+int main( int argc, char** const argv )
+{
+    QCoreApplication * qapp = new QCoreApplication(argc, argv);
+    int result = Catch::Session().run(argc, argv);
+    return result;
+}
@@ -0,0 +1,113 @@
+
+#include "ImageShard.h"
+#include "Image.h"
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <opencv2/opencv.hpp>
+
+using namespace deeplocalizer;
+
+namespace io = boost::filesystem;
+
+std::vector<uchar> encode(const cv::Mat & mat) {
+    std::vector<uchar> buffer;
+    cv::imencode(".png", mat, buffer);
+    return buffer;
+}
+
+bool bitIdentical(const cv::Mat & a, const cv::Mat & b) {
+    return a.size() == b.size() && a.type() == b.type() &&
+           cv::norm(a, b, cv::NORM_INF) == 0;
+}
+
+TEST_CASE( "ShardRef", "[shard]" ) {
+    auto ref = ShardRef::parse("out/images_00001.shard:1234");
+    REQUIRE(ref);
+    REQUIRE(ref->shard == "out/images_00001.shard");
+    REQUIRE(ref->offset == 1234);
+    REQUIRE(ref->str() == "out/images_00001.shard:1234");
+    REQUIRE_FALSE(ShardRef::parse("out/image.jpeg"));
+    REQUIRE_FALSE(ShardRef::parse("out/image.jpeg:1234"));
+    REQUIRE_FALSE(ShardRef::parse("out/images_00001.shard:"));
+}
+
+TEST_CASE( "ImageShard", "[shard]" ) {
+    io::path dir = io::unique_path("/tmp/test_shard_%%%%%%%%");
+    std::vector<std::string> names = {
+            "testdata/with_one_tag.jpeg",
+            "testdata/with_5_tags.jpeg",
+            "testdata/one_tag_at_center.jpeg",
+    };
+    std::vector<cv::Mat> images;
+    for(const auto & name : names) {
+        images.push_back(cv::imread(name, cv::IMREAD_GRAYSCALE));
+        REQUIRE(not images.back().empty());
+    }
+    GIVEN( "frames appended to one shard" ) {
+        std::vector<std::string> refs;
+        {
+            ShardWriter writer(dir / "images", 1 << 30);
+            for(size_t i = 0; i < images.size(); i++) {
+                refs.push_back(writer.append(names.at(i), encode(images.at(i))));
+            }
+            REQUIRE(writer.nbShards() == 1);
+        }
+        THEN( "they can be read by their reference" ) {
+            for(size_t i = 0; i < images.size(); i++) {
+                REQUIRE(imageExists(refs.at(i)));
+                REQUIRE(bitIdentical(readImage(refs.at(i)), images.at(i)));
+                REQUIRE(bitIdentical(Image(ImageDesc(refs.at(i))).getCvMat(), images.at(i)));
+            }
+        }
+        THEN( "they can be found by their original name" ) {
+            auto shard = ImageShard::open(ShardRef::parse(refs.at(0))->shard);
+            REQUIRE(shard->nbFrames() == images.size());
+            for(size_t i = 0; i < images.size(); i++) {
+                auto offset = shard->find(names.at(i));
+                REQUIRE(offset);
+                REQUIRE(bitIdentical(shard->decode(offset.get()), images.at(i)));
+            }
+            REQUIRE_FALSE(shard->find("unknown.jpeg"));
+        }
+        THEN( "a second writer starts a new shard" ) {
+            ShardWriter writer(dir / "images", 1 << 30);
+            std::string ref = writer.append(names.at(0), encode(images.at(0)));
+            REQUIRE(ShardRef::parse(ref)->shard != ShardRef::parse(refs.at(0))->shard);
+            REQUIRE(bitIdentical(readImage(refs.at(0)), images.at(0)));
+        }
+    }
+    GIVEN( "a shard that grows after it was read" ) {
+        THEN( "the new frames are read from a new mapping" ) {
+            ShardWriter writer(dir / "images", 1 << 30);
+            std::string first = writer.append(names.at(0), encode(images.at(0)));
+            REQUIRE(bitIdentical(readImage(first), images.at(0)));
+            auto mapping = ImageShard::open(ShardRef::parse(first)->shard);
+            std::string second = writer.append(names.at(1), encode(images.at(1)));
+            REQUIRE(not mapping->contains(ShardRef::parse(second)->offset));
+            REQUIRE(imageExists(second));
+            REQUIRE(bitIdentical(readImage(second), images.at(1)));
+            REQUIRE(bitIdentical(readImage(first), images.at(0)));
+        }
+        THEN( "references past its end do not exist" ) {
+            ShardWriter writer(dir / "images", 1 << 30);
+            auto ref = ShardRef::parse(writer.append(names.at(0), encode(images.at(0))));
+            ref->offset += 1 << 20;
+            REQUIRE_FALSE(imageExists(ref->str()));
+            REQUIRE(readImage(ref->str()).empty());
+        }
+    }
+    GIVEN( "a small maximum shard size" ) {
+        THEN( "every frame gets its own shard" ) {
+            ShardWriter writer(dir / "images", 1);
+            for(size_t i = 0; i < images.size(); i++) {
+                std::string ref = writer.append(names.at(i), encode(images.at(i)));
+                REQUIRE(ShardRef::parse(ref)->offset == 0);
+                REQUIRE(bitIdentical(readImage(ref), images.at(i)));
+            }
+            REQUIRE(writer.nbShards() == images.size());
+        }
+    }
+    io::remove_all(dir);
+}
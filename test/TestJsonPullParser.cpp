@@ -0,0 +1,148 @@
+#include "JsonPullParser.h"
+#include "Image.h"
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace deeplocalizer;
+using namespace std::chrono;
+
+static const std::vector<std::string> JSON_FILES = {
+    "testdata/Cam_2_20150828143300_888543_wb.jpeg.proposal.json",
+    "testdata/Cam_2_20150828143300_888543_wb.jpeg.tagger.json",
+};
+
+static std::string readFile(const std::string & path) {
+    std::ifstream is(path);
+    std::stringstream ss;
+    ss << is.rdbuf();
+    return ss.str();
+}
+
+static bool isMalformed(const std::string & text) {
+    JsonPullParser parser(text);
+    try {
+        parser.skipValue();
+        parser.end();
+    } catch(const std::string &) {
+        return true;
+    }
+    return false;
+}
+
+TEST_CASE( "JsonPullParser", "[json]" ) {
+    std::string key;
+    SECTION( "reads nested values in order" ) {
+        JsonPullParser parser(" {\"a\": [1, -2.5e3, true, false, null], \"b\": {\"c\": \"d\"}} ");
+        parser.beginObject();
+        REQUIRE(parser.nextKey(key));
+        REQUIRE(key == "a");
+        parser.beginArray();
+        REQUIRE(parser.nextElement());
+        REQUIRE(parser.integer() == 1);
+        REQUIRE(parser.nextElement());
+        REQUIRE(parser.number() == -2500.);
+        REQUIRE(parser.nextElement());
+        REQUIRE(parser.boolean());
+        REQUIRE(parser.nextElement());
+        REQUIRE_FALSE(parser.boolean());
+        REQUIRE(parser.nextElement());
+        REQUIRE(parser.null());
+        REQUIRE_FALSE(parser.nextElement());
+        REQUIRE(parser.nextKey(key));
+        REQUIRE(key == "b");
+        parser.beginObject();
+        REQUIRE(parser.nextKey(key));
+        REQUIRE(parser.string() == "d");
+        REQUIRE_FALSE(parser.nextKey(key));
+        REQUIRE_FALSE(parser.nextKey(key));
+        parser.end();
+    }
+    SECTION( "unescapes strings" ) {
+        JsonPullParser parser("\"a\\\"b\\\\c\\/\\n\\t\\u00e9\\ud83d\\ude00\"");
+        REQUIRE(parser.string() == "a\"b\\c/\n\t\xc3\xa9\xf0\x9f\x98\x80");
+    }
+    SECTION( "truncates floating point integers like nlohmann::json" ) {
+        JsonPullParser parser("[12.75, -3e1]");
+        parser.beginArray();
+        REQUIRE(parser.nextElement());
+        REQUIRE(parser.integer() == 12);
+        REQUIRE(parser.nextElement());
+        REQUIRE(parser.integer() == -30);
+    }
+    SECTION( "skips values" ) {
+        JsonPullParser parser("{\"skip\": {\"x\": [1, {\"y\": []}, \"]\"]}, \"keep\": 7}");
+        parser.beginObject();
+        REQUIRE(parser.nextKey(key));
+        parser.skipValue();
+        REQUIRE(parser.nextKey(key));
+        REQUIRE(key == "keep");
+        REQUIRE(parser.integer() == 7);
+        REQUIRE_FALSE(parser.nextKey(key));
+        parser.end();
+    }
+    SECTION( "throws on malformed json" ) {
+        REQUIRE(isMalformed("{\"a\": 1,}"));
+        REQUIRE(isMalformed("{\"a\" 1}"));
+        REQUIRE(isMalformed("[1 2]"));
+        REQUIRE(isMalformed("\"unterminated"));
+        REQUIRE(isMalformed("\"\\x\""));
+        REQUIRE(isMalformed("[tru]"));
+        REQUIRE(isMalformed("{} {}"));
+        REQUIRE_FALSE(isMalformed(" [] "));
+    }
+}
+
+TEST_CASE( "ImageDesc::parse", "[json]" ) {
+    for(const auto & path : JSON_FILES) {
+        const std::string text = readFile(path);
+        REQUIRE(not text.empty());
+        ImageDesc parsed = ImageDesc::parse(text);
+        REQUIRE(not parsed.getTags().empty());
+        REQUIRE(parsed == ImageDesc::from_json(nlohmann::json::parse(text)));
+    }
+    SECTION( "ignores unknown keys" ) {
+        ImageDesc desc = ImageDesc::parse(
+            "{\"filename\": \"a.jpeg\", \"comment\": {\"by\": [\"me\"]}, \"tags\": []}");
+        REQUIRE(desc.filename == "a.jpeg");
+        REQUIRE(desc.getTags().empty());
+    }
+    SECTION( "reports tags without type" ) {
+        std::string error;
+        try {
+            ImageDesc::parse("{\"filename\": \"a.jpeg\", \"tags\": [{\"x\": 1, \"y\": 2}]}");
+        } catch(const std::string & msg) {
+            error = msg;
+        }
+        REQUIRE(error.find("Tag without type.") != std::string::npos);
+    }
+}
+
+// Compares the streaming parser with building a nlohmann::json DOM first.
+// Run with `./TestJsonPullParser "[benchmark]"`.
+TEST_CASE( "ImageDesc::parse benchmark", "[.][benchmark]" ) {
+    const size_t iterations = 200;
+    for(const auto & path : JSON_FILES) {
+        const std::string text = readFile(path);
+        size_t nb_tags = 0;
+        auto start = high_resolution_clock::now();
+        for(size_t i = 0; i < iterations; i++) {
+            nb_tags += ImageDesc::from_json(nlohmann::json::parse(text)).getTags().size();
+        }
+        auto dom = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+        start = high_resolution_clock::now();
+        for(size_t i = 0; i < iterations; i++) {
+            nb_tags -= ImageDesc::parse(text).getTags().size();
+        }
+        auto pull = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+        REQUIRE(nb_tags == 0);
+        std::cout << path << ": nlohmann::json " << dom / 1000. / iterations << "ms, "
+                  << "JsonPullParser " << pull / 1000. / iterations << "ms per file, "
+                  << static_cast<double>(dom) / std::max<long>(pull, 1) << "x faster" << std::endl;
+    }
+}
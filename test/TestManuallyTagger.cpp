@@ -5,6 +5,7 @@
 #include <boost/format.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <chrono>
+#include <fstream>
 
 #include "catch.hpp"
 #include "ManuallyTagger.h"
@@ -122,6 +123,88 @@ TEST_CASE( "ManuallyTagger ", "[ManuallyTagger]" ) {
             }
         }
     }
+    SECTION("edits are journaled and replayed") {
+        io::path dir = io::unique_path("/tmp/test_tagger_journal_%%%%%%%%");
+        io::create_directories(dir);
+        io::path image = dir / "with_5_tags.jpeg";
+        io::copy_file("testdata/with_5_tags.jpeg", image);
+        const std::string save_path = (dir / "progress.json").string();
+        Tag first = Tag::fromCenter(cv::Point2i(200, 200));
+        Tag added = Tag::fromCenter(cv::Point2i(400, 300));
+        std::vector<ImageDesc> descs{ImageDesc(image.string(), {first})};
+        {
+            ManuallyTagger tagger(descs, save_path);
+            tagger.loadImage(0);
+            auto & tags = tagger.getImageDescs().at(0)->getTags();
+            tags.push_back(added);
+            tagger.tagAdded(added);
+            tags.erase(tags.begin());
+            tagger.tagErased(first);
+            tagger.doneTagging();
+        }
+        // nothing but the journal was written
+        REQUIRE_FALSE(io::exists(save_path));
+        REQUIRE_FALSE(io::exists(save_path + ".index"));
+        REQUIRE(io::exists(save_path + ".journal"));
+        {
+            ManuallyTagger tagger(descs, save_path);
+            REQUIRE(tagger.isDone(0));
+            REQUIRE(tagger.imageDesc(0)->getTags() == std::vector<Tag>{added});
+            tagger.compact(true);
+        }
+        REQUIRE(io::exists(save_path));
+        REQUIRE(EditJournal::read(save_path + ".journal").empty());
+        auto index = StatusIndex::load(save_path + ".index");
+        REQUIRE(index.size() == 1);
+        REQUIRE(index.at(image.string()).has_desc);
+        REQUIRE(index.at(image.string()).nb_tags == 1);
+
+        auto loaded = ManuallyTagger::load(save_path);
+        REQUIRE(loaded->isDone(0));
+        // the description is only loaded on access
+        REQUIRE(loaded->getImageDescs().at(0)->getTags().empty());
+        REQUIRE(loaded->imageDesc(0)->getTags() == std::vector<Tag>{added});
+        REQUIRE(loaded->status(0).nb_tags == 1);
+        loaded.reset();
+
+        // a description written by someone else is not counted from the index
+        const std::string desc_path = image.string() + "." + ManuallyTagger::IMAGE_DESC_EXT;
+        io::last_write_time(desc_path, io::last_write_time(desc_path) + 10);
+        loaded = ManuallyTagger::load(save_path);
+        REQUIRE(loaded->status(0).has_desc);
+        REQUIRE(loaded->status(0).nb_tags == -1);
+        loaded.reset();
+
+        // a deleted image is noticed on start
+        io::remove(image);
+        REQUIRE_THROWS(ManuallyTagger::load(save_path));
+        io::remove_all(dir);
+    }
+    SECTION("counts the tags of unloaded images") {
+        io::path dir = io::unique_path("/tmp/test_count_tags_%%%%%%%%");
+        io::create_directories(dir);
+        std::vector<ImageDesc> descs;
+        for(int i = 0; i < 2; i++) {
+            const std::string filename = (dir / (std::to_string(i) + ".jpeg")).string();
+            std::ofstream(filename) << "" << std::endl;
+            descs.emplace_back(filename);
+        }
+        Tag excluded = Tag::fromCenter(cv::Point2i(100, 100));
+        excluded.setType(TagType::Exclude);
+        ImageDesc(descs.at(0).filename, {excluded}).save(descs.at(0).filename + ".proposal.json");
+        std::ofstream(descs.at(1).filename + ".proposal.json")
+            << R"({"filename": "1.jpeg", "tags": [{"x": 50, "y": 50, "tagtype": "bogus"}]})";
+        {
+            ManuallyTagger tagger(descs, (dir / "progress.json").string());
+            const auto errors = tagger.countTags();
+            REQUIRE(tagger.status(0).nb_excluded == 1);
+            // the unreadable description is reported, not thrown
+            REQUIRE(tagger.status(1).nb_excluded == -1);
+            REQUIRE(errors.size() == 1);
+            REQUIRE(errors.at(0).path == descs.at(1).filename);
+        }
+        io::remove_all(dir);
+    }
     SECTION("serialization") {
         GIVEN("many image descriptions") {
             using namespace std::chrono;
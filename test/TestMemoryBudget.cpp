@@ -0,0 +1,53 @@
+
+#include "MemoryBudget.h"
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace deeplocalizer;
+
+TEST_CASE( "MemoryBudget", "[memory]" ) {
+    SECTION( "counts the bytes in flight and their peak" ) {
+        MemoryBudget budget(100);
+        budget.acquire(40);
+        budget.acquire(60);
+        REQUIRE(budget.used() == 100);
+        budget.release(60);
+        budget.force(30);
+        REQUIRE(budget.used() == 70);
+        REQUIRE(budget.peak() == 100);
+    }
+    SECTION( "acquire waits until the bytes fit" ) {
+        MemoryBudget budget(100);
+        budget.acquire(80);
+        std::atomic<bool> admitted{false};
+        std::thread t([&]() {
+            budget.acquire(50);
+            admitted = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        REQUIRE(not admitted);
+        budget.release(80);
+        t.join();
+        REQUIRE(admitted);
+        REQUIRE(budget.used() == 50);
+    }
+    SECTION( "admits an oversized item once nothing else is in flight" ) {
+        MemoryBudget budget(100);
+        budget.pin(120);
+        budget.acquire(500);
+        REQUIRE(budget.used() == 620);
+        budget.release(1000);
+        REQUIRE(budget.used() == 120);
+    }
+    SECTION( "a budget of 0 is unlimited" ) {
+        MemoryBudget budget(0);
+        budget.acquire(1000);
+        budget.acquire(1000);
+        REQUIRE(budget.used() == 2000);
+    }
+}
@@ -0,0 +1,35 @@
+
+#include "PathfileReader.h"
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <sstream>
+
+using namespace deeplocalizer;
+
+TEST_CASE( "PathfileReader", "[PathfileReader]" ) {
+    std::stringstream ss("a.jpeg\nb.jpeg\n\nc.jpeg\nd.jpeg\ne.jpeg\n");
+    PathfileReader reader(ss);
+    std::vector<std::string> paths;
+    SECTION( "reads the paths in chunks" ) {
+        REQUIRE(reader.next(2, paths) == 0);
+        REQUIRE(paths == std::vector<std::string>({"a.jpeg", "b.jpeg"}));
+        REQUIRE(reader.nbRead() == 2);
+        REQUIRE_FALSE(reader.eof());
+        REQUIRE(reader.next(2, paths) == 2);
+        REQUIRE(paths == std::vector<std::string>({"c.jpeg", "d.jpeg"}));
+        REQUIRE(reader.next(2, paths) == 4);
+        REQUIRE(paths == std::vector<std::string>({"e.jpeg"}));
+        REQUIRE(reader.next(2, paths) == 5);
+        REQUIRE(paths.empty());
+        REQUIRE(reader.eof());
+        REQUIRE(reader.fractionRead() == 1);
+    }
+    SECTION( "reads all paths at once" ) {
+        REQUIRE(reader.next(1, paths) == 0);
+        auto rest = reader.readAll();
+        REQUIRE(rest == std::vector<std::string>({"b.jpeg", "c.jpeg", "d.jpeg", "e.jpeg"}));
+        REQUIRE(reader.nbRead() == 5);
+    }
+}
@@ -0,0 +1,110 @@
+
+#include "PreprocessManifest.h"
+#include "utils.h"
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+using namespace deeplocalizer;
+
+namespace io = boost::filesystem;
+
+void writeFile(const io::path & path, const std::string & content) {
+    std::ofstream os(path.string());
+    os << content;
+}
+
+TEST_CASE( "PreprocessManifest", "[manifest]" ) {
+    io::path dir = io::unique_path("/tmp/test_manifest_%%%%%%%%");
+    io::create_directories(dir);
+    io::path input = dir / "input.jpeg";
+    io::path output = dir / "input.b.jpeg";
+    io::path manifest_path = PreprocessManifest::pathFor(dir / "images.txt");
+    writeFile(input, "some image content");
+    writeFile(output, "processed content");
+
+    PreprocessOptions opt{};
+    opt.add_border = true;
+    opt.format = ImageFormat::JPEG;
+    opt.compression = DEFAULT_JPEG_COMPRESSION;
+
+    auto hashInput = [&]() {
+        std::ifstream is(input.string());
+        std::string content((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+        return fnv1aHash(content);
+    };
+    auto entryFor = [&]() {
+        ManifestEntry entry;
+        entry.input = input.string();
+        entry.output = output.string();
+        REQUIRE(entry.stat());
+        return entry;
+    };
+    {
+        PreprocessManifest manifest(manifest_path, opt);
+        ManifestEntry entry = entryFor();
+        entry.hash = hashInput();
+        manifest.add(entry);
+    }
+    SECTION( "up to date outputs" ) {
+        GIVEN( "an unchanged input" ) {
+            THEN( "its output is up to date" ) {
+                PreprocessManifest manifest(manifest_path, opt);
+                ManifestEntry entry = entryFor();
+                REQUIRE(manifest.isUpToDate(entry, hashInput));
+            }
+        }
+        GIVEN( "an input with a new mtime but the same content" ) {
+            THEN( "its output is up to date" ) {
+                PreprocessManifest manifest(manifest_path, opt);
+                ManifestEntry entry = entryFor();
+                entry.mtime += 10;
+                REQUIRE(manifest.isUpToDate(entry, hashInput));
+            }
+        }
+        GIVEN( "a changed input" ) {
+            THEN( "its output is outdated" ) {
+                writeFile(input, "other image content");
+                PreprocessManifest manifest(manifest_path, opt);
+                ManifestEntry entry = entryFor();
+                entry.mtime += 10;
+                REQUIRE_FALSE(manifest.isUpToDate(entry, hashInput));
+            }
+        }
+        GIVEN( "other options" ) {
+            THEN( "all outputs are outdated" ) {
+                PreprocessOptions other_opt = opt;
+                other_opt.compression = 80;
+                PreprocessManifest manifest(manifest_path, other_opt);
+                ManifestEntry entry = entryFor();
+                REQUIRE(manifest.nbPrevious() == 0);
+                REQUIRE_FALSE(manifest.isUpToDate(entry, hashInput));
+            }
+        }
+        GIVEN( "a manifest with a corrupt header" ) {
+            THEN( "it is treated as no manifest" ) {
+                writeFile(manifest_path, "{\"options\": {\"bor");
+                PreprocessManifest manifest(manifest_path, opt);
+                ManifestEntry entry = entryFor();
+                REQUIRE(manifest.nbPrevious() == 0);
+                REQUIRE_FALSE(manifest.isUpToDate(entry, hashInput));
+            }
+        }
+        GIVEN( "a manifest with a header that is not an object" ) {
+            THEN( "it is treated as no manifest" ) {
+                writeFile(manifest_path, "[1, 2]\n");
+                PreprocessManifest manifest(manifest_path, opt);
+                REQUIRE(manifest.nbPrevious() == 0);
+            }
+        }
+        GIVEN( "a deleted output" ) {
+            THEN( "it is outdated" ) {
+                io::remove(output);
+                PreprocessManifest manifest(manifest_path, opt);
+                ManifestEntry entry = entryFor();
+                REQUIRE_FALSE(manifest.isUpToDate(entry, hashInput));
+            }
+        }
+    }
+    io::remove_all(dir);
+}
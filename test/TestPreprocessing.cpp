@@ -0,0 +1,165 @@
+
+#include "preprocessing.h"
+#include "PreprocessContext.h"
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <opencv2/opencv.hpp>
+
+#include <cmath>
+
+using namespace deeplocalizer;
+
+namespace io = boost::filesystem;
+
+PreprocessOptions makeOptions(bool add_border, bool use_hist_eq,
+                              bool use_thresholding, bool use_binary_image) {
+    PreprocessOptions opt{};
+    opt.add_border = add_border;
+    opt.use_hist_eq = use_hist_eq;
+    opt.use_thresholding = use_thresholding;
+    opt.use_binary_image = use_binary_image;
+    opt.format = ImageFormat::JPEG;
+    opt.compression = DEFAULT_JPEG_COMPRESSION;
+    return opt;
+}
+
+bool bitIdentical(const cv::Mat & a, const cv::Mat & b) {
+    return a.size() == b.size() && a.type() == b.type() &&
+           cv::norm(a, b, cv::NORM_INF) == 0;
+}
+
+TEST_CASE( "processImage", "[preprocessing]" ) {
+    ImageDesc desc("testdata/Cam_2_20140805145841_2_wb.jpeg");
+    std::vector<PreprocessOptions> all_options;
+    for(bool border : {false, true}) {
+        for(bool hist_eq : {false, true}) {
+            all_options.push_back(makeOptions(border, hist_eq, false, false));
+            all_options.push_back(makeOptions(border, hist_eq, true, false));
+            all_options.push_back(makeOptions(border, hist_eq, true, true));
+        }
+    }
+    SECTION( "fused kernel" ) {
+        GIVEN( "any combination of options" ) {
+            THEN( "it produces the same output as the chain of single steps" ) {
+                ProcessingBuffers buffers;
+                for(const auto & opt : all_options) {
+                    Image reference(desc);
+                    cv::Mat input = reference.getCvMat().clone();
+                    processImage(reference, opt);
+
+                    cv::Mat output;
+                    processImage(input, output, opt, buffers);
+                    INFO("border: " << opt.add_border << ", clahe: " << opt.use_hist_eq <<
+                         ", threshold: " << opt.use_thresholding <<
+                         ", binary: " << opt.use_binary_image);
+                    REQUIRE(bitIdentical(reference.getCvMat(), output));
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE( "PreprocessContext", "[preprocessing]" ) {
+    const std::string filename = "testdata/Cam_2_20140805145841_2_wb.jpeg";
+    PreprocessOptions opt = makeOptions(true, true, true, false);
+    PreprocessContext context(opt);
+    FramePool input_pool;
+    SECTION( "processing" ) {
+        GIVEN( "an image" ) {
+            THEN( "it produces the same output as the chain of single steps" ) {
+                Image reference{ImageDesc(filename)};
+                processImage(reference, opt);
+                cv::Mat input = context.decode(filename, input_pool);
+                cv::Mat output = context.process(input);
+                REQUIRE(bitIdentical(reference.getCvMat(), output));
+            }
+        }
+    }
+    SECTION( "buffer growths" ) {
+        GIVEN( "frames of the same size" ) {
+            THEN( "only the first frame allocates buffers" ) {
+                auto processOnce = [&]() {
+                    cv::Mat input = context.decode(filename, input_pool);
+                    cv::Mat output = context.process(input);
+                    input_pool.release(input);
+                    context.releaseOutput(output);
+                };
+                processOnce();
+                size_t nb_growths = context.bufferGrowths();
+                REQUIRE(nb_growths > 0);
+                for(int i = 0; i < 3; i++) {
+                    processOnce();
+                }
+                REQUIRE(context.bufferGrowths() == nb_growths);
+            }
+        }
+        GIVEN( "a smaller frame after a larger one" ) {
+            THEN( "the scratch buffers are reused" ) {
+                cv::Mat large = context.decode(filename, input_pool);
+                context.releaseOutput(context.process(large));
+                size_t nb_growths = context.bufferGrowths();
+                cv::Mat small = large(cv::Rect(0, 0, large.cols / 2, large.rows / 2)).clone();
+                context.releaseOutput(context.process(small));
+                // only the output buffer of the new size is allocated
+                REQUIRE(context.bufferGrowths() == nb_growths + 1);
+            }
+        }
+    }
+}
+
+TEST_CASE( "image quality metrics", "[preprocessing]" ) {
+    cv::Mat image = cv::imread("testdata/Cam_2_20140805145841_2_wb.jpeg", cv::IMREAD_GRAYSCALE);
+    REQUIRE(not image.empty());
+    SECTION( "identical images" ) {
+        REQUIRE(std::isinf(psnr(image, image)));
+        REQUIRE(ssim(image, image) == Approx(1));
+    }
+    SECTION( "a JPEG encoded image" ) {
+        std::vector<uchar> buffer;
+        cv::imencode(".jpeg", image, buffer, {CV_IMWRITE_JPEG_QUALITY, 50});
+        cv::Mat decoded = cv::imdecode(buffer, cv::IMREAD_GRAYSCALE);
+        double quality_psnr = psnr(image, decoded);
+        double quality_ssim = ssim(image, decoded);
+        REQUIRE(std::isfinite(quality_psnr));
+        REQUIRE(quality_psnr > 20);
+        REQUIRE(quality_ssim < 1);
+        REQUIRE(quality_ssim > 0.5);
+    }
+}
+
+TEST_CASE( "splitting the images over several machines", "[preprocessing]" ) {
+    const size_t nb_nodes = 4;
+    std::vector<std::string> paths;
+    for(size_t i = 0; i < 100; i++) {
+        paths.push_back("cam" + std::to_string(i % 4) + "/Cam_" + std::to_string(i) + ".jpeg");
+    }
+    PreprocessOptions opt{};
+    SECTION( "every image is on exactly one machine" ) {
+        for(const auto & path : paths) {
+            size_t nb_owners = 0;
+            for(size_t i = 0; i < nb_nodes; i++) {
+                opt.node_index = i;
+                opt.nb_nodes = nb_nodes;
+                nb_owners += opt.isOnThisNode(path);
+            }
+            REQUIRE(nb_owners == 1);
+        }
+    }
+    SECTION( "the machine depends only on the filename" ) {
+        opt.nb_nodes = nb_nodes;
+        for(size_t i = 0; i < nb_nodes; i++) {
+            opt.node_index = i;
+            REQUIRE(opt.isOnThisNode("a/Cam_1.jpeg") == opt.isOnThisNode("/b/c/Cam_1.jpeg"));
+        }
+    }
+    SECTION( "a single machine gets every image" ) {
+        for(size_t nb : {0, 1}) {
+            opt.nb_nodes = nb;
+            for(const auto & path : paths) {
+                REQUIRE(opt.isOnThisNode(path));
+            }
+        }
+    }
+}
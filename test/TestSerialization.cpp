@@ -20,6 +20,7 @@ TEST_CASE( "JSON serialization", "[serialize]" ) {
     ImageDesc img("image_path.jpeg");
     Tag tag(cv::Rect(30, 40, TAG_WIDTH, TAG_HEIGHT));
     Tag tag_with_ell(cv::Rect(300, 400, TAG_WIDTH, TAG_HEIGHT));
+    tag_with_ell.setEllipse(TagEllipse{1341, cv::Point2i(30, 30), cv::Size(30, 23), 103.348727113287});
     SECTION("simple tag") {
         json j = tag.to_json();
         Tag from_json = Tag::from_json(j);
@@ -29,6 +30,7 @@ TEST_CASE( "JSON serialization", "[serialize]" ) {
         json j = tag_with_ell.to_json();
         Tag from_json = Tag::from_json(j);
         REQUIRE(tag_with_ell == from_json);
+        REQUIRE(from_json.ellipse());
     }
     img.addTag(tag);
     img.addTag(tag_with_ell);
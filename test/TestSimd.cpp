@@ -0,0 +1,82 @@
+
+#include "simd.h"
+#include "preprocessing.h"
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <opencv2/opencv.hpp>
+
+using namespace deeplocalizer;
+
+// fraction of pixels that differ by more than `tolerance`
+double fractionDiffering(const cv::Mat & a, const cv::Mat & b, double tolerance) {
+    cv::Mat diff;
+    cv::absdiff(a, b, diff);
+    return static_cast<double>(cv::countNonZero(diff > tolerance)) / a.total();
+}
+
+cv::Mat testImage() {
+    cv::Mat image = cv::imread("testdata/Cam_2_20140805145841_2_wb.jpeg", cv::IMREAD_GRAYSCALE);
+    REQUIRE(not image.empty());
+    // an odd size that is not a multiple of the CLAHE tile grid
+    return image(cv::Rect(0, 0, image.cols - 13, image.rows - 7)).clone();
+}
+
+TEST_CASE( "SIMD kernels", "[simd]" ) {
+    const cv::Mat image = testImage();
+    const cv::Size block(51, 51);
+    cv::Mat image_float, mean;
+    image.convertTo(image_float, CV_32F);
+    cv::GaussianBlur(image_float, mean, block, 0, 0,
+                     cv::BORDER_REPLICATE | cv::BORDER_ISOLATED);
+    SECTION( "gaussian local mean matches cv::GaussianBlur" ) {
+        for(SimdLevel level : supportedSimdLevels()) {
+            INFO("SIMD level: " << simd_level_to_str(level));
+            SimdBuffers buffers;
+            cv::Mat simd_mean;
+            gaussianLocalMeanSimd(image, simd_mean, block.width, buffers, level);
+            REQUIRE(cv::norm(mean, simd_mean, cv::NORM_INF) < 1e-2);
+        }
+    }
+    SECTION( "thresholding matches cv::adaptiveThreshold" ) {
+        cv::Mat expected, expected_blend;
+        cv::adaptiveThreshold(image, expected, 255, cv::ADAPTIVE_THRESH_GAUSSIAN_C,
+                              cv::THRESH_BINARY, block.width, 0);
+        cv::addWeighted(image, 0.7, expected, 0.3, 0, expected_blend);
+        for(SimdLevel level : supportedSimdLevels()) {
+            INFO("SIMD level: " << simd_level_to_str(level));
+            cv::Mat thresholded, blended;
+            thresholdBlendSimd(image, mean, thresholded, 255, true, 0.7, 0.3, level);
+            REQUIRE(fractionDiffering(expected, thresholded, 0) < 1e-3);
+            thresholdBlendSimd(image, mean, blended, 255, false, 0.7, 0.3, level);
+            REQUIRE(fractionDiffering(expected_blend, blended, 1) < 1e-3);
+        }
+    }
+    SECTION( "CLAHE matches cv::CLAHE" ) {
+        cv::Mat expected;
+        cv::createCLAHE(2, cv::Size(32, 32))->apply(image, expected);
+        for(SimdLevel level : supportedSimdLevels()) {
+            INFO("SIMD level: " << simd_level_to_str(level));
+            SimdBuffers buffers;
+            cv::Mat equalized;
+            claheSimd(image, equalized, 2, cv::Size(32, 32), buffers, level);
+            REQUIRE(fractionDiffering(expected, equalized, 1) < 1e-3);
+        }
+    }
+}
+
+TEST_CASE( "processImage with SIMD kernels", "[simd]" ) {
+    const cv::Mat image = testImage();
+    PreprocessOptions opt{};
+    opt.add_border = true;
+    opt.use_hist_eq = true;
+    opt.use_thresholding = true;
+    ProcessingBuffers buffers, simd_buffers;
+    cv::Mat expected, output;
+    processImage(image, expected, opt, buffers);
+    opt.use_simd = true;
+    processImage(image, output, opt, simd_buffers);
+    REQUIRE(output.size() == expected.size());
+    REQUIRE(psnr(expected, output) > 30);
+}
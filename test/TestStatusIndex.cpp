@@ -0,0 +1,56 @@
+#include "StatusIndex.h"
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+
+using namespace deeplocalizer;
+
+namespace io = boost::filesystem;
+
+TEST_CASE( "StatusIndex", "[StatusIndex]" ) {
+    io::path dir = io::unique_path("/tmp/test_status_index_%%%%%%%%");
+    io::create_directories(dir);
+    const std::string path = (dir / "progress.json.index").string();
+
+    SECTION( "statuses round trip" ) {
+        ImageStatus tagged;
+        tagged.has_desc = true;
+        tagged.nb_tags = 42;
+        tagged.nb_excluded = 3;
+        tagged.desc_mtime = 1439000000;
+        StatusIndex::save(path, {"a.jpeg", "b \"quoted\".jpeg"}, {tagged, ImageStatus()});
+        auto index = StatusIndex::load(path);
+        REQUIRE(index.size() == 2);
+        REQUIRE(index.at("a.jpeg").has_desc);
+        REQUIRE(index.at("a.jpeg").nb_tags == 42);
+        REQUIRE(index.at("a.jpeg").nb_excluded == 3);
+        REQUIRE(index.at("a.jpeg").desc_mtime == 1439000000);
+        REQUIRE_FALSE(index.at("b \"quoted\".jpeg").has_desc);
+        REQUIRE(index.at("b \"quoted\".jpeg").nb_tags == -1);
+    }
+    SECTION( "a missing or broken index is empty" ) {
+        REQUIRE(StatusIndex::load(path).empty());
+        {
+            std::ofstream os(path);
+            os << "{\"images\": [{\"filename\": \"a.jpeg\"";
+        }
+        REQUIRE(StatusIndex::load(path).empty());
+    }
+    SECTION( "probe stats the description" ) {
+        const std::string desc = (dir / "a.jpeg.tagger.json").string();
+        REQUIRE_FALSE(ImageStatus::probe(desc).has_desc);
+        {
+            std::ofstream os(desc);
+            os << "{}";
+        }
+        ImageStatus status = ImageStatus::probe(desc);
+        REQUIRE(status.has_desc);
+        REQUIRE(status.desc_mtime == io::last_write_time(desc));
+        REQUIRE(status.nb_tags == -1);
+    }
+    io::remove_all(dir);
+}
@@ -0,0 +1,102 @@
+#include "TagGrid.h"
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <random>
+#include <set>
+
+using namespace deeplocalizer;
+
+static int64_t squaredDistance(cv::Point2i a, cv::Point2i b) {
+    const int64_t dx = a.x - b.x;
+    const int64_t dy = a.y - b.y;
+    return dx * dx + dy * dy;
+}
+
+TEST_CASE( "TagGrid", "[taggrid]" ) {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> coordinate(-200, 4200);
+    std::vector<Tag> tags;
+    std::vector<bool> alive;
+    TagGrid grid;
+    for(size_t i = 0; i < 2000; i++) {
+        tags.push_back(Tag::fromCenter(cv::Point2i(coordinate(gen), coordinate(gen))));
+        alive.push_back(true);
+        grid.insert(i, tags.back().getBoundingBox());
+    }
+    for(size_t i = 0; i < tags.size(); i += 3) {
+        REQUIRE(grid.erase(i));
+        alive.at(i) = false;
+    }
+    REQUIRE_FALSE(grid.erase(0));
+    // moving a tag
+    tags.at(1) = Tag::fromCenter(cv::Point2i(10, 10));
+    grid.insert(1, tags.at(1).getBoundingBox());
+    REQUIRE(grid.size() == 2000 - 667);
+
+    SECTION( "point queries find the closest tag containing the point" ) {
+        REQUIRE((grid.at(cv::Point2i(10, 10)) == boost::optional<size_t>(1)));
+        for(int q = 0; q < 300; q++) {
+            cv::Point2i point(coordinate(gen), coordinate(gen));
+            int64_t closest = -1;
+            for(size_t i = 0; i < tags.size(); i++) {
+                if (alive.at(i) && tags.at(i).getBoundingBox().contains(point)) {
+                    if (closest < 0 || squaredDistance(point, tags.at(i).center()) <
+                                       squaredDistance(point, tags.at(closest).center())) {
+                        closest = i;
+                    }
+                }
+            }
+            auto found = grid.at(point);
+            REQUIRE(static_cast<bool>(found) == (closest >= 0));
+            if (found) {
+                REQUIRE(squaredDistance(point, tags.at(*found).center()) ==
+                        squaredDistance(point, tags.at(closest).center()));
+            }
+        }
+    }
+    SECTION( "rectangle and radius queries match a linear scan" ) {
+        for(int q = 0; q < 300; q++) {
+            cv::Rect rect(coordinate(gen), coordinate(gen), q % 700, q % 300);
+            cv::Point2i center(coordinate(gen), coordinate(gen));
+            double radius = q % 200 + 0.5;
+            std::set<size_t> in_rect, in_radius;
+            for(size_t i = 0; i < tags.size(); i++) {
+                if (not alive.at(i)) {
+                    continue;
+                }
+                if ((tags.at(i).getBoundingBox() & rect).area() > 0) {
+                    in_rect.insert(i);
+                }
+                if (squaredDistance(center, tags.at(i).center()) <= radius * radius) {
+                    in_radius.insert(i);
+                }
+            }
+            auto intersecting = grid.intersecting(rect);
+            auto within = grid.within(center, radius);
+            REQUIRE(std::set<size_t>(intersecting.begin(), intersecting.end()) == in_rect);
+            REQUIRE(intersecting.size() == in_rect.size());
+            REQUIRE(std::set<size_t>(within.begin(), within.end()) == in_radius);
+            REQUIRE(within.size() == in_radius.size());
+        }
+    }
+}
+
+TEST_CASE( "mergeNearDuplicates", "[taggrid]" ) {
+    std::vector<Tag> tags;
+    for(int i = 0; i < 4; i++) {
+        tags.push_back(Tag::fromCenter(cv::Point2i(100 + 10 * i, 100)));
+    }
+    tags.at(2).setEllipse(TagEllipse{5, {50, 50}, {20, 20}, 0.});
+    tags.push_back(Tag::fromCenter(cv::Point2i(500, 500)));
+
+    auto merged = mergeNearDuplicates(tags, 15);
+    REQUIRE(merged.size() == 3);
+    // the tag with the ellipse wins over its neighbours, then the first one
+    // that is far enough from it
+    REQUIRE(merged.at(0) == tags.at(0));
+    REQUIRE(merged.at(1) == tags.at(2));
+    REQUIRE(merged.at(2) == tags.at(4));
+    REQUIRE(mergeNearDuplicates(tags, 0).size() == tags.size());
+}
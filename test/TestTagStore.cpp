@@ -0,0 +1,87 @@
+#include <fstream>
+#include <iterator>
+
+#include "TagStore.h"
+#include "Image.h"
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+using namespace deeplocalizer;
+
+namespace io = boost::filesystem;
+
+TEST_CASE( "TagStore", "[tagstore]" ) {
+    io::path dir = io::unique_path("/tmp/test_tagstore_%%%%%%%%");
+    io::create_directories(dir);
+    io::path path = dir / ("tags" + TagStore::EXTENSION);
+    auto proposals = ImageDesc::load("testdata/Cam_2_20150828143300_888543_wb.jpeg.proposal.json");
+    auto tagged = ImageDesc::load("testdata/Cam_2_20150828143300_888543_wb.jpeg.tagger.json");
+    tagged->filename = "b/tagged.jpeg";
+    proposals->filename = "a/proposals.jpeg";
+    ImageDesc empty("c/empty.jpeg");
+    REQUIRE(not proposals->getTags().empty());
+    REQUIRE(proposals->getTags().front().ellipse());
+    {
+        TagStoreWriter writer(path);
+        tagged->save(writer);
+        proposals->save(writer);
+        empty.save(writer);
+        writer.save();
+    }
+    SECTION( "images round trip in filename order" ) {
+        TagStore store(path);
+        REQUIRE(store.size() == 3);
+        REQUIRE(store.filename(0) == proposals->filename);
+        REQUIRE(store.filename(1) == tagged->filename);
+        REQUIRE(store.at(0) == *proposals);
+        REQUIRE(store.at(1) == *tagged);
+        REQUIRE(store.at(2) == empty);
+        auto loaded = ImageDesc::load(store, tagged->filename);
+        REQUIRE(loaded);
+        REQUIRE(*loaded == *tagged);
+        REQUIRE_FALSE(ImageDesc::load(store, "d/missing.jpeg"));
+        REQUIRE_FALSE(store.contains("a"));
+    }
+    SECTION( "the binary store is smaller than the JSON files" ) {
+        REQUIRE(io::file_size(path) <
+                io::file_size("testdata/Cam_2_20150828143300_888543_wb.jpeg.proposal.json"));
+    }
+    SECTION( "updating a store keeps the other images" ) {
+        TagStoreWriter writer(path);
+        REQUIRE(writer.size() == 3);
+        tagged->setTags({});
+        tagged->save(writer);
+        writer.save();
+        TagStore store(path);
+        REQUIRE(store.size() == 3);
+        REQUIRE(store.find(tagged->filename)->getTags().empty());
+        REQUIRE(*store.find(proposals->filename) == *proposals);
+    }
+    SECTION( "an unknown tag type is an error" ) {
+        io::path corrupt_path = dir / ("corrupt" + TagStore::EXTENSION);
+        ImageDesc corrupt("corrupt.jpeg", {Tag::fromCenter(cv::Point2i(10, 10))});
+        REQUIRE(corrupt.getTags().front().center() == cv::Point2i(10, 10));
+        {
+            TagStoreWriter writer(corrupt_path);
+            corrupt.save(writer);
+            writer.save();
+        }
+        {
+            std::fstream file(corrupt_path.string(), std::ios::in | std::ios::out | std::ios::binary);
+            std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            // the filename, one tag, its center as two one-byte varints, its type
+            const size_t type_pos = bytes.find(corrupt.filename) + corrupt.filename.size() + 3;
+            file.clear();
+            file.seekp(static_cast<std::streamoff>(type_pos));
+            file.put(0x7f);
+        }
+        TagStore store(corrupt_path);
+        REQUIRE(store.filename(0) == corrupt.filename);
+        REQUIRE_THROWS(store.at(0));
+    }
+    SECTION( "files of other formats are rejected" ) {
+        REQUIRE_THROWS(TagStore("testdata/Cam_2_20150828143300_888543_wb.jpeg.proposal.json"));
+    }
+    io::remove_all(dir);
+}
@@ -0,0 +1,151 @@
+#include "TagTable.h"
+#include "TagStore.h"
+#include "Image.h"
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+using namespace deeplocalizer;
+
+namespace io = boost::filesystem;
+
+TEST_CASE( "TagTable", "[tagtable]" ) {
+    auto proposals = ImageDesc::load("testdata/Cam_2_20150828143300_888543_wb.jpeg.proposal.json");
+    auto tagged = ImageDesc::load("testdata/Cam_2_20150828143300_888543_wb.jpeg.tagger.json");
+    proposals->filename = "season/cam_2/proposals.jpeg";
+    tagged->filename = "season/cam_2/tagged.jpeg";
+    ImageDesc empty("empty.jpeg");
+    REQUIRE(not proposals->getTags().empty());
+    REQUIRE(proposals->getTags().front().ellipse());
+
+    TagTable table;
+    table.add(*proposals);
+    table.add(empty);
+    table.add(*tagged);
+    const size_t nb_tags = proposals->getTags().size() + tagged->getTags().size();
+
+    SECTION( "images round trip" ) {
+        REQUIRE(table.nbImages() == 3);
+        REQUIRE(table.size() == nb_tags);
+        REQUIRE(table.filename(0) == proposals->filename);
+        REQUIRE(table.filename(1) == empty.filename);
+        REQUIRE(table.filename(2) == tagged->filename);
+        REQUIRE(table.imageDesc(0) == *proposals);
+        REQUIRE(table.imageDesc(1) == empty);
+        REQUIRE(table.imageDesc(2) == *tagged);
+    }
+    SECTION( "views behave like tags" ) {
+        auto range = table.tagsOf(2);
+        REQUIRE(range.first == proposals->getTags().size());
+        REQUIRE(range.second == nb_tags);
+        REQUIRE(table.tagsOf(1).first == table.tagsOf(1).second);
+        for(size_t i = range.first; i < range.second; i++) {
+            const Tag & tag = tagged->getTags().at(i - range.first);
+            TagView view = table.tag(i);
+            REQUIRE(view.image() == 2);
+            REQUIRE(view.center() == tag.center());
+            REQUIRE(view.getBoundingBox() == tag.getBoundingBox());
+            REQUIRE(view.type() == tag.type());
+            REQUIRE(view.isTag() == tag.isTag());
+            REQUIRE((view.ellipse() == tag.ellipse()));
+            REQUIRE(view.toTag() == tag);
+        }
+        REQUIRE(table.imageOf(0) == 0);
+        REQUIRE(table.imageOf(range.first - 1) == 0);
+    }
+    SECTION( "filters select the same tags as a loop over the descriptions" ) {
+        for(auto type : {IsTag, NoTag, Exclude, BeeWithoutTag}) {
+            std::vector<uint32_t> expected;
+            size_t i = 0;
+            for(const auto & desc : {proposals, tagged}) {
+                for(const auto & tag : desc->getTags()) {
+                    if (tag.type() == type) {
+                        expected.push_back(static_cast<uint32_t>(i));
+                    }
+                    i++;
+                }
+            }
+            REQUIRE(table.withType(type) == expected);
+        }
+        const int min_vote = proposals->getTags().front().ellipse()->vote;
+        std::vector<uint32_t> expected;
+        for(size_t i = 0; i < table.size(); i++) {
+            auto ellipse = table.tag(i).ellipse();
+            if (ellipse && ellipse->vote >= min_vote) {
+                expected.push_back(static_cast<uint32_t>(i));
+            }
+        }
+        REQUIRE(not expected.empty());
+        REQUIRE(table.withVote(min_vote) == expected);
+        REQUIRE(table.withVote(TagTable::NO_VOTE).size() <= table.size());
+
+        auto voted_tags = table.withType(expected, IsTag);
+        for(auto i : voted_tags) {
+            REQUIRE(table.tag(i).isTag());
+        }
+    }
+    SECTION( "filters handle blocks with all, no and some tags selected" ) {
+        // a full block of tags, a block without, and a mixed block that ends early
+        ImageDesc many("many.jpeg");
+        std::vector<uint32_t> expected;
+        for(uint32_t i = 0; i < 700; i++) {
+            Tag tag = Tag::fromCenter(cv::Point2i(100, 100));
+            const bool is_tag = i < 256 || (i >= 512 && i % 3 == 0);
+            tag.setType(is_tag ? IsTag : NoTag);
+            many.addTag(tag);
+            if (is_tag) {
+                expected.push_back(i);
+            }
+        }
+        TagTable blocks;
+        blocks.add(many);
+        REQUIRE(blocks.withType(IsTag) == expected);
+        REQUIRE(blocks.withType(Exclude).empty());
+        std::vector<uint32_t> odd;
+        for(uint32_t i = 1; i < 700; i += 2) {
+            odd.push_back(i);
+        }
+        std::vector<uint32_t> odd_tags;
+        std::copy_if(odd.begin(), odd.end(), std::back_inserter(odd_tags),
+                     [&](uint32_t i) { return blocks.tag(i).isTag(); });
+        REQUIRE(blocks.withType(odd, IsTag) == odd_tags);
+    }
+    SECTION( "filenames share their directory" ) {
+        TagTable many;
+        size_t before = 0;
+        for(int i = 0; i < 100; i++) {
+            many.add(ImageDesc("a/rather/long/directory/of/a/season/image_" + std::to_string(i) + ".jpeg"));
+            if (i == 0) {
+                many.shrinkToFit();
+                before = many.memoryUsage();
+            }
+        }
+        many.shrinkToFit();
+        REQUIRE(many.filename(42) == "a/rather/long/directory/of/a/season/image_42.jpeg");
+        // every further image only adds its basename and a few offsets
+        REQUIRE(many.memoryUsage() - before < 99 * 32);
+    }
+    SECTION( "rejects centers that do not fit into 16 bits" ) {
+        ImageDesc huge("huge.jpeg", {Tag::fromCenter(cv::Point2i(40000, 10))});
+        REQUIRE_THROWS(table.add(huge));
+    }
+    SECTION( "loads a tag store" ) {
+        io::path dir = io::unique_path("/tmp/test_tagtable_%%%%%%%%");
+        io::create_directories(dir);
+        io::path path = dir / ("tags" + TagStore::EXTENSION);
+        {
+            TagStoreWriter writer(path);
+            proposals->save(writer);
+            tagged->save(writer);
+            writer.save();
+        }
+        TagTable loaded = TagTable::fromStore(TagStore(path));
+        REQUIRE(loaded.nbImages() == 2);
+        REQUIRE(loaded.imageDesc(0) == *proposals);
+        REQUIRE(loaded.imageDesc(1) == *tagged);
+        io::remove_all(dir);
+    }
+}
@@ -0,0 +1,80 @@
+
+#include "ThreadingPolicy.h"
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <opencv2/core/core.hpp>
+
+#include <set>
+#include <thread>
+
+using namespace deeplocalizer;
+
+TEST_CASE( "ThreadingPolicy", "[threading]" ) {
+    SECTION( "parallelism names" ) {
+        for(auto parallelism : {Parallelism::Frames, Parallelism::IntraFrame, Parallelism::Auto}) {
+            REQUIRE(parallelism_from_str(parallelism_to_str(parallelism)) == parallelism);
+        }
+        REQUIRE_THROWS(parallelism_from_str("fast"));
+    }
+    SECTION( "every allowed CPU is on one NUMA node" ) {
+        std::set<int> cpus;
+        size_t nb_cpus = 0;
+        for(const auto & node : cpusByNumaNode()) {
+            REQUIRE(not node.empty());
+            cpus.insert(node.begin(), node.end());
+            nb_cpus += node.size();
+        }
+        REQUIRE(nb_cpus == cpus.size());
+        REQUIRE(ThreadingPolicy().nbCores() == nb_cpus);
+    }
+    SECTION( "frame parallelism runs OpenCV single threaded" ) {
+        ThreadingPolicy policy(Parallelism::Frames);
+        REQUIRE(policy.frameThreads(0) == policy.nbCores());
+        REQUIRE(policy.frameThreads(3) == 3);
+        REQUIRE(policy.opencvThreads() == 1);
+    }
+    SECTION( "intra-frame parallelism processes one frame at a time" ) {
+        ThreadingPolicy policy(Parallelism::IntraFrame);
+        REQUIRE(policy.frameThreads(0) == 1);
+        REQUIRE(policy.opencvThreads() == static_cast<int>(policy.nbCores()));
+        if (policy.nbCores() > 1) {
+            policy.apply();
+            REQUIRE(cv::getNumThreads() == policy.opencvThreads());
+        }
+    }
+    SECTION( "threads that do not call OpenCV" ) {
+        for(auto parallelism : {Parallelism::Frames, Parallelism::IntraFrame}) {
+            ThreadingPolicy policy(parallelism);
+            REQUIRE(policy.workerThreads(0) == policy.nbCores());
+            REQUIRE(policy.workerThreads(5) == 5);
+        }
+    }
+    SECTION( "the policy of the process" ) {
+        REQUIRE(processPolicy().parallelism() == Parallelism::Frames);
+        setProcessPolicy(ThreadingPolicy(Parallelism::IntraFrame));
+        REQUIRE(processPolicy().parallelism() == Parallelism::IntraFrame);
+        if (processPolicy().nbCores() > 1) {
+            REQUIRE(cv::getNumThreads() == processPolicy().opencvThreads());
+        }
+        setProcessPolicy(ThreadingPolicy(Parallelism::Frames));
+    }
+    SECTION( "auto has to be resolved first" ) {
+        REQUIRE_THROWS(ThreadingPolicy(Parallelism::Auto));
+    }
+#ifdef __linux__
+    SECTION( "pinned workers run on one CPU" ) {
+        // pinned on its own thread, so the test thread keeps its affinity
+        bool pinned = false;
+        bool unpinned = true;
+        std::thread worker([&]() {
+            pinned = ThreadingPolicy(Parallelism::Frames, true).pinWorker(0);
+            unpinned = ThreadingPolicy(Parallelism::Frames, false).pinWorker(0);
+        });
+        worker.join();
+        REQUIRE(pinned);
+        REQUIRE(not unpinned);
+    }
+#endif
+}
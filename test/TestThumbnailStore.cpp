@@ -0,0 +1,39 @@
+#include "ThumbnailStore.h"
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+using namespace deeplocalizer;
+
+namespace io = boost::filesystem;
+
+TEST_CASE( "ThumbnailStore", "[ThumbnailStore]" ) {
+    io::path dir = io::unique_path("/tmp/test_thumbnails_%%%%%%%%");
+    ThumbnailStore store(dir / "store");
+    const std::string frame = "testdata/Cam_0_20140804152006_3.jpeg";
+
+    SECTION( "thumbnails are 32 times smaller" ) {
+        cv::Mat thumbnail = ThumbnailStore::make(frame);
+        REQUIRE(thumbnail.cols == 125);
+        REQUIRE(thumbnail.rows == 94);
+        REQUIRE(thumbnail.channels() == 1);
+    }
+    SECTION( "the key depends on the content, not on the path" ) {
+        io::path copy = dir / "renamed.jpeg";
+        io::copy_file(frame, copy);
+        REQUIRE(ThumbnailStore::contentKey(frame) == ThumbnailStore::contentKey(copy.string()));
+        REQUIRE(ThumbnailStore::contentKey(frame) !=
+                ThumbnailStore::contentKey("testdata/with_5_tags.jpeg"));
+    }
+    SECTION( "load stores the thumbnail" ) {
+        REQUIRE_FALSE(io::exists(store.pathOf(frame)));
+        ImagePtr made = store.load(frame);
+        REQUIRE(made->filename() == frame);
+        REQUIRE(io::exists(store.pathOf(frame)));
+        const auto mtime = io::last_write_time(store.pathOf(frame));
+        ImagePtr stored = store.load(frame);
+        REQUIRE(io::last_write_time(store.pathOf(frame)) == mtime);
+        REQUIRE(cv::countNonZero(made->getCvMat() != stored->getCvMat()) == 0);
+    }
+    io::remove_all(dir);
+}
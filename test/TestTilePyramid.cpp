@@ -0,0 +1,56 @@
+#include "TilePyramid.h"
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+using namespace deeplocalizer;
+
+TEST_CASE( "TilePyramid", "[TilePyramid]" ) {
+    cv::Mat mat(3000, 4000, CV_8U, cv::Scalar(128));
+    TilePyramid pyramid(mat, 256);
+
+    SECTION( "halves the image until it fits into one tile" ) {
+        REQUIRE(pyramid.levels() == 5);
+        REQUIRE(pyramid.level(0).data == mat.data);
+        REQUIRE(pyramid.level(1).cols == 2000);
+        REQUIRE(pyramid.level(1).rows == 1500);
+        REQUIRE(pyramid.level(4).cols == 250);
+        REQUIRE(pyramid.level(4).rows == 188);
+    }
+    SECTION( "max_levels stops early" ) {
+        TilePyramid level0(mat, 256, 1);
+        REQUIRE(level0.levels() == 1);
+        REQUIRE(level0.level(0).data == mat.data);
+    }
+    SECTION( "picks the smallest level with enough resolution" ) {
+        REQUIRE(pyramid.levelFor(2.0) == 0);
+        REQUIRE(pyramid.levelFor(0.8) == 0);
+        REQUIRE(pyramid.levelFor(0.5) == 1);
+        REQUIRE(pyramid.levelFor(0.3) == 1);
+        REQUIRE(pyramid.levelFor(0.2) == 2);
+        REQUIRE(pyramid.levelFor(0.001) == 4);
+    }
+    SECTION( "only the tiles that intersect the area" ) {
+        auto tiles = pyramid.tiles(0, cv::Rect(300, 10, 300, 10));
+        REQUIRE(tiles.size() == 2);
+        REQUIRE(tiles.at(0) == cv::Rect(256, 0, 256, 256));
+        REQUIRE(tiles.at(1) == cv::Rect(512, 0, 256, 256));
+
+        auto corner = pyramid.tiles(0, cv::Rect(3900, 2900, 500, 500));
+        REQUIRE(corner.size() == 1);
+        REQUIRE(corner.at(0) == cv::Rect(3840, 2816, 160, 184));
+        REQUIRE(pyramid.tile(0, corner.at(0)).cols == 160);
+
+        REQUIRE(pyramid.tiles(0, cv::Rect(-100, -100, 50, 50)).empty());
+        REQUIRE(pyramid.tiles(4, cv::Rect(0, 0, 10000, 10000)).size() == 1);
+    }
+    SECTION( "the tiles of a level cover it" ) {
+        auto tiles = pyramid.tiles(1, cv::Rect(0, 0, 2000, 1500));
+        REQUIRE(tiles.size() == 8 * 6);
+        long area = 0;
+        for(const auto & tile : tiles) {
+            area += tile.area();
+        }
+        REQUIRE(area == 2000 * 1500);
+    }
+}